@@ -0,0 +1,211 @@
+#include "AmbientOcclusion.h"
+
+#include <glm\gtc\type_ptr.hpp>
+
+static constexpr unsigned int DEPTH_MAP = UniformHash("depthMap");
+static constexpr unsigned int PROJECTION = UniformHash("projection");
+static constexpr unsigned int INVERSE_PROJECTION = UniformHash("inverseProjection");
+static constexpr unsigned int OCCLUSION_MAP = UniformHash("occlusionMap");
+static constexpr unsigned int AMBIENT_OCCLUSION = UniformHash("ambientOcclusion");
+static constexpr unsigned int OCCLUSION_SCALE = UniformHash("occlusionScale");
+
+AmbientOcclusion::AmbientOcclusion()
+{
+	depthFBO = 0;
+	occlusionFBO = 0;
+	blurFBO = 0;
+	depthTexture = 0;
+	occlusionTexture = 0;
+	blurredTexture = 0;
+	emptyVAO = 0;
+	divisor = 0;
+
+	windowWidth = 0;
+	windowHeight = 0;
+	width = 0;
+	height = 0;
+}
+
+void AmbientOcclusion::CreateFromFiles(const char* vertexLocation, const char* occlusionLocation, const char* blurLocation, unsigned int divisor)
+{
+	this->divisor = divisor;
+
+	occlusionShader.CreateFromFiles(vertexLocation, occlusionLocation);
+	blurShader.CreateFromFiles(vertexLocation, blurLocation);
+}
+
+bool AmbientOcclusion::Resize(GLint windowWidth, GLint windowHeight)
+{
+	if (divisor == 0)
+	{
+		return false;
+	}
+
+	if (depthFBO != 0 && windowWidth == this->windowWidth && windowHeight == this->windowHeight)
+	{
+		return true;
+	}
+
+	ClearTargets();
+
+	width = (windowWidth + divisor - 1) / divisor;
+	height = (windowHeight + divisor - 1) / divisor;
+
+	depthTexture = CreateTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+	// r - how much ambient light reaches the point, g - its distance along the view,
+	// which the blur and the upsample compare
+	occlusionTexture = CreateTarget(GL_RG16F, GL_RG, GL_HALF_FLOAT);
+	blurredTexture = CreateTarget(GL_RG16F, GL_RG, GL_HALF_FLOAT);
+
+	if (!CreateFramebuffer(depthFBO, GL_DEPTH_ATTACHMENT, depthTexture) ||
+		!CreateFramebuffer(occlusionFBO, GL_COLOR_ATTACHMENT0, occlusionTexture) ||
+		!CreateFramebuffer(blurFBO, GL_COLOR_ATTACHMENT0, blurredTexture))
+	{
+		ClearTargets();
+		// No ambient occlusion from now on, rather than retrying every frame
+		divisor = 0;
+		return false;
+	}
+
+	this->windowWidth = windowWidth;
+	this->windowHeight = windowHeight;
+
+	return true;
+}
+
+GLuint AmbientOcclusion::CreateTarget(GLenum internalFormat, GLenum format, GLenum type)
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+
+	// Read with texelFetch, the upsample weighs its own taps
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return texture;
+}
+
+bool AmbientOcclusion::CreateFramebuffer(GLuint& FBO, GLenum attachment, GLuint texture)
+{
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+	if (attachment == GL_DEPTH_ATTACHMENT)
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Ambient occlusion framebuffer error: 0x%x\n", status);
+		return false;
+	}
+
+	return true;
+}
+
+void AmbientOcclusion::BeginDepth()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+	glViewport(0, 0, width, height);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void AmbientOcclusion::RenderOcclusion(const glm::mat4& projection)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, occlusionFBO);
+
+	if (emptyVAO == 0)
+	{
+		glGenVertexArrays(1, &emptyVAO);
+	}
+	glBindVertexArray(emptyVAO);
+
+	occlusionShader.UseShader();
+	glUniform1i(occlusionShader.GetUniformLocation(DEPTH_MAP), AMBIENT_OCCLUSION_TEXTURE_UNIT);
+	glUniformMatrix4fv(occlusionShader.GetUniformLocation(PROJECTION), 1, GL_FALSE, glm::value_ptr(projection));
+	glm::mat4 inverseProjection = glm::inverse(projection);
+	glUniformMatrix4fv(occlusionShader.GetUniformLocation(INVERSE_PROJECTION), 1, GL_FALSE, glm::value_ptr(inverseProjection));
+
+	glActiveTexture(GL_TEXTURE0 + AMBIENT_OCCLUSION_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+}
+
+void AmbientOcclusion::RenderBlur()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+	glBindVertexArray(emptyVAO);
+
+	blurShader.UseShader();
+	glUniform1i(blurShader.GetUniformLocation(OCCLUSION_MAP), AMBIENT_OCCLUSION_TEXTURE_UNIT);
+
+	glActiveTexture(GL_TEXTURE0 + AMBIENT_OCCLUSION_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, occlusionTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+void AmbientOcclusion::UseOcclusion(Shader* shader)
+{
+	glActiveTexture(GL_TEXTURE0 + AMBIENT_OCCLUSION_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, blurredTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(shader->GetUniformLocation(AMBIENT_OCCLUSION), AMBIENT_OCCLUSION_TEXTURE_UNIT);
+	// Takes gl_FragCoord to the occlusion map's texels
+	glUniform2f(shader->GetUniformLocation(OCCLUSION_SCALE), (GLfloat)width / windowWidth, (GLfloat)height / windowHeight);
+}
+
+void AmbientOcclusion::ClearTargets()
+{
+	GLuint framebuffers[] = { depthFBO, occlusionFBO, blurFBO };
+	glDeleteFramebuffers(3, framebuffers);
+	depthFBO = 0;
+	occlusionFBO = 0;
+	blurFBO = 0;
+
+	GLuint textures[] = { depthTexture, occlusionTexture, blurredTexture };
+	glDeleteTextures(3, textures);
+	depthTexture = 0;
+	occlusionTexture = 0;
+	blurredTexture = 0;
+
+	windowWidth = 0;
+	windowHeight = 0;
+}
+
+void AmbientOcclusion::ClearOcclusion()
+{
+	ClearTargets();
+
+	if (emptyVAO != 0)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+		emptyVAO = 0;
+	}
+
+	occlusionShader.ClearShader();
+	blurShader.ClearShader();
+}
+
+AmbientOcclusion::~AmbientOcclusion()
+{
+}
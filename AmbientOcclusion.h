@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <GL\glew.h>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+#include "Shader.h"
+
+// Screen-space ambient occlusion at a half or a quarter of the window's
+// resolution. The visible objects' depths are drawn at that size, ssao.frag
+// rebuilds positions and normals from them and samples around each one, and
+// ssaoblur.frag smooths the noise without crossing depth edges. The forward
+// shader upsamples the result against each fragment's own depth.
+class AmbientOcclusion
+{
+public:
+	AmbientOcclusion();
+
+	// divisor - 2 for half resolution, 4 for quarter; vertexLocation draws a full-screen triangle
+	void CreateFromFiles(const char* vertexLocation, const char* occlusionLocation, const char* blurLocation, unsigned int divisor);
+
+	// Makes or remakes the targets for a window of the given size; false when there are none
+	bool Resize(GLint windowWidth, GLint windowHeight);
+
+	// Binds and clears the depth target; the caller draws depth with the camera the colour pass will use
+	void BeginDepth();
+	// Occlusion from the depths, with the projection they were drawn with
+	void RenderOcclusion(const glm::mat4& projection);
+	// Depth-aware blur, then rebinds the default framebuffer at the window's size
+	void RenderBlur();
+
+	// For an AMBIENT_OCCLUSION_ENABLED shader, which must be in use
+	void UseOcclusion(Shader* shader);
+
+	unsigned int GetDivisor() { return divisor; }
+
+	void ClearOcclusion();
+
+	~AmbientOcclusion();
+
+private:
+	Shader occlusionShader, blurShader;
+	GLuint depthFBO, occlusionFBO, blurFBO;
+	GLuint depthTexture, occlusionTexture, blurredTexture;
+	GLuint emptyVAO;
+	unsigned int divisor;
+
+	GLint windowWidth, windowHeight;
+	GLsizei width, height;
+
+	void ClearTargets();
+	GLuint CreateTarget(GLenum internalFormat, GLenum format, GLenum type);
+	bool CreateFramebuffer(GLuint& FBO, GLenum attachment, GLuint texture);
+};
@@ -0,0 +1,374 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+BVH::BVH() : nodeCount(0)
+{
+}
+
+void BVH::Build(const std::vector<AABB>& bounds, JobSystem& jobs)
+{
+	Clear();
+
+	if (bounds.empty())
+	{
+		return;
+	}
+
+	unsigned int itemCount = (unsigned int)bounds.size();
+
+	itemBounds = bounds;
+	itemCentres.resize(itemCount);
+	itemOrder.resize(itemCount);
+	itemLeaf.assign(itemCount, -1);
+	for (unsigned int i = 0; i < itemCount; i++)
+	{
+		itemCentres[i] = bounds[i].GetCentre();
+		itemOrder[i] = i;
+	}
+
+	// A binary tree with single-item leaves at worst has 2n - 1 nodes
+	nodes.resize(2 * itemCount - 1);
+	nodeCount = 1;
+	nodes[0].parent = -1;
+
+	JobCounter built;
+	BuildNode(0, 0, itemCount, 0, jobs, &built);
+	jobs.Wait(&built);
+
+	nodes.resize(nodeCount.load());
+}
+
+void BVH::Clear()
+{
+	nodes.clear();
+	itemBounds.clear();
+	itemCentres.clear();
+	itemOrder.clear();
+	itemLeaf.clear();
+	nodeCount = 0;
+}
+
+void BVH::BuildNode(unsigned int nodeIndex, unsigned int first, unsigned int count, unsigned int depth, JobSystem& jobs, JobCounter* counter)
+{
+	Node& node = nodes[nodeIndex];
+
+	AABB centreBounds;
+	node.bounds = AABB();
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		node.bounds.Grow(itemBounds[itemOrder[i]]);
+		centreBounds.Grow(itemCentres[itemOrder[i]]);
+	}
+
+	if (count <= MAX_LEAF_ITEMS)
+	{
+		MakeLeaf(nodeIndex, first, count);
+		return;
+	}
+
+	unsigned int* begin = &itemOrder[first];
+	unsigned int* end = begin + count;
+	unsigned int leftCount = 0;
+
+	int axis = 0;
+	float position = 0.0f;
+	if (depth < MAX_SAH_DEPTH && FindSplit(node, first, count, centreBounds, axis, position))
+	{
+		unsigned int* middle = std::partition(begin, end, [this, axis, position](unsigned int item)
+		{
+			return itemCentres[item][axis] < position;
+		});
+		leftCount = (unsigned int)(middle - begin);
+	}
+	else
+	{
+		// SAH prefers a leaf but it would be too big, or the tree is getting too deep
+		// for the query stacks; split at the median of the widest axis instead
+		glm::vec3 extent = centreBounds.GetExtent();
+		axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	}
+
+	if (leftCount == 0 || leftCount == count)
+	{
+		leftCount = count / 2;
+		std::nth_element(begin, begin + leftCount, end, [this, axis](unsigned int a, unsigned int b)
+		{
+			return itemCentres[a][axis] < itemCentres[b][axis];
+		});
+	}
+
+	unsigned int left = nodeCount.fetch_add(2);
+	node.left = (int)left;
+	node.count = 0;
+	node.first = 0;
+	nodes[left].parent = (int)nodeIndex;
+	nodes[left + 1].parent = (int)nodeIndex;
+
+	// Big subtrees go to other workers; the counter keeps Build waiting for all of them
+	if (leftCount >= PARALLEL_BUILD_ITEMS)
+	{
+		jobs.Run([this, left, first, leftCount, depth, &jobs, counter]()
+		{
+			BuildNode(left, first, leftCount, depth + 1, jobs, counter);
+		}, counter);
+	}
+	else
+	{
+		BuildNode(left, first, leftCount, depth + 1, jobs, counter);
+	}
+
+	BuildNode(left + 1, first + leftCount, count - leftCount, depth + 1, jobs, counter);
+}
+
+void BVH::MakeLeaf(unsigned int nodeIndex, unsigned int first, unsigned int count)
+{
+	Node& node = nodes[nodeIndex];
+	node.left = -1;
+	node.first = first;
+	node.count = count;
+
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		itemLeaf[itemOrder[i]] = (int)nodeIndex;
+	}
+}
+
+bool BVH::FindSplit(const Node& node, unsigned int first, unsigned int count, const AABB& centreBounds,
+	int& splitAxis, float& splitPosition) const
+{
+	float bestCost = FLT_MAX;
+	glm::vec3 extent = centreBounds.GetExtent();
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		AABB binBounds[BIN_COUNT];
+		unsigned int binCounts[BIN_COUNT] = { 0 };
+		float scale = BIN_COUNT / extent[axis];
+
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			unsigned int item = itemOrder[i];
+			unsigned int bin = std::min(BIN_COUNT - 1, (unsigned int)((itemCentres[item][axis] - centreBounds.min[axis]) * scale));
+			binCounts[bin]++;
+			binBounds[bin].Grow(itemBounds[item]);
+		}
+
+		// Sweep from the right to get the cost of everything past each plane
+		float rightArea[BIN_COUNT - 1];
+		unsigned int rightCount[BIN_COUNT - 1];
+		AABB sweep;
+		unsigned int sweepCount = 0;
+		for (unsigned int i = BIN_COUNT - 1; i > 0; i--)
+		{
+			sweep.Grow(binBounds[i]);
+			sweepCount += binCounts[i];
+			rightArea[i - 1] = sweep.GetSurfaceArea();
+			rightCount[i - 1] = sweepCount;
+		}
+
+		sweep = AABB();
+		sweepCount = 0;
+		for (unsigned int i = 0; i < BIN_COUNT - 1; i++)
+		{
+			sweep.Grow(binBounds[i]);
+			sweepCount += binCounts[i];
+
+			float cost = sweepCount * sweep.GetSurfaceArea() + rightCount[i] * rightArea[i];
+			if (sweepCount > 0 && rightCount[i] > 0 && cost < bestCost)
+			{
+				bestCost = cost;
+				splitAxis = axis;
+				splitPosition = centreBounds.min[axis] + (i + 1) / scale;
+			}
+		}
+	}
+
+	// Splitting has to beat intersecting every item of this node
+	return bestCost < count * node.bounds.GetSurfaceArea();
+}
+
+void BVH::UpdateItem(unsigned int item, const AABB& bounds)
+{
+	if (item >= itemBounds.size())
+	{
+		return;
+	}
+
+	itemBounds[item] = bounds;
+	itemCentres[item] = bounds.GetCentre();
+
+	int nodeIndex = itemLeaf[item];
+	while (nodeIndex >= 0)
+	{
+		AABB oldBounds = nodes[nodeIndex].bounds;
+		RefitNode(nodeIndex);
+
+		// Past this point nothing above can change
+		if (nodes[nodeIndex].bounds == oldBounds)
+		{
+			break;
+		}
+
+		nodeIndex = nodes[nodeIndex].parent;
+	}
+}
+
+void BVH::RefitNode(unsigned int nodeIndex)
+{
+	Node& node = nodes[nodeIndex];
+	node.bounds = AABB();
+
+	if (node.left < 0)
+	{
+		for (unsigned int i = node.first; i < node.first + node.count; i++)
+		{
+			node.bounds.Grow(itemBounds[itemOrder[i]]);
+		}
+	}
+	else
+	{
+		node.bounds.Grow(nodes[node.left].bounds);
+		node.bounds.Grow(nodes[node.left + 1].bounds);
+	}
+}
+
+template <typename Test>
+void BVH::Query(const Test& overlaps, std::vector<unsigned int>& items) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		if (!overlaps(node.bounds))
+		{
+			continue;
+		}
+
+		if (node.left < 0)
+		{
+			for (unsigned int i = node.first; i < node.first + node.count; i++)
+			{
+				unsigned int item = itemOrder[i];
+				if (overlaps(itemBounds[item]))
+				{
+					items.push_back(item);
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.left + 1;
+		}
+	}
+}
+
+void BVH::QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& items) const
+{
+	Query([&frustum](const AABB& box) { return frustum.Intersects(box); }, items);
+}
+
+void BVH::QuerySphere(const glm::vec3& centre, float radius, std::vector<unsigned int>& items) const
+{
+	Query([&centre, radius](const AABB& box) { return box.OverlapsSphere(centre, radius); }, items);
+}
+
+void BVH::QueryBox(const AABB& queryBox, std::vector<unsigned int>& items) const
+{
+	Query([&queryBox](const AABB& box) { return box.Overlaps(queryBox); }, items);
+}
+
+bool BVH::Raycast(const Ray& ray, float maxDistance, unsigned int& hitItem, float& hitDistance,
+	const std::function<bool(unsigned int item, float& distance)>& intersectItem) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	bool hit = false;
+	float closest = maxDistance;
+
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+
+		float entry;
+		if (!ray.Intersects(node.bounds, closest, entry))
+		{
+			continue;
+		}
+
+		if (node.left < 0)
+		{
+			for (unsigned int i = node.first; i < node.first + node.count; i++)
+			{
+				unsigned int item = itemOrder[i];
+				float distance;
+				if (!ray.Intersects(itemBounds[item], closest, distance))
+				{
+					continue;
+				}
+
+				if (intersectItem && !intersectItem(item, distance))
+				{
+					continue;
+				}
+
+				if (distance <= closest)
+				{
+					closest = distance;
+					hitItem = item;
+					hit = true;
+				}
+			}
+		}
+		else
+		{
+			// Visit the nearer child first so the far one is usually culled by closest
+			float leftEntry, rightEntry;
+			bool leftHit = ray.Intersects(nodes[node.left].bounds, closest, leftEntry);
+			bool rightHit = ray.Intersects(nodes[node.left + 1].bounds, closest, rightEntry);
+
+			if (leftHit && rightHit)
+			{
+				bool leftFirst = leftEntry <= rightEntry;
+				stack[stackSize++] = leftFirst ? node.left + 1 : node.left;
+				stack[stackSize++] = leftFirst ? node.left : node.left + 1;
+			}
+			else if (leftHit)
+			{
+				stack[stackSize++] = node.left;
+			}
+			else if (rightHit)
+			{
+				stack[stackSize++] = node.left + 1;
+			}
+		}
+	}
+
+	hitDistance = closest;
+	return hit;
+}
+
+BVH::~BVH()
+{
+}
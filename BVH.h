@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include "Bounds.h"
+#include "JobSystem.h"
+
+// Bounding volume hierarchy over a list of item bounds (scene objects, triangles).
+// Built top-down with a binned SAH; subtrees above a size threshold are built
+// as jobs. Items can be moved afterwards and only their path to the root is refit.
+class BVH
+{
+public:
+	BVH();
+
+	void Build(const std::vector<AABB>& itemBounds, JobSystem& jobs);
+	void Clear();
+
+	// Incremental refit after one item moved
+	void UpdateItem(unsigned int item, const AABB& bounds);
+
+	void QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& items) const;
+	void QuerySphere(const glm::vec3& centre, float radius, std::vector<unsigned int>& items) const;
+	void QueryBox(const AABB& box, std::vector<unsigned int>& items) const;
+
+	// Nearest hit along the ray. By default items are hit where the ray enters their
+	// bounds; intersectItem can refine that (return false for a miss, or shorten distance).
+	bool Raycast(const Ray& ray, float maxDistance, unsigned int& hitItem, float& hitDistance,
+		const std::function<bool(unsigned int item, float& distance)>& intersectItem = nullptr) const;
+
+	unsigned int GetItemCount() const { return (unsigned int)itemBounds.size(); }
+	unsigned int GetNodeCount() const { return nodeCount.load(); }
+	const AABB& GetItemBounds(unsigned int item) const { return itemBounds[item]; }
+	AABB GetBounds() const { return nodes.empty() ? AABB() : nodes[0].bounds; }
+
+	~BVH();
+
+private:
+	static const unsigned int BIN_COUNT = 16;
+	static const unsigned int MAX_LEAF_ITEMS = 4;
+	static const unsigned int PARALLEL_BUILD_ITEMS = 2048;
+
+	// Past MAX_SAH_DEPTH splits are forced to the median, which bounds the tree
+	// depth (and the traversal stacks) to MAX_SAH_DEPTH + 32
+	static const unsigned int MAX_SAH_DEPTH = 64;
+	static const unsigned int MAX_DEPTH = MAX_SAH_DEPTH + 34;
+
+	struct Node
+	{
+		AABB bounds;
+		int parent;
+		int left;				// right child is left + 1; -1 for a leaf
+		unsigned int first;		// leaf items are itemOrder[first, first + count)
+		unsigned int count;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<AABB> itemBounds;
+	std::vector<glm::vec3> itemCentres;
+	std::vector<unsigned int> itemOrder;
+	std::vector<int> itemLeaf;
+	std::atomic<unsigned int> nodeCount;
+
+	void BuildNode(unsigned int nodeIndex, unsigned int first, unsigned int count, unsigned int depth, JobSystem& jobs, JobCounter* counter);
+	void MakeLeaf(unsigned int nodeIndex, unsigned int first, unsigned int count);
+	bool FindSplit(const Node& node, unsigned int first, unsigned int count, const AABB& centreBounds,
+		int& splitAxis, float& splitPosition) const;
+	void RefitNode(unsigned int nodeIndex);
+
+	template <typename Test>
+	void Query(const Test& overlaps, std::vector<unsigned int>& items) const;
+};
+
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+
+#include <glm\glm.hpp>
+
+// Axis-aligned box; an empty box has min > max so any Grow makes it valid.
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB() : min(FLT_MAX), max(-FLT_MAX) {}
+	AABB(const glm::vec3& minimum, const glm::vec3& maximum) : min(minimum), max(maximum) {}
+
+	bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+	void Grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void Grow(const AABB& box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	glm::vec3 GetCentre() const { return (min + max) * 0.5f; }
+	glm::vec3 GetExtent() const { return max - min; }
+
+	float GetSurfaceArea() const
+	{
+		if (IsEmpty())
+		{
+			return 0.0f;
+		}
+
+		glm::vec3 extent = max - min;
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	bool Overlaps(const AABB& box) const
+	{
+		return min.x <= box.max.x && max.x >= box.min.x &&
+			min.y <= box.max.y && max.y >= box.min.y &&
+			min.z <= box.max.z && max.z >= box.min.z;
+	}
+
+	bool Contains(const glm::vec3& point) const
+	{
+		return point.x >= min.x && point.x <= max.x &&
+			point.y >= min.y && point.y <= max.y &&
+			point.z >= min.z && point.z <= max.z;
+	}
+
+	bool OverlapsSphere(const glm::vec3& centre, float radius) const
+	{
+		glm::vec3 closest = glm::max(min, glm::min(centre, max));
+		glm::vec3 offset = centre - closest;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	// Bounds of this box after transform, from its eight corners
+	AABB Transformed(const glm::mat4& transform) const
+	{
+		AABB result;
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+			result.Grow(glm::vec3(transform * glm::vec4(corner, 1.0f)));
+		}
+		return result;
+	}
+
+	bool operator==(const AABB& box) const { return min == box.min && max == box.max; }
+	bool operator!=(const AABB& box) const { return !(*this == box); }
+};
+
+// Six inward-facing planes (xyz normal, w distance) taken from a view-projection matrix
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	Frustum() {}
+
+	// ndcRect (x0, y0, x1, y1) narrows the sides to part of the screen, e.g. a portal
+	explicit Frustum(const glm::mat4& viewProjection, const glm::vec4& ndcRect = glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f))
+	{
+		const glm::mat4& m = viewProjection;
+		glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		planes[0] = row0 - row3 * ndcRect.x;	// left
+		planes[1] = row3 * ndcRect.z - row0;	// right
+		planes[2] = row1 - row3 * ndcRect.y;	// bottom
+		planes[3] = row3 * ndcRect.w - row1;	// top
+		planes[4] = row3 + row2;	// near
+		planes[5] = row3 - row2;	// far
+
+		for (int i = 0; i < 6; i++)
+		{
+			float length = glm::length(glm::vec3(planes[i]));
+			planes[i] = planes[i] / length;
+		}
+	}
+
+	// Conservative: may accept boxes just outside a corner of the frustum
+	bool Intersects(const AABB& box) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& plane = planes[i];
+
+			// Corner furthest along the plane normal
+			glm::vec3 positive(plane.x >= 0.0f ? box.max.x : box.min.x,
+				plane.y >= 0.0f ? box.max.y : box.min.y,
+				plane.z >= 0.0f ? box.max.z : box.min.z);
+
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 inverseDirection;
+
+	Ray(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) : origin(rayOrigin), direction(rayDirection)
+	{
+		inverseDirection = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	}
+
+	// Slab test; returns the entry distance through hitDistance, 0 when the origin is inside
+	bool Intersects(const AABB& box, float maxDistance, float& hitDistance) const
+	{
+		float exitDistance;
+		return Intersects(box, maxDistance, hitDistance, exitDistance);
+	}
+
+	bool Intersects(const AABB& box, float maxDistance, float& enterDistance, float& exitDistance) const
+	{
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		enterDistance = std::fmax(std::fmax(tNear.x, tNear.y), std::fmax(tNear.z, 0.0f));
+		exitDistance = std::fmin(std::fmin(tFar.x, tFar.y), std::fmin(tFar.z, maxDistance));
+
+		return enterDistance <= exitDistance;
+	}
+
+	// Moller-Trumbore, either winding. Distances are in units of direction, which
+	// needn't be normalised.
+	bool IntersectsTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float maxDistance, float& hitDistance) const
+	{
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::fabs(determinant) < 1e-8f)
+		{
+			return false;
+		}
+
+		float inverseDeterminant = 1.0f / determinant;
+		glm::vec3 toOrigin = origin - a;
+		float u = glm::dot(toOrigin, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+
+		glm::vec3 q = glm::cross(toOrigin, edge1);
+		float v = glm::dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+
+		float t = glm::dot(edge2, q) * inverseDeterminant;
+		if (t < 0.0f || t > maxDistance)
+		{
+			return false;
+		}
+
+		hitDistance = t;
+		return true;
+	}
+};
+
@@ -30,36 +30,47 @@ void Camera::keyControl(bool* keys, GLfloat deltaTime)
 	if (keys[GLFW_KEY_W])
 	{
 		position += front * velocity;
+		changed = true;
 	}
 
 	if (keys[GLFW_KEY_S])
 	{
 		position -= front * velocity;
+		changed = true;
 	}
 
 	if (keys[GLFW_KEY_A])
 	{
 		position -= right * velocity;
+		changed = true;
 	}
 
 	if (keys[GLFW_KEY_D])
 	{
 		position += right * velocity;
+		changed = true;
 	}
 
 	if (keys[GLFW_KEY_PAGE_UP])
 	{
 		fov -= fovDelta;
+		changed = true;
 	}
 
 	if (keys[GLFW_KEY_PAGE_DOWN])
 	{
 		fov += fovDelta;
+		changed = true;
 	}
 }
 
 void Camera::mouseControl(GLfloat xChange, GLfloat yChange)
 {
+	if (xChange == 0.0f && yChange == 0.0f)
+	{
+		return;
+	}
+
 	xChange *= turnSpeed;
 	yChange *= turnSpeed;
 
@@ -77,6 +88,7 @@ void Camera::mouseControl(GLfloat xChange, GLfloat yChange)
 	}
 
 	update();
+	changed = true;
 }
 
 glm::mat4 Camera::calculateViewMatrix()
@@ -93,6 +105,13 @@ glm::vec3 Camera::getCameraDirection()
 	return glm::normalize(front);
 }
 
+bool Camera::consumeChanged()
+{
+	bool wasChanged = changed;
+	changed = false;
+	return wasChanged;
+}
+
 void Camera::update()
 {
 	front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
@@ -22,6 +22,8 @@ public:
 
 	glm::mat4 calculateViewMatrix();
 
+	bool consumeChanged();
+
 	~Camera();
 
 private:
@@ -39,6 +41,8 @@ private:
 
 	GLfloat fov = 85.0f;
 
+	bool changed = true;
+
 	void update();
 };
 
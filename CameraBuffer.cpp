@@ -0,0 +1,46 @@
+#include "CameraBuffer.h"
+
+CameraBuffer::CameraBuffer()
+{
+	bufferID = 0;
+}
+
+void CameraBuffer::Create()
+{
+	ClearBuffer();
+
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, bufferID);
+}
+
+void CameraBuffer::Update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& eyePosition)
+{
+	CameraBlock block;
+	block.projection = projection;
+	block.view = view;
+	block.eyePosition = glm::vec4(eyePosition, 1.0f);
+
+	// Orphan the previous contents so a frame still in flight keeps its own copy
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void CameraBuffer::ClearBuffer()
+{
+	if (bufferID != 0)
+	{
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+}
+
+CameraBuffer::~CameraBuffer()
+{
+	ClearBuffer();
+}
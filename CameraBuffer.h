@@ -0,0 +1,33 @@
+#pragma once
+
+#include <GL\glew.h>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+// View, projection and eye position in one small uniform buffer shared by every
+// program, so the camera can be rewritten after the draw list has been built.
+class CameraBuffer
+{
+public:
+	CameraBuffer();
+
+	void Create();
+	void Update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& eyePosition);
+	void ClearBuffer();
+
+	~CameraBuffer();
+
+private:
+	// std140 layout of CameraBlock in shader.vert / shader.frag
+	struct CameraBlock
+	{
+		glm::mat4 projection;
+		glm::mat4 view;
+		glm::vec4 eyePosition;
+	};
+
+	GLuint bufferID;
+};
+
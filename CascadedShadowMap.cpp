@@ -0,0 +1,383 @@
+#include "CascadedShadowMap.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\type_ptr.hpp>
+
+// Shadows end this far along the view; the room is 6 units across
+static const float SHADOW_DISTANCE = 40.0f;
+// Blend of logarithmic (1) and even (0) split distances
+static const float SPLIT_LAMBDA = 0.75f;
+
+static constexpr unsigned int MODEL = UniformHash("model");
+static constexpr unsigned int CASCADE_TRANSFORMS = UniformHash("cascadeTransforms[]");
+static constexpr unsigned int CASCADE_MASK = UniformHash("cascadeMask");
+static constexpr unsigned int CASCADE_SPLITS = UniformHash("cascadeSplits");
+static constexpr unsigned int CASCADE_COUNT = UniformHash("cascadeCount");
+static constexpr unsigned int DIRECTIONAL_SHADOW_MAP = UniformHash("directionalShadowMap");
+static constexpr unsigned int DEPTH_MAPS = UniformHash("depthMaps");
+static constexpr unsigned int CASCADE = UniformHash("cascade");
+static constexpr unsigned int HORIZONTAL_MOMENTS = UniformHash("horizontalMoments");
+
+CascadedShadowMap::CascadedShadowMap()
+{
+	FBO = 0;
+	depthArray = 0;
+	size = 0;
+	cascadeCount = 0;
+	cascadeSplits = glm::vec4(0.0f);
+
+	moments = false;
+	momentsFBO = 0;
+	momentsArray = 0;
+	blurTexture = 0;
+	emptyVAO = 0;
+	momentsSize = 0;
+}
+
+void CascadedShadowMap::CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation,
+	unsigned int cascadeCount, GLsizei size)
+{
+	this->cascadeCount = std::min(std::max(cascadeCount, 2u), MAX_CASCADES);
+	this->size = size;
+
+	char defines[64];
+	snprintf(defines, sizeof(defines), "#define CASCADE_COUNT %u\n", this->cascadeCount);
+	shader.CreateFromFiles(vertexLocation, geometryLocation, fragmentLocation, defines);
+}
+
+void CascadedShadowMap::CreateMomentsFromFiles(const char* vertexLocation, const char* momentsLocation, const char* blurLocation)
+{
+	// Prefiltered moments hold up at half the resolution of the depths
+	moments = true;
+	momentsSize = size / 2;
+
+	momentsShader.CreateFromFiles(vertexLocation, momentsLocation);
+	blurShader.CreateFromFiles(vertexLocation, blurLocation);
+}
+
+bool CascadedShadowMap::CreateTargets()
+{
+	if (FBO != 0)
+	{
+		return true;
+	}
+
+	glGenTextures(1, &depthArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, cascadeCount, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	if (moments)
+	{
+		// Only read texel by texel, when the moments are made
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else
+	{
+		// Read through a comparison sampler: each lookup is a filtered 2x2 PCF
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	}
+	// Outside a cascade reads as the far plane, i.e. lit
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Layered attachment: gl_Layer in shadow.geom picks the cascade
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Cascaded shadow map framebuffer error: 0x%x\n", status);
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteTextures(1, &depthArray);
+		FBO = 0;
+		depthArray = 0;
+		// No cascades from now on, rather than retrying every frame
+		cascadeCount = 0;
+		return false;
+	}
+
+	return !moments || CreateMomentTargets();
+}
+
+bool CascadedShadowMap::CreateMomentTargets()
+{
+	glGenTextures(1, &momentsArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, momentsArray);
+	// 32-bit floats, as the positive warp's second moment reaches e^80
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, momentsSize, momentsSize, cascadeCount, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenTextures(1, &blurTexture);
+	glBindTexture(GL_TEXTURE_2D, blurTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, momentsSize, momentsSize, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Colour only; the attachment changes between the two blur passes
+	glGenFramebuffers(1, &momentsFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, momentsFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTexture, 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Shadow moments framebuffer error: 0x%x\n", status);
+		glDeleteFramebuffers(1, &momentsFBO);
+		glDeleteTextures(1, &momentsArray);
+		glDeleteTextures(1, &blurTexture);
+		momentsFBO = 0;
+		momentsArray = 0;
+		blurTexture = 0;
+		// The shaders expect moments, so no cascades rather than unfiltered depths
+		cascadeCount = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool CascadedShadowMap::Update(FrameState& frame, GLfloat fov, GLfloat aspect, GLfloat nearPlane, const BVH& bvh)
+{
+	casters.clear();
+	casterMasks.clear();
+
+	glm::vec3 direction = frame.mainLight.GetDirection();
+	if (cascadeCount == 0 || !frame.mainLight.IsActive() || glm::dot(direction, direction) < 1e-8f || !CreateTargets())
+	{
+		return false;
+	}
+
+	// The light's rotation only; cascades are placed inside it, so their centres can be snapped to texels
+	direction = glm::normalize(direction);
+	glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+	// Casters between the light and a cascade count too, so every map reaches back to the scene's edge
+	AABB lightSceneBounds = bvh.GetBounds().Transformed(lightView);
+
+	glm::mat4 inverseView = glm::inverse(frame.view);
+	glm::vec3 eye = glm::vec3(inverseView[3]);
+	glm::vec3 forward = -glm::normalize(glm::vec3(inverseView[2]));
+
+	// Squared slope from the view axis to a frustum corner
+	float tanY = std::tan(fov * 0.5f);
+	float tanX = tanY * aspect;
+	float cornerSlope = tanX * tanX + tanY * tanY;
+
+	objectMasks.assign(bvh.GetItemCount(), 0);
+
+	float splitNear = nearPlane;
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		float part = (float)(c + 1) / cascadeCount;
+		float logSplit = nearPlane * std::pow(SHADOW_DISTANCE / nearPlane, part);
+		float evenSplit = nearPlane + (SHADOW_DISTANCE - nearPlane) * part;
+		float splitFar = SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * evenSplit;
+
+		// Smallest sphere around the slice. It only depends on the split distances, so the
+		// cascade keeps its size as the camera turns and edges don't crawl.
+		float centreDistance = std::min(0.5f * (splitNear + splitFar) * (1.0f + cornerSlope), splitFar);
+		float nearCorner = (centreDistance - splitNear) * (centreDistance - splitNear) + splitNear * splitNear * cornerSlope;
+		float farCorner = (splitFar - centreDistance) * (splitFar - centreDistance) + splitFar * splitFar * cornerSlope;
+		float radius = std::ceil(std::sqrt(std::max(nearCorner, farCorner)) * 16.0f) / 16.0f;
+
+		// Moving the cascade in whole texels keeps static edges on the same texels
+		glm::vec3 centre = glm::vec3(lightView * glm::vec4(eye + forward * centreDistance, 1.0f));
+		float texel = 2.0f * radius / size;
+		centre.x = std::floor(centre.x / texel) * texel;
+		centre.y = std::floor(centre.y / texel) * texel;
+
+		// Light view space looks down -z, so the light is towards +z
+		float towardsLight = std::max(centre.z + radius, lightSceneBounds.max.z);
+		glm::mat4 projection = glm::ortho(centre.x - radius, centre.x + radius, centre.y - radius, centre.y + radius,
+			-towardsLight, -(centre.z - radius));
+
+		cascadeTransforms[c] = projection * lightView;
+		cascadeSplits[c] = splitFar;
+
+		cascadeObjects.clear();
+		bvh.QueryFrustum(Frustum(cascadeTransforms[c]), cascadeObjects);
+		for (size_t i = 0; i < cascadeObjects.size(); i++)
+		{
+			unsigned int object = cascadeObjects[i];
+			if (objectMasks[object] == 0)
+			{
+				casters.push_back(object);
+			}
+			objectMasks[object] |= (unsigned char)(1u << c);
+		}
+
+		splitNear = splitFar;
+	}
+
+	casterMasks.resize(casters.size());
+	for (size_t i = 0; i < casters.size(); i++)
+	{
+		casterMasks[i] = objectMasks[casters[i]];
+	}
+
+	return true;
+}
+
+void CascadedShadowMap::Render(const Scene& scene, GLint viewportWidth, GLint viewportHeight)
+{
+	if (FBO == 0)
+	{
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glViewport(0, 0, size, size);
+	// Clears every layer of the array
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	shader.UseShader();
+	glUniformMatrix4fv(shader.GetUniformLocation(CASCADE_TRANSFORMS, 0), cascadeCount, GL_FALSE, glm::value_ptr(cascadeTransforms[0]));
+
+	GLint uniformModel = shader.GetUniformLocation(MODEL);
+	GLint uniformMask = shader.GetUniformLocation(CASCADE_MASK);
+
+	for (size_t i = 0; i < casters.size(); i++)
+	{
+		const SceneObject& object = scene.GetObject(casters[i]);
+
+		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(object.transform));
+		glUniform1i(uniformMask, casterMasks[i]);
+
+		if (object.type == SCENE_OBJECT_MESH)
+		{
+			scene.GetMesh(object.resource)->RenderDepth();
+		}
+		else
+		{
+			scene.GetModel(object.resource)->RenderDepth();
+		}
+	}
+
+	if (moments)
+	{
+		RenderMoments();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void CascadedShadowMap::RenderMoments()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, momentsFBO);
+	glViewport(0, 0, momentsSize, momentsSize);
+
+	if (emptyVAO == 0)
+	{
+		glGenVertexArrays(1, &emptyVAO);
+	}
+	glBindVertexArray(emptyVAO);
+	glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		// Depths to moments, blurred along x
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTexture, 0);
+		momentsShader.UseShader();
+		glUniform1i(momentsShader.GetUniformLocation(DEPTH_MAPS), SHADOW_TEXTURE_UNIT);
+		glUniform1i(momentsShader.GetUniformLocation(CASCADE), c);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		// Then along y, into the cascade's layer
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentsArray, 0, c);
+		blurShader.UseShader();
+		glUniform1i(blurShader.GetUniformLocation(HORIZONTAL_MOMENTS), SHADOW_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, blurTexture);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(0);
+}
+
+void CascadedShadowMap::UseCascades(Shader* shader)
+{
+	glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, moments ? momentsArray : depthArray);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(shader->GetUniformLocation(DIRECTIONAL_SHADOW_MAP), SHADOW_TEXTURE_UNIT);
+	glUniformMatrix4fv(shader->GetUniformLocation(CASCADE_TRANSFORMS, 0), cascadeCount, GL_FALSE, glm::value_ptr(cascadeTransforms[0]));
+	glUniform4fv(shader->GetUniformLocation(CASCADE_SPLITS), 1, glm::value_ptr(cascadeSplits));
+	glUniform1i(shader->GetUniformLocation(CASCADE_COUNT), cascadeCount);
+}
+
+void CascadedShadowMap::ClearShadowMap()
+{
+	if (FBO != 0)
+	{
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+	}
+
+	if (depthArray != 0)
+	{
+		glDeleteTextures(1, &depthArray);
+		depthArray = 0;
+	}
+
+	if (momentsFBO != 0)
+	{
+		glDeleteFramebuffers(1, &momentsFBO);
+		momentsFBO = 0;
+	}
+
+	if (momentsArray != 0)
+	{
+		glDeleteTextures(1, &momentsArray);
+		momentsArray = 0;
+	}
+
+	if (blurTexture != 0)
+	{
+		glDeleteTextures(1, &blurTexture);
+		blurTexture = 0;
+	}
+
+	if (emptyVAO != 0)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+		emptyVAO = 0;
+	}
+
+	shader.ClearShader();
+	momentsShader.ClearShader();
+	blurShader.ClearShader();
+	casters.clear();
+	casterMasks.clear();
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+#include "Scene.h"
+#include "BVH.h"
+#include "Shader.h"
+#include "FrameState.h"
+
+// Shadow map of the directional light split along the view into cascades. Each
+// cascade is an orthographic map around its slice of the camera's frustum, and
+// all of them are layers of one depth texture array. A single pass draws every
+// caster once; shadow.geom copies its triangles into each cascade the caster
+// was found in. With EVSM the cascades are then turned into blurred
+// exponential moments at half resolution, which shading filters like colour.
+class CascadedShadowMap
+{
+public:
+	static const unsigned int MAX_CASCADES = 4;
+
+	CascadedShadowMap();
+
+	// cascadeCount is clamped to 2-MAX_CASCADES; every cascade is size x size texels
+	void CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation,
+		unsigned int cascadeCount, GLsizei size);
+	// After CreateFromFiles: makes UseCascades hand out moments for SHADOW_FILTER_EVSM shaders
+	// instead of depths for comparison samplers. vertexLocation draws a full-screen triangle.
+	void CreateMomentsFromFiles(const char* vertexLocation, const char* momentsLocation, const char* blurLocation);
+
+	// Fits the cascades to the view, widened to fov, and finds each one's casters.
+	// False when there is nothing to shadow: the light is off or has no direction.
+	bool Update(FrameState& frame, GLfloat fov, GLfloat aspect, GLfloat nearPlane, const BVH& bvh);
+	// Draws the casters Update found, then rebinds the default framebuffer at the given viewport size
+	void Render(const Scene& scene, GLint viewportWidth, GLint viewportHeight);
+
+	// For a SHADOWS_ENABLED shader, which must be in use
+	void UseCascades(Shader* shader);
+
+	unsigned int GetCascadeCount() { return cascadeCount; }
+	unsigned int GetCasterCount() { return (unsigned int)casters.size(); }
+
+	void ClearShadowMap();
+
+	~CascadedShadowMap();
+
+private:
+	Shader shader;
+	GLuint FBO, depthArray;
+	GLsizei size;
+	unsigned int cascadeCount;
+
+	// EVSM prefiltering: moments blurred along x into blurTexture, then along y into their cascade's layer
+	bool moments;
+	Shader momentsShader, blurShader;
+	GLuint momentsFBO, momentsArray, blurTexture, emptyVAO;
+	GLsizei momentsSize;
+
+	glm::mat4 cascadeTransforms[MAX_CASCADES];
+	// Distance along the view where each cascade ends
+	glm::vec4 cascadeSplits;
+
+	// Objects drawn into at least one cascade, with a bit per cascade they reach
+	std::vector<unsigned int> casters;
+	std::vector<unsigned char> casterMasks;
+	std::vector<unsigned char> objectMasks;
+	std::vector<unsigned int> cascadeObjects;
+
+	bool CreateTargets();
+	bool CreateMomentTargets();
+	void RenderMoments();
+};
@@ -0,0 +1,30 @@
+#include "CommandBuffer.h"
+
+#include <algorithm>
+
+CommandBuffer::CommandBuffer()
+{
+	count = 0;
+}
+
+DrawCommand& CommandBuffer::Add()
+{
+	if (count == commands.size())
+	{
+		commands.resize(commands.empty() ? 64 : commands.size() * 2);
+	}
+
+	return commands[count++];
+}
+
+void CommandBuffer::Sort()
+{
+	std::sort(commands.begin(), commands.begin() + count, [](const DrawCommand& a, const DrawCommand& b)
+	{
+		return a.sortKey < b.sortKey;
+	});
+}
+
+CommandBuffer::~CommandBuffer()
+{
+}
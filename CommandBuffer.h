@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+// One draw, recorded off the GL thread. Holds only scene indices and the
+// data the replay needs, never GL names.
+struct DrawCommand
+{
+	unsigned long long sortKey;
+	glm::mat4 transform;
+	glm::ivec4 lights;		// packed light list, see LightCuller::GetLightList
+	glm::vec4 lightmapRect;	// see SceneObject
+	unsigned short resource;
+	unsigned short texture;
+	unsigned short material;
+	unsigned char type;
+};
+
+// Linear, reusable list of draw commands written by one recording job. Capacity
+// is kept between frames so recording does not allocate once warmed up.
+class CommandBuffer
+{
+public:
+	CommandBuffer();
+
+	void Reset() { count = 0; }
+	DrawCommand& Add();
+	void Sort();
+
+	size_t GetCount() const { return count; }
+	const DrawCommand& GetCommand(size_t index) const { return commands[index]; }
+
+	~CommandBuffer();
+
+private:
+	std::vector<DrawCommand> commands;
+	size_t count;
+};
+
@@ -1,4 +1,20 @@
 #pragma once
 
 const int MAX_POINT_LIGHTS = 3;
-const int MAX_SPOT_LIGHTS = 3;
\ No newline at end of file
+const int MAX_SPOT_LIGHTS = 3;
+
+// Uniform buffer binding points
+const int DRAW_BLOCK_BINDING = 0;
+const int CAMERA_BLOCK_BINDING = 1;
+
+// Texture unit of the baked lightmap atlas; unit 0 is the surface texture
+const int LIGHTMAP_TEXTURE_UNIT = 3;
+
+// Texture unit of the directional light's cascaded shadow maps
+const int SHADOW_TEXTURE_UNIT = 4;
+// Texture unit of the spot lights' shadow atlas
+const int SPOT_SHADOW_TEXTURE_UNIT = 5;
+// First of MAX_POINT_LIGHTS units holding the point lights' cube shadow maps
+const int POINT_SHADOW_TEXTURE_UNIT = 6;
+// Texture unit of the reduced-resolution ambient occlusion
+const int AMBIENT_OCCLUSION_TEXTURE_UNIT = 9;
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "DeferredRenderer.h"
+
+#include <glm\gtc\type_ptr.hpp>
+
+static constexpr unsigned int LIGHT_TYPE = UniformHash("lightType");
+static constexpr unsigned int LIGHT_INDEX = UniformHash("lightIndex");
+static constexpr unsigned int INVERSE_VIEW_PROJECTION = UniformHash("inverseViewProjection");
+static constexpr unsigned int G_ALBEDO = UniformHash("gAlbedo");
+static constexpr unsigned int G_NORMAL_MATERIAL = UniformHash("gNormalMaterial");
+static constexpr unsigned int G_DEPTH = UniformHash("gDepth");
+
+DeferredRenderer::DeferredRenderer()
+{
+	emptyVAO = 0;
+	lightPassCount = 0;
+}
+
+void DeferredRenderer::CreateFromFiles(const char* geometryVertex, const char* geometryFragment,
+	const char* lightVertex, const char* lightFragment)
+{
+	geometryLibrary.CreateFromFiles(geometryVertex, geometryFragment);
+	lightLibrary.CreateFromFiles(lightVertex, lightFragment);
+}
+
+Shader* DeferredRenderer::BeginGeometry(GLint width, GLint height, bool drawBlock)
+{
+	if (!gBuffer.Resize(width, height))
+	{
+		return nullptr;
+	}
+
+	if (emptyVAO == 0)
+	{
+		glGenVertexArrays(1, &emptyVAO);
+	}
+
+	gBuffer.BindForWriting();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Only the vertex transform and material vary; lights are applied afterwards
+	ShaderFeatures features = { 0, 0, false, false, false, drawBlock };
+	Shader* shader = geometryLibrary.GetVariant(features);
+	shader->UseShader();
+
+	return shader;
+}
+
+void DeferredRenderer::EndGeometry()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, gBuffer.GetWidth(), gBuffer.GetHeight());
+}
+
+void DeferredRenderer::LightScene(FrameState& frame, const glm::mat4& viewProjection)
+{
+	ShaderFeatures features = { 0, 0, frame.features.directionalLight, false, frame.features.specular, false };
+	Shader* shader = lightLibrary.GetVariant(features);
+	shader->UseShader();
+
+	glUniform1i(shader->GetUniformLocation(G_ALBEDO), GBuffer::ALBEDO_UNIT);
+	glUniform1i(shader->GetUniformLocation(G_NORMAL_MATERIAL), GBuffer::NORMAL_MATERIAL_UNIT);
+	glUniform1i(shader->GetUniformLocation(G_DEPTH), GBuffer::DEPTH_UNIT);
+	glUniformMatrix4fv(shader->GetUniformLocation(INVERSE_VIEW_PROJECTION), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+
+	shader->SetDirectionalLight(&frame.mainLight);
+	shader->SetPointLights(frame.pointLights, frame.pointLightCount);
+	shader->SetSpotLights(frame.spotLights, frame.spotLightCount);
+
+	gBuffer.BindTextures();
+	glBindVertexArray(emptyVAO);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+
+	lightPassCount = 0;
+
+	// The base pass overwrites every covered pixel, so it runs even without a directional light
+	DrawLight(shader, LIGHT_TYPE_DIRECTIONAL, 0);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glEnable(GL_SCISSOR_TEST);
+
+	Frustum frustum(viewProjection);
+	GLint rect[4];
+
+	for (unsigned int i = 0; i < frame.pointLightCount && i < MAX_POINT_LIGHTS; i++)
+	{
+		AABB bounds = frame.pointLights[i].GetBounds();
+		if (bounds.IsEmpty() || !frustum.Intersects(bounds) || !GetScissor(bounds, viewProjection, rect))
+		{
+			continue;
+		}
+
+		glScissor(rect[0], rect[1], rect[2], rect[3]);
+		DrawLight(shader, LIGHT_TYPE_POINT, i);
+	}
+
+	for (unsigned int i = 0; i < frame.spotLightCount && i < MAX_SPOT_LIGHTS; i++)
+	{
+		AABB bounds = frame.spotLights[i].GetBounds();
+		if (bounds.IsEmpty() || !frustum.Intersects(bounds) || !GetScissor(bounds, viewProjection, rect))
+		{
+			continue;
+		}
+
+		glScissor(rect[0], rect[1], rect[2], rect[3]);
+		DrawLight(shader, LIGHT_TYPE_SPOT, i);
+	}
+
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+	glBindVertexArray(0);
+}
+
+bool DeferredRenderer::GetScissor(const AABB& bounds, const glm::mat4& viewProjection, GLint* rect)
+{
+	GLint width = gBuffer.GetWidth();
+	GLint height = gBuffer.GetHeight();
+
+	rect[0] = 0;
+	rect[1] = 0;
+	rect[2] = width;
+	rect[3] = height;
+
+	// Unbounded lights, and boxes reaching behind the eye, cover the whole screen
+	if (bounds.min.x == -FLT_MAX || bounds.max.x == FLT_MAX)
+	{
+		return true;
+	}
+
+	glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner(i & 1 ? bounds.max.x : bounds.min.x, i & 2 ? bounds.max.y : bounds.min.y, i & 4 ? bounds.max.z : bounds.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+		if (clip.w <= 0.0001f)
+		{
+			return true;
+		}
+
+		glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	ndcMin = glm::max(ndcMin, glm::vec2(-1.0f));
+	ndcMax = glm::min(ndcMax, glm::vec2(1.0f));
+	if (ndcMin.x >= ndcMax.x || ndcMin.y >= ndcMax.y)
+	{
+		return false;
+	}
+
+	GLint x0 = (GLint)floorf((ndcMin.x * 0.5f + 0.5f) * width);
+	GLint y0 = (GLint)floorf((ndcMin.y * 0.5f + 0.5f) * height);
+	GLint x1 = (GLint)ceilf((ndcMax.x * 0.5f + 0.5f) * width);
+	GLint y1 = (GLint)ceilf((ndcMax.y * 0.5f + 0.5f) * height);
+
+	rect[0] = x0;
+	rect[1] = y0;
+	rect[2] = x1 - x0;
+	rect[3] = y1 - y0;
+
+	return rect[2] > 0 && rect[3] > 0;
+}
+
+void DeferredRenderer::DrawLight(Shader* shader, LightType type, int index)
+{
+	glUniform1i(shader->GetUniformLocation(LIGHT_TYPE), type);
+	glUniform1i(shader->GetUniformLocation(LIGHT_INDEX), index);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	lightPassCount++;
+}
+
+void DeferredRenderer::ClearRenderer()
+{
+	gBuffer.ClearGBuffer();
+	geometryLibrary.ClearLibrary();
+	lightLibrary.ClearLibrary();
+
+	if (emptyVAO != 0)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+		emptyVAO = 0;
+	}
+
+	lightPassCount = 0;
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+}
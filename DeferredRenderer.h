@@ -0,0 +1,60 @@
+#pragma once
+
+#include <GL\glew.h>
+
+#include <glm\glm.hpp>
+
+#include "Bounds.h"
+#include "FrameState.h"
+#include "GBuffer.h"
+#include "ShaderLibrary.h"
+
+// Deferred alternative to the forward shader: the scene is drawn once into a
+// G-buffer, then every light is added with a full-screen triangle scissored to
+// the screen rectangle of its bounds, so lighting costs pixels covered rather
+// than lights x overdraw.
+class DeferredRenderer
+{
+public:
+	DeferredRenderer();
+
+	void CreateFromFiles(const char* geometryVertex, const char* geometryFragment,
+		const char* lightVertex, const char* lightFragment);
+
+	// Binds the G-buffer, sized to the window, and the program to submit the scene with;
+	// nullptr if the G-buffer can't be created
+	Shader* BeginGeometry(GLint width, GLint height, bool drawBlock);
+	void EndGeometry();
+
+	// Accumulates the frame's lights into the default framebuffer; the view-projection
+	// must be the one the geometry was drawn with
+	void LightScene(FrameState& frame, const glm::mat4& viewProjection);
+
+	unsigned int GetLightPassCount() { return lightPassCount; }
+
+	void ClearRenderer();
+
+	~DeferredRenderer();
+
+private:
+	// Must match the LIGHT_TYPE_ values in deferred.frag
+	enum LightType
+	{
+		LIGHT_TYPE_DIRECTIONAL = 0,
+		LIGHT_TYPE_POINT = 1,
+		LIGHT_TYPE_SPOT = 2
+	};
+
+	GBuffer gBuffer;
+	ShaderLibrary geometryLibrary;
+	ShaderLibrary lightLibrary;
+
+	// Core profile needs a bound VAO even when the vertices come from gl_VertexID
+	GLuint emptyVAO;
+
+	unsigned int lightPassCount;
+
+	bool GetScissor(const AABB& bounds, const glm::mat4& viewProjection, GLint* rect);
+	void DrawLight(Shader* shader, LightType type, int index);
+};
+
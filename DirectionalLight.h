@@ -13,6 +13,8 @@ public:
 	void UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
 		GLfloat diffuseIntensityLocation, GLfloat directionLocation);
 
+	glm::vec3 GetDirection() { return direction; }
+
 	~DirectionalLight();
 
 private:
@@ -0,0 +1,159 @@
+#include "FramePacer.h"
+
+FramePacer::FramePacer()
+{
+	for (unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		fences[i] = (GLsync)0;
+	}
+
+	framesInFlight = 2;
+	currentSlot = 0;
+
+	lastPresentTime = 0.0;
+	lastPresentInterval = 0.0;
+	lastBlockedTime = 0.0;
+
+	statFrames = 0;
+	statPresentSum = 0.0;
+	statPresentMax = 0.0;
+	statBlockedSum = 0.0;
+	statBlockedMax = 0.0;
+	statLatencyCount = 0;
+	statLatencySum = 0.0;
+	statLatencyMax = 0.0;
+	lastReportTime = 0.0;
+}
+
+void FramePacer::Initialise(unsigned int framesInFlight)
+{
+	ClearPacer();
+
+	if (framesInFlight < 1)
+	{
+		framesInFlight = 1;
+	}
+	if (framesInFlight > MAX_FRAMES_IN_FLIGHT)
+	{
+		framesInFlight = MAX_FRAMES_IN_FLIGHT;
+	}
+
+	this->framesInFlight = framesInFlight;
+	currentSlot = framesInFlight - 1;
+	lastReportTime = glfwGetTime();
+}
+
+unsigned int FramePacer::BeginFrame()
+{
+	currentSlot = (currentSlot + 1) % framesInFlight;
+	lastBlockedTime = WaitForSlot(currentSlot);
+
+	return currentSlot;
+}
+
+void FramePacer::EndFrame()
+{
+	fences[currentSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	double now = glfwGetTime();
+	lastPresentInterval = lastPresentTime > 0.0 ? now - lastPresentTime : 0.0;
+	lastPresentTime = now;
+
+	statFrames++;
+	statPresentSum += lastPresentInterval;
+	statBlockedSum += lastBlockedTime;
+	if (lastPresentInterval > statPresentMax) { statPresentMax = lastPresentInterval; }
+	if (lastBlockedTime > statBlockedMax) { statBlockedMax = lastBlockedTime; }
+}
+
+void FramePacer::AddInputLatency(double seconds)
+{
+	statLatencyCount++;
+	statLatencySum += seconds;
+	if (seconds > statLatencyMax) { statLatencyMax = seconds; }
+}
+
+void FramePacer::WaitIdle()
+{
+	for (unsigned int i = 0; i < framesInFlight; i++)
+	{
+		WaitForSlot(i);
+	}
+}
+
+void FramePacer::ReportStats(double reportInterval)
+{
+	double now = glfwGetTime();
+	if (now - lastReportTime < reportInterval || statFrames == 0)
+	{
+		return;
+	}
+
+	printf("Frames in flight: %u | present-to-present avg %.2f ms, max %.2f ms | blocked on fences avg %.2f ms, max %.2f ms | %u frames\n",
+		framesInFlight,
+		statPresentSum / statFrames * 1000.0, statPresentMax * 1000.0,
+		statBlockedSum / statFrames * 1000.0, statBlockedMax * 1000.0,
+		statFrames);
+
+	if (statLatencyCount > 0)
+	{
+		printf("    input-to-present avg %.2f ms, max %.2f ms | %u input events\n",
+			statLatencySum / statLatencyCount * 1000.0, statLatencyMax * 1000.0, statLatencyCount);
+	}
+
+	statFrames = 0;
+	statLatencyCount = 0;
+	statLatencySum = 0.0;
+	statLatencyMax = 0.0;
+	statPresentSum = 0.0;
+	statPresentMax = 0.0;
+	statBlockedSum = 0.0;
+	statBlockedMax = 0.0;
+	lastReportTime = now;
+}
+
+double FramePacer::WaitForSlot(unsigned int slot)
+{
+	GLsync fence = fences[slot];
+	if (!fence)
+	{
+		return 0.0;
+	}
+
+	double start = glfwGetTime();
+
+	// Flush on the first wait so the fence is guaranteed to signal eventually
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (true)
+	{
+		GLenum result = glClientWaitSync(fence, waitFlags, 1000000000);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+		{
+			break;
+		}
+		waitFlags = 0;
+	}
+
+	glDeleteSync(fence);
+	fences[slot] = (GLsync)0;
+
+	return glfwGetTime() - start;
+}
+
+void FramePacer::ClearPacer()
+{
+	for (unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = (GLsync)0;
+		}
+	}
+
+	lastPresentTime = 0.0;
+}
+
+FramePacer::~FramePacer()
+{
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <GL\glew.h>
+#include <GLFW\glfw3.h>
+
+// Bounds how far the CPU may run ahead of the GPU. Each frame in flight has a
+// slot; per-frame resources (e.g. ring buffer sections) are indexed by it, and
+// BeginFrame blocks on the fence of the frame that last used the slot.
+// 1 frame in flight gives the lowest latency, 3 the most CPU/GPU overlap.
+class FramePacer
+{
+public:
+	static const unsigned int MAX_FRAMES_IN_FLIGHT = 3;
+
+	FramePacer();
+
+	void Initialise(unsigned int framesInFlight);
+	unsigned int GetFramesInFlight() { return framesInFlight; }
+
+	// Waits until the GPU is done with the next slot and returns it
+	unsigned int BeginFrame();
+	// Call right after swapBuffers
+	void EndFrame();
+
+	// Waits for every frame in flight, e.g. before reallocating per-frame resources
+	void WaitIdle();
+
+	double GetLastPresentInterval() { return lastPresentInterval; }
+	double GetLastBlockedTime() { return lastBlockedTime; }
+
+	// Time from an input event to the present of the first frame showing it
+	void AddInputLatency(double seconds);
+
+	// Prints averages since the last report once reportInterval seconds have passed
+	void ReportStats(double reportInterval);
+
+	void ClearPacer();
+
+	~FramePacer();
+
+private:
+	GLsync fences[MAX_FRAMES_IN_FLIGHT];
+	unsigned int framesInFlight;
+	unsigned int currentSlot;
+
+	double lastPresentTime;
+	double lastPresentInterval;
+	double lastBlockedTime;
+
+	unsigned int statFrames;
+	double statPresentSum, statPresentMax;
+	double statBlockedSum, statBlockedMax;
+	unsigned int statLatencyCount;
+	double statLatencySum, statLatencyMax;
+	double lastReportTime;
+
+	double WaitForSlot(unsigned int slot);
+};
+
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+#include "Camera.h"
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "ShaderLibrary.h"
+
+// Everything the render thread needs to draw one frame. Written by the
+// simulation thread, published through a TripleBuffer and never modified
+// after publishing.
+struct FrameState
+{
+	unsigned int frameNumber;
+
+	// Camera as simulated, and the last input it includes; the render thread
+	// applies any newer mouse movement on top just before submitting
+	Camera camera;
+	unsigned int inputSequence;
+
+	glm::mat4 view;
+	glm::vec3 eyePosition;
+	GLfloat fov;
+
+	// Culling is done before publishing, for a frustum wider than the view by the
+	// late latch's margin: the objects to draw, and with light lists the lights
+	// reaching each of them in the same order (see LightCuller::GetLightList)
+	glm::mat4 cullViewProjection;
+	GLfloat cullFov;
+	std::vector<unsigned int> visibleObjects;
+	std::vector<glm::ivec4> objectLights;
+
+	DirectionalLight mainLight;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+	SpotLight spotLights[MAX_SPOT_LIGHTS];
+	unsigned int pointLightCount;
+	unsigned int spotLightCount;
+
+	ShaderFeatures features;
+};
+
@@ -0,0 +1,106 @@
+#include "GBuffer.h"
+
+GBuffer::GBuffer()
+{
+	FBO = 0;
+	albedoTexture = 0;
+	normalMaterialTexture = 0;
+	depthTexture = 0;
+
+	width = 0;
+	height = 0;
+}
+
+bool GBuffer::Resize(GLint width, GLint height)
+{
+	if (FBO != 0 && width == this->width && height == this->height)
+	{
+		return true;
+	}
+
+	ClearGBuffer();
+
+	albedoTexture = CreateTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	normalMaterialTexture = CreateTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+	depthTexture = CreateTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalMaterialTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("G-buffer framebuffer error: 0x%x\n", status);
+		ClearGBuffer();
+		return false;
+	}
+
+	this->width = width;
+	this->height = height;
+
+	return true;
+}
+
+void GBuffer::BindForWriting()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glViewport(0, 0, width, height);
+}
+
+void GBuffer::BindTextures()
+{
+	glActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT);
+	glBindTexture(GL_TEXTURE_2D, albedoTexture);
+	glActiveTexture(GL_TEXTURE0 + NORMAL_MATERIAL_UNIT);
+	glBindTexture(GL_TEXTURE_2D, normalMaterialTexture);
+	glActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void GBuffer::ClearGBuffer()
+{
+	if (FBO != 0)
+	{
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+	}
+
+	GLuint textures[] = { albedoTexture, normalMaterialTexture, depthTexture };
+	glDeleteTextures(3, textures);
+	albedoTexture = 0;
+	normalMaterialTexture = 0;
+	depthTexture = 0;
+
+	width = 0;
+	height = 0;
+}
+
+GLuint GBuffer::CreateTarget(GLint internalFormat, GLenum format, GLenum type, GLint width, GLint height)
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+
+	// Read with texelFetch, one texel per pixel
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return texture;
+}
+
+GBuffer::~GBuffer()
+{
+}
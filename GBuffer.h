@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <GL\glew.h>
+
+// Render targets filled by the deferred geometry pass:
+//  albedo         - RGBA8, the diffuse texture colour
+//  normalMaterial - RGBA16F, octahedral world normal in .xy, specular intensity in .z, shininess in .w
+//  depth          - 24-bit depth texture, world positions are rebuilt from it
+class GBuffer
+{
+public:
+	static const GLuint ALBEDO_UNIT = 0;
+	static const GLuint NORMAL_MATERIAL_UNIT = 1;
+	static const GLuint DEPTH_UNIT = 2;
+
+	GBuffer();
+
+	// Recreates the targets when the size changes; false if the framebuffer is incomplete
+	bool Resize(GLint width, GLint height);
+	bool IsCreated() { return FBO != 0; }
+
+	GLint GetWidth() { return width; }
+	GLint GetHeight() { return height; }
+
+	void BindForWriting();
+	void BindTextures();
+
+	void ClearGBuffer();
+
+	~GBuffer();
+
+private:
+	GLuint FBO;
+	GLuint albedoTexture;
+	GLuint normalMaterialTexture;
+	GLuint depthTexture;
+
+	GLint width, height;
+
+	static GLuint CreateTarget(GLint internalFormat, GLenum format, GLenum type, GLint width, GLint height);
+};
+
@@ -0,0 +1,144 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer()
+{
+	for (unsigned int slot = 0; slot < FramePacer::MAX_FRAMES_IN_FLIGHT; slot++)
+	{
+		for (unsigned int section = 0; section < MAX_SECTIONS; section++)
+		{
+			queries[slot][section] = 0;
+			issued[slot][section] = false;
+		}
+	}
+
+	for (unsigned int section = 0; section < MAX_SECTIONS; section++)
+	{
+		sums[section] = 0.0;
+		samples[section] = 0;
+		averages[section] = 0.0;
+	}
+
+	slotCount = 0;
+	currentSlot = 0;
+	activeSection = -1;
+}
+
+bool GpuTimer::IsSupported()
+{
+	// Core since 3.3, but report it through the extension as well for older drivers
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+void GpuTimer::Create(unsigned int slotCount)
+{
+	ClearTimer();
+
+	if (!IsSupported())
+	{
+		printf("GPU timer queries are not supported, GPU times will not be reported.\n");
+		return;
+	}
+
+	if (slotCount > FramePacer::MAX_FRAMES_IN_FLIGHT)
+	{
+		slotCount = FramePacer::MAX_FRAMES_IN_FLIGHT;
+	}
+
+	for (unsigned int slot = 0; slot < slotCount; slot++)
+	{
+		glGenQueries(MAX_SECTIONS, queries[slot]);
+	}
+
+	this->slotCount = slotCount;
+}
+
+void GpuTimer::BeginFrame(unsigned int slot)
+{
+	if (slotCount == 0)
+	{
+		return;
+	}
+
+	currentSlot = slot % slotCount;
+
+	for (unsigned int section = 0; section < MAX_SECTIONS; section++)
+	{
+		if (!issued[currentSlot][section])
+		{
+			continue;
+		}
+
+		// The slot's fence has been waited on, so this is almost always ready already
+		GLint available = 0;
+		glGetQueryObjectiv(queries[currentSlot][section], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(queries[currentSlot][section], GL_QUERY_RESULT, &elapsed);
+			sums[section] += elapsed / 1000000.0;
+			samples[section]++;
+		}
+
+		issued[currentSlot][section] = false;
+	}
+}
+
+void GpuTimer::Begin(unsigned int section)
+{
+	if (slotCount == 0 || section >= MAX_SECTIONS || activeSection >= 0)
+	{
+		return;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[currentSlot][section]);
+	activeSection = (int)section;
+}
+
+void GpuTimer::End()
+{
+	if (activeSection < 0)
+	{
+		return;
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	issued[currentSlot][activeSection] = true;
+	activeSection = -1;
+}
+
+double GpuTimer::TakeAverage(unsigned int section)
+{
+	if (section >= MAX_SECTIONS)
+	{
+		return 0.0;
+	}
+
+	if (samples[section] > 0)
+	{
+		averages[section] = sums[section] / samples[section];
+		sums[section] = 0.0;
+		samples[section] = 0;
+	}
+
+	return averages[section];
+}
+
+void GpuTimer::ClearTimer()
+{
+	for (unsigned int slot = 0; slot < slotCount; slot++)
+	{
+		glDeleteQueries(MAX_SECTIONS, queries[slot]);
+		for (unsigned int section = 0; section < MAX_SECTIONS; section++)
+		{
+			queries[slot][section] = 0;
+			issued[slot][section] = false;
+		}
+	}
+
+	slotCount = 0;
+	activeSection = -1;
+}
+
+GpuTimer::~GpuTimer()
+{
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <GL\glew.h>
+
+#include "FramePacer.h"
+
+// GPU time of a few sections of the frame, measured with GL_TIME_ELAPSED
+// queries. Each FramePacer slot has its own queries, so results are read
+// once the pacer has waited for that slot and never stall the pipeline.
+// Sections can't nest (only one elapsed-time query may be active).
+class GpuTimer
+{
+public:
+	static const unsigned int MAX_SECTIONS = 12;
+
+	GpuTimer();
+
+	static bool IsSupported();
+
+	void Create(unsigned int slotCount);
+	bool IsCreated() { return slotCount > 0; }
+
+	// Collects what this slot measured last time round; call after FramePacer::BeginFrame
+	void BeginFrame(unsigned int slot);
+
+	void Begin(unsigned int section);
+	void End();
+
+	// Milliseconds per frame averaged since the previous call; sections not measured
+	// since then return their previous average (0 if never measured)
+	double TakeAverage(unsigned int section);
+
+	void ClearTimer();
+
+	~GpuTimer();
+
+private:
+	GLuint queries[FramePacer::MAX_FRAMES_IN_FLIGHT][MAX_SECTIONS];
+	bool issued[FramePacer::MAX_FRAMES_IN_FLIGHT][MAX_SECTIONS];
+	unsigned int slotCount;
+	unsigned int currentSlot;
+	int activeSection;
+
+	double sums[MAX_SECTIONS];
+	unsigned int samples[MAX_SECTIONS];
+	double averages[MAX_SECTIONS];
+};
+
@@ -0,0 +1,72 @@
+#include "InputMailbox.h"
+
+InputMailbox::InputMailbox()
+{
+	memset(pending.keys, 0, sizeof(pending.keys));
+	pending.xChange = 0.0f;
+	pending.yChange = 0.0f;
+	pending.aspect = 1.0f;
+	pending.sequence = 0;
+
+	hasNewInput = false;
+	stopping = false;
+}
+
+unsigned int InputMailbox::Post(const bool* keys, GLfloat xChange, GLfloat yChange, GLfloat aspect)
+{
+	unsigned int sequence;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		memcpy(pending.keys, keys, sizeof(pending.keys));
+		pending.xChange += xChange;
+		pending.yChange += yChange;
+		pending.aspect = aspect;
+		sequence = ++pending.sequence;
+		hasNewInput = true;
+	}
+
+	posted.notify_one();
+
+	return sequence;
+}
+
+bool InputMailbox::Wait(InputState& state, double timeout)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	if (timeout < 0.0)
+	{
+		posted.wait(guard, [this] { return hasNewInput || stopping; });
+	}
+	else
+	{
+		posted.wait_for(guard, std::chrono::duration<double>(timeout), [this] { return hasNewInput || stopping; });
+	}
+
+	if (stopping)
+	{
+		return false;
+	}
+
+	state = pending;
+	pending.xChange = 0.0f;
+	pending.yChange = 0.0f;
+	hasNewInput = false;
+
+	return true;
+}
+
+void InputMailbox::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+
+	posted.notify_all();
+}
+
+InputMailbox::~InputMailbox()
+{
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <GL\glew.h>
+
+struct InputState
+{
+	bool keys[1024];
+	GLfloat xChange;
+	GLfloat yChange;
+	GLfloat aspect;			// of the window's framebuffer, for the cull frustum
+	unsigned int sequence;	// of the latest Post included
+};
+
+// Carries input from the thread that owns the window to the simulation thread.
+// Mouse deltas accumulate until taken so no movement is lost between ticks.
+class InputMailbox
+{
+public:
+	InputMailbox();
+
+	// Returns the sequence number of this post; sequences start at 1
+	unsigned int Post(const bool* keys, GLfloat xChange, GLfloat yChange, GLfloat aspect);
+
+	// Waits up to timeout seconds (forever when negative) for new input, then
+	// copies the latest state out. Returns false once Shutdown has been called.
+	bool Wait(InputState& state, double timeout);
+
+	void Shutdown();
+
+	~InputMailbox();
+
+private:
+	std::mutex lock;
+	std::condition_variable posted;
+
+	InputState pending;
+	bool hasNewInput;
+	bool stopping;
+};
+
@@ -0,0 +1,174 @@
+#include "JobBenchmark.h"
+
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+#include <chrono>
+
+#include "JobSystem.h"
+
+static const unsigned int GRID_SIZE = 512;
+static const unsigned int COMPUTE_ITEMS = 1 << 16;
+static const unsigned int SPAWN_JOBS = 1 << 16;
+static const int REPEATS = 5;
+
+struct BenchmarkData
+{
+	std::vector<float> positions;
+	std::vector<unsigned int> indices;
+	std::vector<float> faceNormals;
+	std::vector<float> results;
+};
+
+static void CreateBenchmarkData(BenchmarkData& data)
+{
+	// A rippled grid, close to what calcAverageNormals does for a large mesh
+	for (unsigned int z = 0; z < GRID_SIZE; z++)
+	{
+		for (unsigned int x = 0; x < GRID_SIZE; x++)
+		{
+			data.positions.push_back((float)x);
+			data.positions.push_back(sinf(x * 0.1f) * cosf(z * 0.1f));
+			data.positions.push_back((float)z);
+		}
+	}
+
+	for (unsigned int z = 0; z + 1 < GRID_SIZE; z++)
+	{
+		for (unsigned int x = 0; x + 1 < GRID_SIZE; x++)
+		{
+			unsigned int i0 = z * GRID_SIZE + x;
+			unsigned int i1 = i0 + 1;
+			unsigned int i2 = i0 + GRID_SIZE;
+			unsigned int i3 = i2 + 1;
+			data.indices.insert(data.indices.end(), { i0, i2, i1, i1, i2, i3 });
+		}
+	}
+
+	data.faceNormals.resize(data.indices.size());
+	data.results.resize(COMPUTE_ITEMS);
+}
+
+static void FaceNormals(JobSystem& jobs, BenchmarkData& data)
+{
+	jobs.ParallelFor((unsigned int)data.indices.size() / 3, 1024, [&data](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int t = begin; t < end; t++)
+		{
+			const float* p0 = &data.positions[data.indices[t * 3] * 3];
+			const float* p1 = &data.positions[data.indices[t * 3 + 1] * 3];
+			const float* p2 = &data.positions[data.indices[t * 3 + 2] * 3];
+
+			float ax = p1[0] - p0[0], ay = p1[1] - p0[1], az = p1[2] - p0[2];
+			float bx = p2[0] - p0[0], by = p2[1] - p0[1], bz = p2[2] - p0[2];
+			float nx = ay * bz - az * by, ny = az * bx - ax * bz, nz = ax * by - ay * bx;
+			float length = sqrtf(nx * nx + ny * ny + nz * nz);
+
+			data.faceNormals[t * 3] = nx / length;
+			data.faceNormals[t * 3 + 1] = ny / length;
+			data.faceNormals[t * 3 + 2] = nz / length;
+		}
+	});
+}
+
+static void Compute(JobSystem& jobs, BenchmarkData& data)
+{
+	jobs.ParallelFor(COMPUTE_ITEMS, 256, [&data](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			float value = (float)i;
+			for (int step = 0; step < 256; step++)
+			{
+				value = sqrtf(value * value + 1.0f) * 0.5f + sinf(value);
+			}
+			data.results[i] = value;
+		}
+	});
+}
+
+static void Spawn(JobSystem& jobs, BenchmarkData& data)
+{
+	// Pure scheduling overhead: many tiny jobs, half of them waiting on the other half
+	JobCounter first, second;
+	for (unsigned int i = 0; i < SPAWN_JOBS / 2; i++)
+	{
+		jobs.Run([&data, i]() { data.results[i & (COMPUTE_ITEMS - 1)] += 1.0f; }, &first);
+	}
+	for (unsigned int i = 0; i < SPAWN_JOBS / 2; i++)
+	{
+		jobs.Run([&data, i]() { data.results[i & (COMPUTE_ITEMS - 1)] -= 1.0f; }, &second, &first);
+	}
+	jobs.Wait(&second);
+}
+
+static double TimeBest(JobSystem& jobs, BenchmarkData& data, void(*workload)(JobSystem&, BenchmarkData&))
+{
+	// One untimed run to fault in memory and wake the workers
+	workload(jobs, data);
+
+	double best = 0.0;
+	for (int i = 0; i < REPEATS; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		workload(jobs, data);
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (i == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+
+	return best;
+}
+
+void RunJobBenchmark(unsigned int maxWorkers)
+{
+	if (maxWorkers == 0)
+	{
+		maxWorkers = std::thread::hardware_concurrency();
+		if (maxWorkers == 0)
+		{
+			maxWorkers = 1;
+		}
+	}
+
+	BenchmarkData data;
+	CreateBenchmarkData(data);
+
+	const char* names[] = { "face normals", "compute", "spawn" };
+	void(*workloads[])(JobSystem&, BenchmarkData&) = { FaceNormals, Compute, Spawn };
+	const int workloadCount = 3;
+
+	std::vector<double> baseline(workloadCount, 0.0);
+
+	printf("Job system benchmark, best of %d runs (ms, speed-up over 1 worker)\n", REPEATS);
+	printf("%8s", "workers");
+	for (int w = 0; w < workloadCount; w++)
+	{
+		printf(" | %22s", names[w]);
+	}
+	printf("\n");
+
+	for (unsigned int workers = 1; workers <= maxWorkers; workers++)
+	{
+		JobSystem jobs;
+		jobs.Initialise(workers);
+
+		printf("%8u", workers);
+		for (int w = 0; w < workloadCount; w++)
+		{
+			double elapsed = TimeBest(jobs, data, workloads[w]);
+			if (workers == 1)
+			{
+				baseline[w] = elapsed;
+			}
+
+			printf(" | %12.3f %8.2fx", elapsed, baseline[w] / elapsed);
+		}
+		printf("\n");
+
+		jobs.Shutdown();
+	}
+}
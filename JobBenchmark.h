@@ -0,0 +1,5 @@
+#pragma once
+
+// Runs a fixed set of workloads through the job system with 1..maxWorkers
+// workers and prints the time and speed-up of each (0 - one per hardware thread)
+void RunJobBenchmark(unsigned int maxWorkers);
@@ -0,0 +1,370 @@
+#include "JobSystem.h"
+
+struct Job
+{
+	std::function<void()> task;
+	JobCounter* counter;
+};
+
+// Index of the deque owned by the current thread, -1 for threads the job system did not start
+static thread_local int currentWorker = -1;
+
+JobSystem jobSystem;
+
+JobCounter::JobCounter() : count(0)
+{
+}
+
+JobCounter::~JobCounter()
+{
+}
+
+JobDeque::JobDeque() : top(0), bottom(0)
+{
+	for (long long i = 0; i < CAPACITY; i++)
+	{
+		jobs[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+bool JobDeque::Push(Job* job)
+{
+	long long b = bottom.load(std::memory_order_relaxed);
+	long long t = top.load(std::memory_order_acquire);
+	if (b - t >= CAPACITY)
+	{
+		return false;
+	}
+
+	jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+
+	return true;
+}
+
+Job* JobDeque::Pop()
+{
+	long long b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	if (t == b)
+	{
+		// Last job, race the thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* JobDeque::Steal()
+{
+	long long t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+	{
+		return nullptr;
+	}
+
+	Job* job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	return job;
+}
+
+JobDeque::~JobDeque()
+{
+}
+
+JobSystem::JobSystem() : workerCount(0), queuedJobs(0), stopping(false)
+{
+}
+
+void JobSystem::Initialise(unsigned int workerCount)
+{
+	Shutdown();
+
+	if (workerCount == 0)
+	{
+		workerCount = std::thread::hardware_concurrency();
+		if (workerCount == 0)
+		{
+			workerCount = 1;
+		}
+	}
+
+	this->workerCount = workerCount;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		deques.push_back(new JobDeque());
+	}
+
+	// The initialising thread is worker 0; it runs jobs whenever it waits on a counter
+	currentWorker = 0;
+
+	for (unsigned int i = 1; i < workerCount; i++)
+	{
+		threads.push_back(std::thread(&JobSystem::WorkerLoop, this, (int)i));
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		// Under the sleep lock so no worker can miss it between its check and its wait
+		std::lock_guard<std::mutex> lock(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+	threads.clear();
+
+	for (size_t i = 0; i < deques.size(); i++)
+	{
+		delete deques[i];
+	}
+	deques.clear();
+
+	workerCount = 0;
+	stopping = false;
+}
+
+void JobSystem::Run(const std::function<void()>& task, JobCounter* counter, JobCounter* dependency)
+{
+	if (deques.empty())
+	{
+		// Not initialised, run in place
+		if (dependency)
+		{
+			Wait(dependency);
+		}
+		task();
+		return;
+	}
+
+	Job* job = new Job();
+	job->task = task;
+	job->counter = counter;
+
+	if (counter)
+	{
+		counter->count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (dependency)
+	{
+		// The final decrement of a counter happens under this lock, so the job is
+		// either queued as a continuation or the dependency is already done
+		std::lock_guard<std::mutex> lock(dependency->continuationLock);
+		if (dependency->count.load(std::memory_order_acquire) != 0)
+		{
+			dependency->continuations.push_back(job);
+			return;
+		}
+	}
+
+	Schedule(job);
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	while (!counter->IsDone())
+	{
+		Job* job = FindJob(currentWorker);
+		if (job)
+		{
+			Execute(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The last Finish may still hold the lock; the counter must outlive it
+	std::lock_guard<std::mutex> lock(counter->continuationLock);
+}
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int begin, unsigned int end)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (grainSize == 0)
+	{
+		// Enough chunks for every worker to steal a few
+		unsigned int chunkCount = workerCount > 0 ? workerCount * 4 : 1;
+		grainSize = (count + chunkCount - 1) / chunkCount;
+	}
+
+	JobCounter counter;
+
+	// Queue all but the first chunk, which the calling thread runs itself
+	for (unsigned int begin = grainSize; begin < count; begin += grainSize)
+	{
+		unsigned int end = begin + grainSize < count ? begin + grainSize : count;
+		Run([&body, begin, end]() { body(begin, end); }, &counter);
+	}
+
+	body(0, grainSize < count ? grainSize : count);
+
+	Wait(&counter);
+}
+
+void JobSystem::Schedule(Job* job)
+{
+	int worker = currentWorker;
+
+	if (worker < 0 || worker >= (int)deques.size() || !deques[worker]->Push(job))
+	{
+		std::lock_guard<std::mutex> lock(injectedLock);
+		injected.push_back(job);
+	}
+
+	{
+		// Same as in Shutdown: a sleeping worker sees either the new count or the notify
+		std::lock_guard<std::mutex> lock(sleepLock);
+		queuedJobs.fetch_add(1, std::memory_order_release);
+	}
+	wake.notify_one();
+}
+
+Job* JobSystem::FindJob(int workerIndex)
+{
+	Job* job = nullptr;
+
+	if (workerIndex >= 0 && workerIndex < (int)deques.size())
+	{
+		job = deques[workerIndex]->Pop();
+		if (job)
+		{
+			return job;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(injectedLock);
+		if (!injected.empty())
+		{
+			job = injected.front();
+			injected.pop_front();
+			return job;
+		}
+	}
+
+	// Start stealing from the next worker along so thieves spread out
+	int dequeCount = (int)deques.size();
+	for (int i = 1; i <= dequeCount; i++)
+	{
+		int victim = (workerIndex + i + dequeCount) % dequeCount;
+		if (victim == workerIndex)
+		{
+			continue;
+		}
+
+		job = deques[victim]->Steal();
+		if (job)
+		{
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+	job->task();
+
+	if (job->counter)
+	{
+		Finish(job->counter);
+	}
+
+	delete job;
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+	// Only the decrement that could reach zero needs the lock
+	int count = counter->count.load(std::memory_order_relaxed);
+	while (count > 1)
+	{
+		if (counter->count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->continuationLock);
+		if (counter->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			ready.swap(counter->continuations);
+		}
+	}
+
+	for (size_t i = 0; i < ready.size(); i++)
+	{
+		Schedule(ready[i]);
+	}
+}
+
+void JobSystem::WorkerLoop(int workerIndex)
+{
+	currentWorker = workerIndex;
+
+	while (!stopping.load(std::memory_order_relaxed))
+	{
+		Job* job = FindJob(workerIndex);
+		if (job)
+		{
+			Execute(job);
+			continue;
+		}
+
+		// Schedule and Shutdown change the predicate under sleepLock, so no wakeup is lost
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wake.wait(lock, [this]()
+		{
+			return stopping.load(std::memory_order_relaxed) || queuedJobs.load(std::memory_order_acquire) > 0;
+		});
+	}
+
+	currentWorker = -1;
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <deque>
+
+struct Job;
+
+// Counts unfinished jobs. Jobs that were given a counter as their dependency
+// are held back until it drops to zero, then scheduled.
+class JobCounter
+{
+public:
+	JobCounter();
+
+	bool IsDone() { return count.load(std::memory_order_acquire) == 0; }
+
+	~JobCounter();
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> count;
+
+	std::mutex continuationLock;
+	std::vector<Job*> continuations;
+};
+
+// Chase-Lev work-stealing deque of fixed capacity. The owning thread pushes and
+// pops at the bottom, any other thread steals from the top.
+class JobDeque
+{
+public:
+	JobDeque();
+
+	bool Push(Job* job);
+	Job* Pop();
+	Job* Steal();
+
+	~JobDeque();
+
+private:
+	static const long long CAPACITY = 4096;
+
+	std::atomic<long long> top;
+	std::atomic<long long> bottom;
+	std::atomic<Job*> jobs[CAPACITY];
+};
+
+class JobSystem
+{
+public:
+	JobSystem();
+
+	// workerCount is the number of threads executing jobs, including the calling
+	// thread; 0 picks one per hardware thread
+	void Initialise(unsigned int workerCount);
+	void Shutdown();
+
+	unsigned int GetWorkerCount() { return workerCount; }
+
+	void Run(const std::function<void()>& task, JobCounter* counter, JobCounter* dependency = nullptr);
+	void Wait(JobCounter* counter);
+
+	// Splits [0, count) into chunks of at most grainSize and runs them in parallel,
+	// returning once all chunks are done
+	void ParallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int begin, unsigned int end)>& body);
+
+	~JobSystem();
+
+private:
+	unsigned int workerCount;
+	std::vector<JobDeque*> deques;
+	std::vector<std::thread> threads;
+
+	// Jobs submitted by threads that are not workers (e.g. the simulation thread)
+	std::mutex injectedLock;
+	std::deque<Job*> injected;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<int> queuedJobs;
+	std::atomic<bool> stopping;
+
+	void Schedule(Job* job);
+	Job* FindJob(int workerIndex);
+	void Execute(Job* job);
+	void Finish(JobCounter* counter);
+	void WorkerLoop(int workerIndex);
+};
+
+extern JobSystem jobSystem;
+
@@ -1,7 +1,13 @@
 #include "Light.h"
 
+static unsigned int nextLightId = 0;
+
 Light::Light()
 {
+	id = ++nextLightId;
+	version = 0;
+	placementVersion = 0;
+
 	colour = glm::vec3(1.0f, 1.0f, 1.0f);
 	ambientIntensity = 1.0f;
 
@@ -12,6 +18,10 @@ Light::Light()
 Light::Light(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity,
 	GLfloat xDir, GLfloat yDir, GLfloat zDir, GLfloat dIntensity)
 {
+	id = ++nextLightId;
+	version = 0;
+	placementVersion = 0;
+
 	colour = glm::vec3(red, green, blue);
 	ambientIntensity = aIntensity;
 
@@ -21,6 +31,10 @@ Light::Light(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity,
 
 Light::Light(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity)
 {
+	id = ++nextLightId;
+	version = 0;
+	placementVersion = 0;
+
 	colour = glm::vec3(red, green, blue);
 	ambientIntensity = aIntensity;
 	diffuseIntensity = dIntensity;
@@ -28,6 +42,7 @@ Light::Light(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLflo
 
 void Light::UpdateDirection(GLfloat deltaTime, bool* keys) {
 	GLfloat speed = 1.0f * deltaTime;
+	glm::vec3 oldDirection = direction;
 	if (keys[GLFW_KEY_RIGHT]) {
 		direction.x -= speed;
 	}
@@ -40,7 +55,10 @@ void Light::UpdateDirection(GLfloat deltaTime, bool* keys) {
 	if (keys[GLFW_KEY_DOWN]) {
 		direction.y += speed;
 	}
-	direction = glm::normalize(direction);
+	if (direction != oldDirection) {
+		direction = glm::normalize(direction);
+		MarkMoved();
+	}
 }
 
 void Light::UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
@@ -52,6 +70,12 @@ void Light::UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLoca
 		glUniform1f(diffuseIntensityLocation, diffuseIntensity);
 	}
 
+bool Light::IsActive()
+{
+	bool lit = ambientIntensity > 0.0f || diffuseIntensity > 0.0f;
+	return lit && (colour.r > 0.0f || colour.g > 0.0f || colour.b > 0.0f);
+}
+
 Light::~Light()
 {
 }
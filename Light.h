@@ -18,23 +18,44 @@ public:
 		if (keys[GLFW_KEY_EQUAL]) {
 			if (ambientIntensity < 0.7) {
 				ambientIntensity += 0.001;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_MINUS]) {
 			if (ambientIntensity > 0.1) {
 				ambientIntensity -= 0.001;
+				MarkChanged();
 			}
 		}
 	}
 
 	void UpdateDirection(GLfloat deltaTime, bool* keys);
 
+	bool IsActive();
+
+	// Bumped on every change so shaders can skip re-uploading unchanged lights
+	unsigned int GetId() { return id; }
+	unsigned int GetVersion() { return version; }
+	// Bumped only when the light moves or turns, not for colour or intensity
+	unsigned int GetPlacementVersion() { return placementVersion; }
+
+	glm::vec3 GetColour() { return colour; }
+	GLfloat GetAmbientIntensity() { return ambientIntensity; }
+	GLfloat GetDiffuseIntensity() { return diffuseIntensity; }
+
 	void UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
 		GLfloat diffuseIntensityLocation, GLfloat directionLocation);
 
 	~Light();
 
 protected:
+	unsigned int id;
+	unsigned int version;
+	unsigned int placementVersion;
+
+	void MarkChanged() { version++; }
+	void MarkMoved() { version++; placementVersion++; }
+
 	glm::vec3 colour;
 	GLfloat ambientIntensity;
 
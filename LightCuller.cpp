@@ -0,0 +1,137 @@
+#include "LightCuller.h"
+
+LightCuller::LightCuller()
+{
+	pointLightCount = 0;
+	spotLightCount = 0;
+}
+
+void LightCuller::Update(FrameState& frame, const BVH& bvh)
+{
+	pointLightCount = 0;
+	for (unsigned int i = 0; i < frame.pointLightCount && i < MAX_POINT_LIGHTS; i++)
+	{
+		GLfloat range = frame.pointLights[i].GetRange();
+		if (range <= 0.0f)
+		{
+			// Switched off or black
+			continue;
+		}
+
+		PointVolume& volume = pointVolumes[pointLightCount++];
+		volume.centre = frame.pointLights[i].GetPosition();
+		volume.radius = range;
+		volume.index = i;
+	}
+
+	spotLightCount = 0;
+	for (unsigned int i = 0; i < frame.spotLightCount && i < MAX_SPOT_LIGHTS; i++)
+	{
+		SpotLight& light = frame.spotLights[i];
+		AABB bounds = light.GetBounds();
+		if (bounds.IsEmpty())
+		{
+			continue;
+		}
+
+		SpotVolume& volume = spotVolumes[spotLightCount++];
+		volume.bounds = bounds;
+		volume.apex = light.GetPosition();
+		volume.range = light.GetRange();
+		light.GetCone(volume.axis, volume.coneCos);
+		volume.coneSin = sqrtf(glm::max(1.0f - volume.coneCos * volume.coneCos, 0.0f));
+		volume.index = i;
+	}
+
+	// Only last frame's lit objects need clearing, not every object
+	if (objectLights.size() != bvh.GetItemCount())
+	{
+		objectLights.assign(bvh.GetItemCount(), glm::ivec4(0));
+	}
+	else
+	{
+		for (size_t i = 0; i < litObjects.size(); i++)
+		{
+			objectLights[litObjects[i]] = glm::ivec4(0);
+		}
+	}
+	litObjects.clear();
+
+	// Lights are visited in order, so every object's list keeps their order too
+	for (unsigned int i = 0; i < pointLightCount; i++)
+	{
+		const PointVolume& volume = pointVolumes[i];
+
+		queryObjects.clear();
+		bvh.QuerySphere(volume.centre, volume.radius, queryObjects);
+		for (size_t j = 0; j < queryObjects.size(); j++)
+		{
+			glm::ivec4& list = objectLights[queryObjects[j]];
+			if (list.x == 0 && list.z == 0)
+			{
+				litObjects.push_back(queryObjects[j]);
+			}
+
+			list.y |= volume.index << (8 * list.x);
+			list.x++;
+		}
+	}
+
+	for (unsigned int i = 0; i < spotLightCount; i++)
+	{
+		const SpotVolume& volume = spotVolumes[i];
+
+		queryObjects.clear();
+		bvh.QueryBox(volume.bounds, queryObjects);
+		for (size_t j = 0; j < queryObjects.size(); j++)
+		{
+			if (!SpotTouches(volume, bvh.GetItemBounds(queryObjects[j])))
+			{
+				continue;
+			}
+
+			glm::ivec4& list = objectLights[queryObjects[j]];
+			if (list.x == 0 && list.z == 0)
+			{
+				litObjects.push_back(queryObjects[j]);
+			}
+
+			list.w |= volume.index << (8 * list.z);
+			list.z++;
+		}
+	}
+}
+
+glm::ivec4 LightCuller::GetLightList(unsigned int object) const
+{
+	return object < objectLights.size() ? objectLights[object] : glm::ivec4(0);
+}
+
+bool LightCuller::SpotTouches(const SpotVolume& spot, const AABB& bounds)
+{
+	if (!spot.bounds.Overlaps(bounds) || !bounds.OverlapsSphere(spot.apex, spot.range))
+	{
+		return false;
+	}
+
+	// Wider than a hemisphere: the box and sphere tests are all there is
+	if (spot.coneCos <= 0.0f)
+	{
+		return true;
+	}
+
+	// The box's bounding sphere against the cone: its centre's distance from the
+	// cone's side, measured in the plane through the axis
+	glm::vec3 centre = bounds.GetCentre();
+	float radius = 0.5f * glm::length(bounds.GetExtent());
+
+	glm::vec3 offset = centre - spot.apex;
+	float along = glm::dot(offset, spot.axis);
+	float across = sqrtf(glm::max(glm::dot(offset, offset) - along * along, 0.0f));
+
+	return across * spot.coneCos - along * spot.coneSin <= radius;
+}
+
+LightCuller::~LightCuller()
+{
+}
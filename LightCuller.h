@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+#include "Bounds.h"
+#include "BVH.h"
+#include "FrameState.h"
+
+// Per-draw light lists. Each frame the point lights' influence spheres (from
+// their attenuation) and the spot lights' cones are computed once, and the scene
+// BVH gathers the objects each one reaches, so the shader only loops over lights
+// that can reach the object.
+class LightCuller
+{
+public:
+	LightCuller();
+
+	// Call before recording, with the BVH over the scene's objects refitted;
+	// indices in the lists refer to the frame's light arrays
+	void Update(FrameState& frame, const BVH& bvh);
+
+	// Lights whose volume touches the object's bounds, packed as DrawBlock.drawLights:
+	// x - point light count, y - point light indices, z - spot light count,
+	// w - spot light indices, 8 bits per index starting at the low byte
+	glm::ivec4 GetLightList(unsigned int object) const;
+
+	unsigned int GetPointLightCount() const { return pointLightCount; }
+	unsigned int GetSpotLightCount() const { return spotLightCount; }
+
+	~LightCuller();
+
+private:
+	struct PointVolume
+	{
+		glm::vec3 centre;
+		float radius;
+		int index;
+	};
+
+	struct SpotVolume
+	{
+		AABB bounds;
+		glm::vec3 apex;
+		glm::vec3 axis;
+		float range;
+		float coneCos;
+		float coneSin;
+		int index;
+	};
+
+	PointVolume pointVolumes[MAX_POINT_LIGHTS];
+	SpotVolume spotVolumes[MAX_SPOT_LIGHTS];
+	unsigned int pointLightCount;
+	unsigned int spotLightCount;
+
+	// Indexed by object; only the objects in litObjects are non-zero
+	std::vector<glm::ivec4> objectLights;
+	std::vector<unsigned int> litObjects;
+	std::vector<unsigned int> queryObjects;
+
+	static bool SpotTouches(const SpotVolume& spot, const AABB& bounds);
+};
+
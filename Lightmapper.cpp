@@ -0,0 +1,1169 @@
+#include "Lightmapper.h"
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+// Rays start this far off the surface so they don't hit the triangle they leave
+static const float RAY_OFFSET = 1e-3f;
+// Shadow rays aim at a random point within this radius of the light, for soft edges
+static const float LIGHT_RADIUS = 0.05f;
+// Directional shadow rays stop here, past the far side of the scene
+static const float SUN_DISTANCE = 100.0f;
+static const float BOUNCE_DISTANCE = 50.0f;
+static const float PI = 3.14159265f;
+
+static constexpr unsigned int LIGHTMAP_LAYERS = UniformHash("lightmapLayers");
+static constexpr unsigned int LAYER_COUNT = UniformHash("layerCount");
+static constexpr unsigned int LAYER_DIFFUSE = UniformHash("layerDiffuse[]");
+static constexpr unsigned int LAYER_AMBIENT = UniformHash("layerAmbient[]");
+
+// Texels are baked independently, so each gets its own PCG-style stream
+static unsigned int HashTexel(unsigned int index)
+{
+	unsigned int state = index * 747796405u + 2891336453u;
+	unsigned int word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+static float Random(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static glm::vec3 RandomInSphere(unsigned int& seed)
+{
+	glm::vec3 point;
+	do
+	{
+		point = glm::vec3(Random(seed), Random(seed), Random(seed)) * 2.0f - glm::vec3(1.0f);
+	} while (glm::dot(point, point) > 1.0f);
+
+	return point;
+}
+
+static glm::vec3 CosineDirection(const glm::vec3& normal, unsigned int& seed)
+{
+	glm::vec3 up = std::fabs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+
+	float angle = 2.0f * PI * Random(seed);
+	float r2 = Random(seed);
+	float r = std::sqrt(r2);
+
+	return tangent * (r * std::cos(angle)) + bitangent * (r * std::sin(angle)) + normal * std::sqrt(1.0f - r2);
+}
+
+static float Luminance(const glm::vec3& colour)
+{
+	return colour.r * 0.2126f + colour.g * 0.7152f + colour.b * 0.0722f;
+}
+
+// Twice the signed area of (a, b, p)
+static float EdgeFunction(const glm::vec2& a, const glm::vec2& b, const glm::vec2& p)
+{
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+Lightmapper::Lightmapper()
+{
+	layerTexture = 0;
+	atlasTexture = 0;
+	atlasFBO = 0;
+	emptyVAO = 0;
+	atlasWidth = 0;
+	atlasHeight = 0;
+	combined = false;
+}
+
+void Lightmapper::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation)
+{
+	char defines[64];
+	snprintf(defines, sizeof(defines), "#define MAX_LAYERS %u\n", MAX_LAYERS);
+	combineShader.CreateFromFiles(vertexLocation, fragmentLocation, defines);
+}
+
+void Lightmapper::Unwrap(const GLfloat* vertices, const unsigned int* indices, unsigned int numOfVertices,
+	unsigned int numOfIndices, LightmapMesh& unwrapped)
+{
+	unsigned int vertexCount = numOfVertices / 8;
+	unsigned int triangleCount = numOfIndices / 3;
+
+	unwrapped.vertices.clear();
+	unwrapped.lightmapUVs.clear();
+	unwrapped.indices.clear();
+	unwrapped.width = 0;
+	unwrapped.height = 0;
+
+	// Seams split vertices that share a position, so adjacency goes through the welded indices
+	PositionStream welded;
+	Mesh::BuildPositionStream(vertices, indices, numOfVertices, numOfIndices, welded);
+
+	std::vector<int> triangleAxis(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 corners[3];
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int index = indices[t * 3 + k] < vertexCount ? indices[t * 3 + k] : 0;
+			corners[k] = glm::vec3(vertices[index * 8], vertices[index * 8 + 1], vertices[index * 8 + 2]);
+		}
+
+		glm::vec3 normal = glm::abs(glm::cross(corners[1] - corners[0], corners[2] - corners[0]));
+		triangleAxis[t] = normal.x >= normal.y && normal.x >= normal.z ? 0 : (normal.y >= normal.z ? 1 : 2);
+	}
+
+	// Charts: triangles projected along the same axis and joined by an edge
+	std::vector<unsigned int> parent(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		parent[t] = t;
+	}
+
+	auto findRoot = [&parent](unsigned int t)
+	{
+		while (parent[t] != t)
+		{
+			parent[t] = parent[parent[t]];
+			t = parent[t];
+		}
+		return t;
+	};
+
+	std::unordered_map<unsigned long long, unsigned int> edgeOwners;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int a = welded.indices[t * 3 + k];
+			unsigned int b = welded.indices[t * 3 + (k + 1) % 3];
+			unsigned long long key = ((unsigned long long)std::min(a, b) << 34) | ((unsigned long long)std::max(a, b) << 2) | triangleAxis[t];
+
+			std::pair<std::unordered_map<unsigned long long, unsigned int>::iterator, bool> inserted = edgeOwners.insert(std::make_pair(key, t));
+			if (!inserted.second)
+			{
+				parent[findRoot(t)] = findRoot(inserted.first->second);
+			}
+		}
+	}
+
+	struct Chart
+	{
+		int axis;
+		glm::vec2 min;
+		glm::vec2 max;
+	};
+
+	std::vector<Chart> charts;
+	std::vector<int> rootChart(triangleCount, -1);
+	std::vector<unsigned int> triangleChart(triangleCount);
+
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		unsigned int root = findRoot(t);
+		if (rootChart[root] < 0)
+		{
+			Chart chart = { triangleAxis[t], glm::vec2(FLT_MAX), glm::vec2(-FLT_MAX) };
+			rootChart[root] = (int)charts.size();
+			charts.push_back(chart);
+		}
+		triangleChart[t] = rootChart[root];
+	}
+
+	// Texel-space projection of a vertex onto its chart's plane
+	auto project = [vertices](unsigned int index, int axis)
+	{
+		const GLfloat* position = &vertices[index * 8];
+		return glm::vec2(position[(axis + 1) % 3], position[(axis + 2) % 3]) * (float)TEXELS_PER_UNIT;
+	};
+
+	for (unsigned int i = 0; i < numOfIndices - numOfIndices % 3; i++)
+	{
+		Chart& chart = charts[triangleChart[i / 3]];
+		unsigned int index = indices[i] < vertexCount ? indices[i] : 0;
+		glm::vec2 texel = project(index, chart.axis);
+		chart.min = glm::min(chart.min, texel);
+		chart.max = glm::max(chart.max, texel);
+	}
+
+	std::vector<glm::uvec2> sizes(charts.size());
+	for (size_t c = 0; c < charts.size(); c++)
+	{
+		glm::vec2 extent = charts[c].max - charts[c].min;
+		sizes[c] = glm::uvec2((unsigned int)std::max(std::ceil(extent.x), 1.0f) + CHART_PADDING * 2,
+			(unsigned int)std::max(std::ceil(extent.y), 1.0f) + CHART_PADDING * 2);
+	}
+
+	std::vector<glm::uvec2> origins;
+	PackRects(sizes, origins, unwrapped.width, unwrapped.height);
+
+	// A vertex is copied once for every chart that uses it
+	std::unordered_map<unsigned long long, unsigned int> chartVertices;
+	for (unsigned int i = 0; i < numOfIndices - numOfIndices % 3; i++)
+	{
+		unsigned int chartIndex = triangleChart[i / 3];
+		unsigned int index = indices[i] < vertexCount ? indices[i] : 0;
+		unsigned long long key = ((unsigned long long)chartIndex << 32) | index;
+
+		std::pair<std::unordered_map<unsigned long long, unsigned int>::iterator, bool> inserted =
+			chartVertices.insert(std::make_pair(key, (unsigned int)(unwrapped.vertices.size() / 8)));
+		if (inserted.second)
+		{
+			const Chart& chart = charts[chartIndex];
+			glm::vec2 texel = project(index, chart.axis) - chart.min + glm::vec2((float)CHART_PADDING) +
+				glm::vec2((float)origins[chartIndex].x, (float)origins[chartIndex].y);
+
+			unwrapped.vertices.insert(unwrapped.vertices.end(), &vertices[index * 8], &vertices[index * 8 + 8]);
+			unwrapped.lightmapUVs.push_back(texel.x / unwrapped.width);
+			unwrapped.lightmapUVs.push_back(texel.y / unwrapped.height);
+		}
+		unwrapped.indices.push_back(inserted.first->second);
+	}
+}
+
+void Lightmapper::AddMesh(Mesh* mesh, const LightmapMesh& unwrapped)
+{
+	MeshCharts& charts = meshCharts[mesh];
+	charts.positions.clear();
+	charts.lightmapUVs.clear();
+
+	for (size_t i = 0; i + 7 < unwrapped.vertices.size(); i += 8)
+	{
+		charts.positions.push_back(glm::vec3(unwrapped.vertices[i], unwrapped.vertices[i + 1], unwrapped.vertices[i + 2]));
+	}
+	for (size_t i = 0; i + 1 < unwrapped.lightmapUVs.size(); i += 2)
+	{
+		charts.lightmapUVs.push_back(glm::vec2(unwrapped.lightmapUVs[i], unwrapped.lightmapUVs[i + 1]));
+	}
+
+	charts.indices = unwrapped.indices;
+	charts.width = unwrapped.width;
+	charts.height = unwrapped.height;
+}
+
+bool Lightmapper::Bake(Scene& scene, FrameState& frame, JobSystem& jobs)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	struct Placement
+	{
+		unsigned int object;
+		const MeshCharts* charts;
+		unsigned int firstTriangle;
+		unsigned int triangleCount;
+	};
+
+	// Every instance gets its own rectangle, sized by its mesh
+	std::vector<Placement> placements;
+	std::vector<glm::uvec2> sizes;
+	for (unsigned int i = 0; i < scene.GetObjectCount(); i++)
+	{
+		const SceneObject& object = scene.GetObject(i);
+		scene.SetLightmapRect(i, glm::vec4(0.0f));
+
+		if (object.type != SCENE_OBJECT_MESH)
+		{
+			continue;
+		}
+
+		std::unordered_map<const Mesh*, MeshCharts>::const_iterator charts = meshCharts.find(scene.GetMesh(object.resource));
+		if (charts == meshCharts.end() || charts->second.width == 0)
+		{
+			continue;
+		}
+
+		Placement placement = { i, &charts->second, 0, 0 };
+		placements.push_back(placement);
+		sizes.push_back(glm::uvec2(charts->second.width, charts->second.height));
+	}
+
+	if (placements.empty())
+	{
+		printf("Lightmap: no lightmapped objects in the scene\n");
+		return false;
+	}
+
+	std::vector<glm::uvec2> origins;
+	unsigned int width = 0, height = 0;
+	PackRects(sizes, origins, width, height);
+
+	if (width > MAX_ATLAS_SIZE || height > MAX_ATLAS_SIZE)
+	{
+		printf("Lightmap: atlas of %ux%u texels is too large\n", width, height);
+		return false;
+	}
+
+	atlasWidth = width;
+	atlasHeight = height;
+
+	// World-space triangles with their atlas texel corners, for tracing and rasterising
+	triangles.clear();
+	for (size_t p = 0; p < placements.size(); p++)
+	{
+		Placement& placement = placements[p];
+		const SceneObject& object = scene.GetObject(placement.object);
+		const MeshCharts& charts = *placement.charts;
+
+		glm::vec2 size((float)charts.width, (float)charts.height);
+		glm::vec2 origin((float)origins[p].x, (float)origins[p].y);
+
+		scene.SetLightmapRect(placement.object, glm::vec4(size.x / atlasWidth, size.y / atlasHeight,
+			origin.x / atlasWidth, origin.y / atlasHeight));
+
+		glm::vec3 albedo(0.5f);
+		if (object.texture != NO_SCENE_RESOURCE)
+		{
+			albedo = scene.GetTexture(object.texture)->GetAverageColour();
+		}
+
+		placement.firstTriangle = (unsigned int)triangles.size();
+		for (size_t i = 0; i + 2 < charts.indices.size(); i += 3)
+		{
+			BakeTriangle triangle;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int index = charts.indices[i + k];
+				triangle.positions[k] = glm::vec3(object.transform * glm::vec4(charts.positions[index], 1.0f));
+				triangle.texels[k] = origin + charts.lightmapUVs[index] * size;
+			}
+
+			glm::vec3 normal = glm::cross(triangle.positions[1] - triangle.positions[0], triangle.positions[2] - triangle.positions[0]);
+			if (glm::dot(normal, normal) <= 1e-12f)
+			{
+				continue;
+			}
+
+			triangle.normal = glm::normalize(normal);
+			triangle.albedo = albedo;
+			triangles.push_back(triangle);
+		}
+		placement.triangleCount = (unsigned int)triangles.size() - placement.firstTriangle;
+	}
+
+	// Slightly fattened so the slab test never misses flat, axis-aligned triangles
+	std::vector<AABB> triangleBounds(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			triangleBounds[i].Grow(triangles[i].positions[k]);
+		}
+		triangleBounds[i].min -= glm::vec3(1e-4f);
+		triangleBounds[i].max += glm::vec3(1e-4f);
+	}
+	triangleBVH.Build(triangleBounds, jobs);
+
+	Texel empty = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), -1, 0 };
+	texels.assign(atlasWidth * atlasHeight, empty);
+
+	// Objects own disjoint rectangles, so they rasterise in parallel
+	jobs.ParallelFor((unsigned int)placements.size(), 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int p = begin; p < end; p++)
+		{
+			for (unsigned int t = placements[p].firstTriangle; t < placements[p].firstTriangle + placements[p].triangleCount; t++)
+			{
+				RasteriseTriangle(t);
+			}
+		}
+	});
+
+	// One layer per light, in the order the frame lists them
+	layers.clear();
+	if (frame.features.directionalLight)
+	{
+		LightLayer layer = { frame.mainLight.GetId(), frame.mainLight.GetPlacementVersion(), LAYER_DIRECTIONAL, 0, 0, false };
+		layers.push_back(layer);
+	}
+	for (unsigned int i = 0; i < frame.pointLightCount; i++)
+	{
+		LightLayer layer = { frame.pointLights[i].GetId(), frame.pointLights[i].GetPlacementVersion(), LAYER_POINT, i, 0, false };
+		layers.push_back(layer);
+	}
+	for (unsigned int i = 0; i < frame.spotLightCount; i++)
+	{
+		LightLayer layer = { frame.spotLights[i].GetId(), frame.spotLights[i].GetPlacementVersion(), LAYER_SPOT, i, 0, false };
+		layers.push_back(layer);
+	}
+
+	unsigned int texelCount = atlasWidth * atlasHeight;
+	unsigned int layerCount = (unsigned int)layers.size();
+	std::vector<std::vector<float>> ambient(layerCount, std::vector<float>(texelCount, 0.0f));
+	std::vector<std::vector<float>> direct(layerCount, std::vector<float>(texelCount, 0.0f));
+
+	// Direct light on both sides of each texel; the brighter side is the one facing out
+	jobs.ParallelFor(atlasHeight, 4, [&](unsigned int begin, unsigned int end)
+	{
+		float front[MAX_LAYERS], back[MAX_LAYERS];
+
+		for (unsigned int i = begin * atlasWidth; i < end * atlasWidth; i++)
+		{
+			Texel& texel = texels[i];
+			if (texel.triangle < 0)
+			{
+				continue;
+			}
+
+			unsigned int seed = HashTexel(i);
+			float frontTotal = 0.0f, backTotal = 0.0f;
+			for (unsigned int l = 0; l < layerCount; l++)
+			{
+				front[l] = DirectLight(texel.position, texel.normal, frame, layers[l], seed);
+				back[l] = DirectLight(texel.position, -texel.normal, frame, layers[l], seed);
+				frontTotal += front[l];
+				backTotal += back[l];
+				ambient[l][i] = AmbientLight(texel.position, frame, layers[l]);
+			}
+
+			if (frontTotal > 0.0f || backTotal > 0.0f)
+			{
+				bool frontLit = frontTotal >= backTotal;
+				texel.outward = frontLit ? texel.normal : -texel.normal;
+				for (unsigned int l = 0; l < layerCount; l++)
+				{
+					direct[l][i] = frontLit ? front[l] : back[l];
+				}
+			}
+		}
+	});
+
+	// Bounce rays may land in a texel only partly covered by its triangle
+	std::vector<std::vector<float>> directLookup = direct;
+	for (unsigned int l = 0; l < layerCount; l++)
+	{
+		Dilate(directLookup[l]);
+	}
+
+	std::vector<std::vector<glm::vec3>> bounce(layerCount, std::vector<glm::vec3>(texelCount, glm::vec3(0.0f)));
+	jobs.ParallelFor(atlasHeight, 4, [&](unsigned int begin, unsigned int end)
+	{
+		glm::vec3 front[MAX_LAYERS], back[MAX_LAYERS];
+
+		for (unsigned int i = begin * atlasWidth; i < end * atlasWidth; i++)
+		{
+			const Texel& texel = texels[i];
+			if (texel.triangle < 0)
+			{
+				continue;
+			}
+
+			unsigned int seed = HashTexel(i + texelCount);
+			if (texel.outward != glm::vec3(0.0f))
+			{
+				BounceLight(texel, texel.outward, directLookup, seed, front);
+			}
+			else
+			{
+				// No direct light to tell which side faces out, so keep the brighter bounce
+				BounceLight(texel, texel.normal, directLookup, seed, front);
+				BounceLight(texel, -texel.normal, directLookup, seed, back);
+
+				float frontTotal = 0.0f, backTotal = 0.0f;
+				for (unsigned int l = 0; l < layerCount; l++)
+				{
+					frontTotal += Luminance(front[l]);
+					backTotal += Luminance(back[l]);
+				}
+				if (backTotal > frontTotal)
+				{
+					std::copy(back, back + layerCount, front);
+				}
+			}
+
+			for (unsigned int l = 0; l < layerCount; l++)
+			{
+				bounce[l][i] = front[l];
+			}
+		}
+	});
+
+	std::vector<glm::vec4> layerData(texelCount * layerCount);
+	std::vector<glm::vec3> denoised;
+	std::vector<glm::vec4> layer(texelCount);
+	for (unsigned int l = 0; l < layerCount; l++)
+	{
+		Denoise(bounce[l], denoised, jobs);
+
+		for (unsigned int i = 0; i < texelCount; i++)
+		{
+			layer[i] = texels[i].triangle >= 0 ? glm::vec4(glm::vec3(direct[l][i]) + denoised[i], ambient[l][i]) : glm::vec4(0.0f);
+		}
+		Dilate(layer);
+
+		std::copy(layer.begin(), layer.end(), layerData.begin() + l * texelCount);
+	}
+
+	// The layers are only ever read by the sum pass, one texel at a time
+	if (layerTexture == 0)
+	{
+		glGenTextures(1, &layerTexture);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layerTexture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	if (layerCount == 0)
+	{
+		// An array needs a layer even when there is no light to put in it
+		layerData.assign(texelCount, glm::vec4(0.0f));
+	}
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, atlasWidth, atlasHeight, std::max(layerCount, 1u), 0, GL_RGBA, GL_FLOAT, &layerData[0].x);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// RGBA rather than RGB: 16-bit float RGB isn't guaranteed to be renderable
+	if (atlasTexture == 0)
+	{
+		glGenTextures(1, &atlasTexture);
+	}
+	glBindTexture(GL_TEXTURE_2D, atlasTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, atlasWidth, atlasHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (atlasFBO == 0)
+	{
+		glGenFramebuffers(1, &atlasFBO);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, atlasFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlasTexture, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	unsigned int triangleCount = (unsigned int)triangles.size();
+
+	// Only the textures are needed from here on
+	std::vector<BakeTriangle>().swap(triangles);
+	std::vector<Texel>().swap(texels);
+	triangleBVH.Clear();
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Lightmap framebuffer error: 0x%x\n", status);
+		glDeleteTextures(1, &layerTexture);
+		layerTexture = 0;
+		return false;
+	}
+
+	// The first Relight sums every layer
+	combined = false;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Lightmap baked: %ux%u texels, %u light layers, %u objects, %u triangles in %.2f s\n",
+		atlasWidth, atlasHeight, layerCount, (unsigned int)placements.size(), triangleCount, seconds);
+
+	return true;
+}
+
+bool Lightmapper::Matches(FrameState& frame) const
+{
+	if (layerTexture == 0)
+	{
+		return false;
+	}
+
+	// Lights that were off while baking have no layer; lights that are off now just weigh 0
+	Light* lights[MAX_LAYERS];
+	unsigned int lightCount = 0;
+	if (frame.features.directionalLight)
+	{
+		lights[lightCount++] = &frame.mainLight;
+	}
+	for (unsigned int i = 0; i < frame.pointLightCount; i++)
+	{
+		lights[lightCount++] = &frame.pointLights[i];
+	}
+	for (unsigned int i = 0; i < frame.spotLightCount; i++)
+	{
+		lights[lightCount++] = &frame.spotLights[i];
+	}
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		bool found = false;
+		for (size_t l = 0; l < layers.size() && !found; l++)
+		{
+			found = layers[l].id == lights[i]->GetId() && layers[l].placementVersion == lights[i]->GetPlacementVersion();
+		}
+
+		if (!found)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Lightmapper::Relight(FrameState& frame)
+{
+	if (!Matches(frame))
+	{
+		return false;
+	}
+
+	bool changed = !combined;
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		Light* light = FindLight(frame, layers[l]);
+		unsigned int version = light ? light->GetVersion() : 0;
+		changed = changed || layers[l].present != (light != nullptr) || layers[l].version != version;
+		layers[l].present = light != nullptr;
+		layers[l].version = version;
+	}
+
+	if (!changed)
+	{
+		return true;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, atlasFBO);
+	glViewport(0, 0, atlasWidth, atlasHeight);
+
+	combineShader.UseShader();
+	glUniform1i(combineShader.GetUniformLocation(LIGHTMAP_LAYERS), LIGHTMAP_TEXTURE_UNIT);
+	glUniform1i(combineShader.GetUniformLocation(LAYER_COUNT), (GLint)layers.size());
+
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		glm::vec3 diffuse(0.0f), ambient(0.0f);
+		Light* light = FindLight(frame, layers[l]);
+		if (light)
+		{
+			diffuse = light->GetColour() * light->GetDiffuseIntensity();
+			ambient = light->GetColour() * light->GetAmbientIntensity();
+		}
+
+		glUniform3f(combineShader.GetUniformLocation(LAYER_DIFFUSE, (unsigned int)l), diffuse.x, diffuse.y, diffuse.z);
+		glUniform3f(combineShader.GetUniformLocation(LAYER_AMBIENT, (unsigned int)l), ambient.x, ambient.y, ambient.z);
+	}
+
+	glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layerTexture);
+
+	if (emptyVAO == 0)
+	{
+		glGenVertexArrays(1, &emptyVAO);
+	}
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	combined = true;
+	return true;
+}
+
+void Lightmapper::UseLightmap()
+{
+	glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, atlasTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void Lightmapper::ClearLightmapper()
+{
+	if (atlasFBO != 0)
+	{
+		glDeleteFramebuffers(1, &atlasFBO);
+		atlasFBO = 0;
+	}
+
+	if (atlasTexture != 0)
+	{
+		glDeleteTextures(1, &atlasTexture);
+		atlasTexture = 0;
+	}
+
+	if (layerTexture != 0)
+	{
+		glDeleteTextures(1, &layerTexture);
+		layerTexture = 0;
+	}
+
+	if (emptyVAO != 0)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+		emptyVAO = 0;
+	}
+
+	combineShader.ClearShader();
+
+	atlasWidth = 0;
+	atlasHeight = 0;
+	layers.clear();
+	meshCharts.clear();
+	combined = false;
+}
+
+bool Lightmapper::Occluded(const glm::vec3& origin, const glm::vec3& target) const
+{
+	glm::vec3 offset = target - origin;
+	float distance = glm::length(offset);
+	if (distance <= RAY_OFFSET)
+	{
+		return false;
+	}
+
+	Ray ray(origin, offset / distance);
+	unsigned int triangle;
+	float hitDistance;
+	glm::vec2 barycentric;
+	return TraceTriangle(ray, distance - RAY_OFFSET, triangle, hitDistance, barycentric);
+}
+
+bool Lightmapper::TraceTriangle(const Ray& ray, float maxDistance, unsigned int& triangle, float& distance, glm::vec2& barycentric) const
+{
+	float closest = maxDistance;
+
+	// Moller-Trumbore; the BVH keeps a hit only if it is the nearest so far, which mirrors closest
+	bool hit = triangleBVH.Raycast(ray, maxDistance, triangle, distance, [&](unsigned int item, float& itemDistance)
+	{
+		const BakeTriangle& candidate = triangles[item];
+		glm::vec3 edge1 = candidate.positions[1] - candidate.positions[0];
+		glm::vec3 edge2 = candidate.positions[2] - candidate.positions[0];
+
+		glm::vec3 p = glm::cross(ray.direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::fabs(determinant) < 1e-12f)
+		{
+			return false;
+		}
+
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = ray.origin - candidate.positions[0];
+		float u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(ray.direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+
+		float t = glm::dot(edge2, q) * inverse;
+		if (t < 0.0f || t > closest)
+		{
+			return false;
+		}
+
+		closest = t;
+		itemDistance = t;
+		barycentric = glm::vec2(u, v);
+		return true;
+	});
+
+	return hit;
+}
+
+void Lightmapper::RasteriseTriangle(unsigned int triangleIndex)
+{
+	const BakeTriangle& triangle = triangles[triangleIndex];
+	const glm::vec2* corners = triangle.texels;
+
+	float area = EdgeFunction(corners[0], corners[1], corners[2]);
+	if (std::fabs(area) < 1e-8f)
+	{
+		return;
+	}
+
+	// Texels whose square the triangle touches, not just those whose centre it covers
+	glm::vec2 low = glm::min(corners[0], glm::min(corners[1], corners[2]));
+	glm::vec2 high = glm::max(corners[0], glm::max(corners[1], corners[2]));
+	int minX = std::max((int)std::floor(low.x - 0.5f), 0);
+	int minY = std::max((int)std::floor(low.y - 0.5f), 0);
+	int maxX = std::min((int)std::ceil(high.x + 0.5f), (int)atlasWidth - 1);
+	int maxY = std::min((int)std::ceil(high.y + 0.5f), (int)atlasHeight - 1);
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		for (int x = minX; x <= maxX; x++)
+		{
+			glm::vec2 centre(x + 0.5f, y + 0.5f);
+			float w0 = EdgeFunction(corners[1], corners[2], centre) / area;
+			float w1 = EdgeFunction(corners[2], corners[0], centre) / area;
+			float w2 = 1.0f - w0 - w1;
+
+			int coverage = 2;
+			if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+			{
+				// Pull the centre onto the triangle; only keep it if that stays inside the texel
+				w0 = std::max(w0, 0.0f);
+				w1 = std::max(w1, 0.0f);
+				w2 = std::max(w2, 0.0f);
+				float sum = w0 + w1 + w2;
+				w0 /= sum;
+				w1 /= sum;
+				w2 /= sum;
+
+				glm::vec2 closest = corners[0] * w0 + corners[1] * w1 + corners[2] * w2;
+				if (std::fabs(closest.x - centre.x) > 0.5f || std::fabs(closest.y - centre.y) > 0.5f)
+				{
+					continue;
+				}
+				coverage = 1;
+			}
+
+			Texel& texel = texels[y * atlasWidth + x];
+			if (coverage <= texel.coverage)
+			{
+				continue;
+			}
+
+			texel.position = triangle.positions[0] * w0 + triangle.positions[1] * w1 + triangle.positions[2] * w2;
+			texel.normal = triangle.normal;
+			texel.triangle = (int)triangleIndex;
+			texel.coverage = coverage;
+		}
+	}
+}
+
+float Lightmapper::DirectLight(const glm::vec3& position, const glm::vec3& normal, FrameState& frame, const LightLayer& layer, unsigned int& seed) const
+{
+	// The shader's diffuse term for a white light of intensity 1, shadowed. Its normals
+	// point into the surface, so normal here (pointing out) is compared against the
+	// direction to the light.
+	glm::vec3 origin = position + normal * RAY_OFFSET;
+
+	if (layer.type == LAYER_DIRECTIONAL)
+	{
+		glm::vec3 toLight = -glm::normalize(frame.mainLight.GetDirection());
+		float factor = glm::dot(normal, toLight);
+		if (factor <= 0.0f)
+		{
+			return 0.0f;
+		}
+
+		unsigned int lit = 0;
+		for (unsigned int s = 0; s < SHADOW_SAMPLES; s++)
+		{
+			glm::vec3 target = origin + toLight * SUN_DISTANCE + RandomInSphere(seed) * LIGHT_RADIUS;
+			lit += Occluded(origin, target) ? 0 : 1;
+		}
+
+		return factor * ((float)lit / SHADOW_SAMPLES);
+	}
+
+	PointLight& light = layer.type == LAYER_SPOT ? frame.spotLights[layer.index] : frame.pointLights[layer.index];
+
+	glm::vec3 toLight = light.GetPosition() - position;
+	float distance = glm::length(toLight);
+	if (distance <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	float factor = glm::dot(normal, toLight / distance);
+	if (factor <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	glm::vec3 attenuationTerms = light.GetAttenuation();
+	float attenuation = attenuationTerms.z * distance * distance + attenuationTerms.y * distance + attenuationTerms.x;
+	float cone = 1.0f;
+
+	if (layer.type == LAYER_SPOT)
+	{
+		SpotLight& spotLight = frame.spotLights[layer.index];
+		float edge = spotLight.GetEdgeCos();
+		float spotFactor = glm::dot(-toLight / distance, spotLight.GetDirection());
+		if (spotFactor <= edge)
+		{
+			return 0.0f;
+		}
+		cone = 1.0f - (1.0f - spotFactor) * (1.0f / (1.0f - edge));
+	}
+
+	unsigned int lit = 0;
+	for (unsigned int s = 0; s < SHADOW_SAMPLES; s++)
+	{
+		lit += Occluded(origin, light.GetPosition() + RandomInSphere(seed) * LIGHT_RADIUS) ? 0 : 1;
+	}
+
+	return factor * cone / attenuation * ((float)lit / SHADOW_SAMPLES);
+}
+
+float Lightmapper::AmbientLight(const glm::vec3& position, FrameState& frame, const LightLayer& layer) const
+{
+	// Unshadowed and independent of the normal, exactly as the shader adds it
+	if (layer.type == LAYER_DIRECTIONAL)
+	{
+		return 1.0f;
+	}
+
+	PointLight& light = layer.type == LAYER_SPOT ? frame.spotLights[layer.index] : frame.pointLights[layer.index];
+
+	glm::vec3 fromLight = position - light.GetPosition();
+	float distance = glm::length(fromLight);
+	glm::vec3 attenuationTerms = light.GetAttenuation();
+	float attenuation = attenuationTerms.z * distance * distance + attenuationTerms.y * distance + attenuationTerms.x;
+
+	if (layer.type == LAYER_SPOT)
+	{
+		SpotLight& spotLight = frame.spotLights[layer.index];
+		float edge = spotLight.GetEdgeCos();
+		float spotFactor = distance > 0.0f ? glm::dot(fromLight / distance, spotLight.GetDirection()) : 1.0f;
+		if (spotFactor <= edge)
+		{
+			return 0.0f;
+		}
+		return (1.0f - (1.0f - spotFactor) * (1.0f / (1.0f - edge))) / attenuation;
+	}
+
+	return 1.0f / attenuation;
+}
+
+void Lightmapper::BounceLight(const Texel& texel, const glm::vec3& normal, const std::vector<std::vector<float>>& direct,
+	unsigned int& seed, glm::vec3* bounce) const
+{
+	// Cosine-weighted, so the mean of what the rays see is the bounced light to store.
+	// Each ray is traced once and picks up every layer where it lands.
+	glm::vec3 origin = texel.position + normal * RAY_OFFSET;
+
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		bounce[l] = glm::vec3(0.0f);
+	}
+
+	for (unsigned int s = 0; s < BOUNCE_SAMPLES; s++)
+	{
+		Ray ray(origin, CosineDirection(normal, seed));
+
+		unsigned int hitTriangle;
+		float distance;
+		glm::vec2 barycentric;
+		if (!TraceTriangle(ray, BOUNCE_DISTANCE, hitTriangle, distance, barycentric))
+		{
+			continue;
+		}
+
+		const BakeTriangle& hit = triangles[hitTriangle];
+		glm::vec2 atlas = hit.texels[0] * (1.0f - barycentric.x - barycentric.y) + hit.texels[1] * barycentric.x + hit.texels[2] * barycentric.y;
+		int x = std::min(std::max((int)atlas.x, 0), (int)atlasWidth - 1);
+		int y = std::min(std::max((int)atlas.y, 0), (int)atlasHeight - 1);
+		unsigned int index = y * atlasWidth + x;
+
+		// The unlit back of a surface
+		if (glm::dot(texels[index].outward, ray.direction) > 0.0f)
+		{
+			continue;
+		}
+
+		for (size_t l = 0; l < layers.size(); l++)
+		{
+			bounce[l] += hit.albedo * direct[l][index];
+		}
+	}
+
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		bounce[l] /= (float)BOUNCE_SAMPLES;
+	}
+}
+
+void Lightmapper::Denoise(const std::vector<glm::vec3>& source, std::vector<glm::vec3>& result, JobSystem& jobs) const
+{
+	// Bilateral: neighbours in the atlas count only if they are also near in the
+	// world and face the same way, so charts packed side by side don't blur together
+	const float spatialSigma = DENOISE_RADIUS * 0.5f;
+	const float positionSigma = 2.0f / TEXELS_PER_UNIT;
+
+	result.assign(source.size(), glm::vec3(0.0f));
+
+	jobs.ParallelFor(atlasHeight, 4, [&](unsigned int begin, unsigned int end)
+	{
+		for (int y = (int)begin; y < (int)end; y++)
+		{
+			for (int x = 0; x < (int)atlasWidth; x++)
+			{
+				const Texel& centre = texels[y * atlasWidth + x];
+				if (centre.triangle < 0)
+				{
+					continue;
+				}
+
+				glm::vec3 sum(0.0f);
+				float weightSum = 0.0f;
+
+				for (int dy = -DENOISE_RADIUS; dy <= DENOISE_RADIUS; dy++)
+				{
+					for (int dx = -DENOISE_RADIUS; dx <= DENOISE_RADIUS; dx++)
+					{
+						int nx = x + dx, ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= (int)atlasWidth || ny >= (int)atlasHeight)
+						{
+							continue;
+						}
+
+						const Texel& neighbour = texels[ny * atlasWidth + nx];
+						if (neighbour.triangle < 0)
+						{
+							continue;
+						}
+
+						glm::vec3 offset = neighbour.position - centre.position;
+						float facing = std::fabs(glm::dot(neighbour.normal, centre.normal));
+
+						float weight = std::exp(-(dx * dx + dy * dy) / (2.0f * spatialSigma * spatialSigma)) *
+							std::exp(-glm::dot(offset, offset) / (2.0f * positionSigma * positionSigma)) *
+							std::pow(facing, 8.0f);
+
+						sum += source[ny * atlasWidth + nx] * weight;
+						weightSum += weight;
+					}
+				}
+
+				result[y * atlasWidth + x] = weightSum > 0.0f ? sum / weightSum : source[y * atlasWidth + x];
+			}
+		}
+	});
+}
+
+template <typename T>
+void Lightmapper::Dilate(std::vector<T>& values) const
+{
+	// Grows every chart into its padding so bilinear taps at the edges find light, not black
+	std::vector<bool> filled(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		filled[i] = texels[i].triangle >= 0;
+	}
+
+	for (unsigned int step = 0; step < CHART_PADDING; step++)
+	{
+		std::vector<bool> nextFilled = filled;
+
+		for (int y = 0; y < (int)atlasHeight; y++)
+		{
+			for (int x = 0; x < (int)atlasWidth; x++)
+			{
+				unsigned int index = y * atlasWidth + x;
+				if (filled[index])
+				{
+					continue;
+				}
+
+				T sum = T(0.0f);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int nx = x + dx, ny = y + dy;
+						if (nx >= 0 && ny >= 0 && nx < (int)atlasWidth && ny < (int)atlasHeight && filled[ny * atlasWidth + nx])
+						{
+							sum += values[ny * atlasWidth + nx];
+							count++;
+						}
+					}
+				}
+
+				if (count > 0)
+				{
+					values[index] = sum / (float)count;
+					nextFilled[index] = true;
+				}
+			}
+		}
+
+		filled.swap(nextFilled);
+	}
+}
+
+void Lightmapper::PackRects(const std::vector<glm::uvec2>& sizes, std::vector<glm::uvec2>& origins,
+	unsigned int& width, unsigned int& height)
+{
+	origins.assign(sizes.size(), glm::uvec2(0, 0));
+	width = 0;
+	height = 0;
+
+	if (sizes.empty())
+	{
+		return;
+	}
+
+	// Shelves about as wide as a square holding everything
+	unsigned long long area = 0;
+	unsigned int shelfWidth = 0;
+	std::vector<unsigned int> order(sizes.size());
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		area += (unsigned long long)sizes[i].x * sizes[i].y;
+		shelfWidth = std::max(shelfWidth, sizes[i].x);
+		order[i] = (unsigned int)i;
+	}
+	shelfWidth = std::max(shelfWidth, (unsigned int)std::ceil(std::sqrt((double)area)));
+
+	std::sort(order.begin(), order.end(), [&sizes](unsigned int a, unsigned int b)
+	{
+		return sizes[a].y != sizes[b].y ? sizes[a].y > sizes[b].y : a < b;
+	});
+
+	unsigned int x = 0, y = 0, shelfHeight = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const glm::uvec2& size = sizes[order[i]];
+		if (x + size.x > shelfWidth)
+		{
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+
+		origins[order[i]] = glm::uvec2(x, y);
+		x += size.x;
+		shelfHeight = std::max(shelfHeight, size.y);
+		width = std::max(width, x);
+	}
+
+	height = y + shelfHeight;
+}
+
+Light* Lightmapper::FindLight(FrameState& frame, const LightLayer& layer)
+{
+	if (layer.type == LAYER_DIRECTIONAL)
+	{
+		return frame.features.directionalLight && frame.mainLight.GetId() == layer.id ? &frame.mainLight : nullptr;
+	}
+
+	if (layer.type == LAYER_POINT)
+	{
+		for (unsigned int i = 0; i < frame.pointLightCount; i++)
+		{
+			if (frame.pointLights[i].GetId() == layer.id)
+			{
+				return &frame.pointLights[i];
+			}
+		}
+		return nullptr;
+	}
+
+	for (unsigned int i = 0; i < frame.spotLightCount; i++)
+	{
+		if (frame.spotLights[i].GetId() == layer.id)
+		{
+			return &frame.spotLights[i];
+		}
+	}
+	return nullptr;
+}
+
+Lightmapper::~Lightmapper()
+{
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <unordered_map>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "Mesh.h"
+#include "Scene.h"
+#include "BVH.h"
+#include "Shader.h"
+#include "FrameState.h"
+#include "JobSystem.h"
+
+// A mesh with its vertices split along lightmap chart seams, ready for CreateMesh
+struct LightmapMesh
+{
+	std::vector<GLfloat> vertices;		// interleaved position/UV/normal, as for CreateMesh
+	std::vector<GLfloat> lightmapUVs;	// two per vertex, 0-1 over the mesh's own texel area
+	std::vector<unsigned int> indices;
+	unsigned int width, height;			// texels the charts need at the baker's density
+};
+
+// Bakes the static lights into one atlas for every lightmapped mesh object:
+// direct light with soft shadows plus one diffuse bounce, traced against a
+// triangle BVH on all workers, then denoised. Every light gets its own layer,
+// baked white at intensity 1, and a GPU pass sums the layers into the atlas
+// with the lights' current colours and intensities. Objects sample the atlas
+// instead of running the light loop until a light moves.
+class Lightmapper
+{
+public:
+	Lightmapper();
+
+	// The pass that sums the layers; vertexLocation draws a full-screen triangle
+	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation);
+
+	// Splits the mesh into planar charts (triangles grouped by their dominant axis)
+	// and packs them into the mesh's own texel rectangle
+	static void Unwrap(const GLfloat* vertices, const unsigned int* indices, unsigned int numOfVertices,
+		unsigned int numOfIndices, LightmapMesh& unwrapped);
+
+	// Keeps the triangles and chart UVs of a mesh created from an unwrapped LightmapMesh
+	void AddMesh(Mesh* mesh, const LightmapMesh& unwrapped);
+
+	// Places every object whose mesh was added in the atlas (see Scene::SetLightmapRect),
+	// bakes one layer per light in the frame and uploads them
+	bool Bake(Scene& scene, FrameState& frame, JobSystem& jobs);
+
+	// True while every light in the frame has a layer and is where it was baked;
+	// colour and intensity may differ
+	bool Matches(FrameState& frame) const;
+	// Sums the layers into the atlas again if any colour or intensity changed.
+	// False, with the atlas left alone, when the layers don't match (see Matches).
+	bool Relight(FrameState& frame);
+	bool IsBaked() const { return layerTexture != 0; }
+
+	void UseLightmap();
+	void ClearLightmapper();
+
+	~Lightmapper();
+
+private:
+	// Texels per world unit; the room's 20 unit floor alone takes 160 x 160
+	static const unsigned int TEXELS_PER_UNIT = 8;
+	// Empty texels around every chart, filled by dilation so bilinear filtering never mixes charts
+	static const unsigned int CHART_PADDING = 2;
+	static const unsigned int MAX_ATLAS_SIZE = 4096;
+
+	// Directional light first, then the point and spot lights
+	static const unsigned int MAX_LAYERS = 1 + MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS;
+
+	static const unsigned int SHADOW_SAMPLES = 8;
+	static const unsigned int BOUNCE_SAMPLES = 64;
+	static const int DENOISE_RADIUS = 2;
+
+	struct MeshCharts
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> lightmapUVs;
+		std::vector<unsigned int> indices;
+		unsigned int width, height;
+	};
+
+	// World-space triangle with its corners in atlas texels
+	struct BakeTriangle
+	{
+		glm::vec3 positions[3];
+		glm::vec2 texels[3];
+		glm::vec3 normal;
+		glm::vec3 albedo;
+	};
+
+	// One atlas texel's surface sample; normal is the geometric normal, which
+	// either side may face out of (many of the scene's meshes carry no normals)
+	struct Texel
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec3 outward;	// side the light arrives on, 0 until known
+		int triangle;		// -1 - not covered
+		int coverage;		// 2 - centre inside the triangle, 1 - only touching it
+	};
+
+	enum LayerType
+	{
+		LAYER_DIRECTIONAL,
+		LAYER_POINT,
+		LAYER_SPOT
+	};
+
+	// rgb - diffuse plus bounce, a - ambient, for a white light of intensity 1
+	struct LightLayer
+	{
+		unsigned int id;
+		unsigned int placementVersion;
+		int type;
+		unsigned int index;		// into the frame's light arrays while baking
+		unsigned int version;	// what was last summed into the atlas, with present
+		bool present;
+	};
+
+	std::unordered_map<const Mesh*, MeshCharts> meshCharts;
+
+	Shader combineShader;
+	GLuint layerTexture, atlasTexture, atlasFBO, emptyVAO;
+	unsigned int atlasWidth, atlasHeight;
+	std::vector<LightLayer> layers;
+	bool combined;
+
+	std::vector<BakeTriangle> triangles;
+	BVH triangleBVH;
+	std::vector<Texel> texels;
+
+	bool Occluded(const glm::vec3& origin, const glm::vec3& target) const;
+	bool TraceTriangle(const Ray& ray, float maxDistance, unsigned int& triangle, float& distance, glm::vec2& barycentric) const;
+
+	void RasteriseTriangle(unsigned int triangleIndex);
+	float DirectLight(const glm::vec3& position, const glm::vec3& normal, FrameState& frame, const LightLayer& layer, unsigned int& seed) const;
+	float AmbientLight(const glm::vec3& position, FrameState& frame, const LightLayer& layer) const;
+	// Writes one value per layer into bounce
+	void BounceLight(const Texel& texel, const glm::vec3& normal, const std::vector<std::vector<float>>& direct,
+		unsigned int& seed, glm::vec3* bounce) const;
+	void Denoise(const std::vector<glm::vec3>& source, std::vector<glm::vec3>& result, JobSystem& jobs) const;
+	template <typename T>
+	void Dilate(std::vector<T>& values) const;
+
+	// Shelf packing, tallest first; origins line up with sizes
+	static void PackRects(const std::vector<glm::uvec2>& sizes, std::vector<glm::uvec2>& origins,
+		unsigned int& width, unsigned int& height);
+	// The frame's light a layer was baked from, nullptr if it is off now
+	static Light* FindLight(FrameState& frame, const LightLayer& layer);
+};
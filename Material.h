@@ -10,6 +10,10 @@ public:
 
 	void UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation);
 
+	bool HasSpecular() { return specularIntensity > 0.0f; }
+	GLfloat GetSpecularIntensity() { return specularIntensity; }
+	GLfloat GetShininess() { return shininess; }
+
 	~Material();
 
 private: 
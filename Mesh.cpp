@@ -1,17 +1,51 @@
 #include "Mesh.h"
 
+#include <string.h>
+#include <unordered_map>
+
 Mesh::Mesh()
 {
 	VAO = 0;
 	VBO = 0;
 	IBO = 0;
 	indexCount = 0;
+
+	lightmapVBO = 0;
+
+	depthVAO = 0;
+	positionVBO = 0;
+	positionIBO = 0;
+	positionIndexCount = 0;
 }
 
-void Mesh::CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices)
+void Mesh::CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices,
+	bool keepPositions, const PositionStream* positionStream, const GLfloat* lightmapUVs)
 {
 	indexCount = numOfIndices;
 
+	bounds = AABB();
+	for (unsigned int i = 0; i + 2 < numOfVertices; i += 8)
+	{
+		bounds.Grow(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+	}
+
+	PositionStream builtStream;
+	if (!positionStream)
+	{
+		BuildPositionStream(vertices, indices, numOfVertices, numOfIndices, builtStream);
+		positionStream = &builtStream;
+	}
+
+	if (keepPositions)
+	{
+		positions.clear();
+		for (size_t i = 0; i + 2 < positionStream->positions.size(); i += 3)
+		{
+			positions.push_back(glm::vec3(positionStream->positions[i], positionStream->positions[i + 1], positionStream->positions[i + 2]));
+		}
+		cpuIndices = positionStream->indices;
+	}
+
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
 
@@ -30,10 +64,102 @@ void Mesh::CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int num
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 5));
 	glEnableVertexAttribArray(2);
 
+	if (lightmapUVs)
+	{
+		glGenBuffers(1, &lightmapVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, lightmapVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * (numOfVertices / 8) * 2, lightmapUVs, GL_STATIC_DRAW);
+
+		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 2, 0);
+		glEnableVertexAttribArray(3);
+	}
+
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	glBindVertexArray(0);
+
+	// Lean VAO: attribute 0 only, so depth.vert and shadow shaders fetch just positions
+	positionIndexCount = (GLsizei)positionStream->indices.size();
+	if (positionIndexCount == 0)
+	{
+		return;
+	}
+
+	glGenVertexArrays(1, &depthVAO);
+	glBindVertexArray(depthVAO);
+
+	glGenBuffers(1, &positionIBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, positionIBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * positionStream->indices.size(), &positionStream->indices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &positionVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * positionStream->positions.size(), &positionStream->positions[0], GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	glBindVertexArray(0);
+}
+
+void Mesh::BuildPositionStream(const GLfloat* vertices, const unsigned int* indices, unsigned int numOfVertices,
+	unsigned int numOfIndices, PositionStream& stream)
+{
+	struct PositionKey
+	{
+		unsigned int bits[3];
+		bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			return (size_t)(key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u);
+		}
+	};
+
+	unsigned int vertexCount = numOfVertices / 8;
+
+	stream.positions.clear();
+	stream.indices.clear();
+	stream.positions.reserve(vertexCount * 3);
+	stream.indices.reserve(numOfIndices);
+
+	// Interleaved vertex -> welded position index
+	std::vector<unsigned int> remap(vertexCount);
+	std::unordered_map<PositionKey, unsigned int, PositionKeyHash> welded;
+	welded.reserve(vertexCount);
+
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		const GLfloat* position = &vertices[i * 8];
+
+		// Weld on exact bit patterns, with -0 folded into 0
+		PositionKey key;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			GLfloat value = position[axis] == 0.0f ? 0.0f : position[axis];
+			memcpy(&key.bits[axis], &value, sizeof(value));
+		}
+
+		std::pair<std::unordered_map<PositionKey, unsigned int, PositionKeyHash>::iterator, bool> inserted =
+			welded.insert(std::make_pair(key, (unsigned int)(stream.positions.size() / 3)));
+		if (inserted.second)
+		{
+			stream.positions.insert(stream.positions.end(), position, position + 3);
+		}
+		remap[i] = inserted.first->second;
+	}
+
+	for (unsigned int i = 0; i < numOfIndices; i++)
+	{
+		stream.indices.push_back(indices[i] < vertexCount ? remap[indices[i]] : 0);
+	}
 }
 
 void Mesh::RenderMesh()
@@ -45,6 +171,21 @@ void Mesh::RenderMesh()
 	glBindVertexArray(0);
 }
 
+void Mesh::RenderDepth()
+{
+	if (depthVAO == 0)
+	{
+		RenderMesh();
+		return;
+	}
+
+	glBindVertexArray(depthVAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, positionIBO);
+	glDrawElements(GL_TRIANGLES, positionIndexCount, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
 void Mesh::ClearMesh()
 {
 	if (IBO != 0)
@@ -59,13 +200,41 @@ void Mesh::ClearMesh()
 		VBO = 0;
 	}
 
+	if (lightmapVBO != 0)
+	{
+		glDeleteBuffers(1, &lightmapVBO);
+		lightmapVBO = 0;
+	}
+
 	if (VAO != 0)
 	{
 		glDeleteVertexArrays(1, &VAO);
 		VAO = 0;
 	}
 
+	if (positionIBO != 0)
+	{
+		glDeleteBuffers(1, &positionIBO);
+		positionIBO = 0;
+	}
+
+	if (positionVBO != 0)
+	{
+		glDeleteBuffers(1, &positionVBO);
+		positionVBO = 0;
+	}
+
+	if (depthVAO != 0)
+	{
+		glDeleteVertexArrays(1, &depthVAO);
+		depthVAO = 0;
+	}
+
 	indexCount = 0;
+	positionIndexCount = 0;
+	bounds = AABB();
+	positions.clear();
+	cpuIndices.clear();
 }
 
 
@@ -1,20 +1,59 @@
 #pragma once
 
+#include <vector>
+
 #include <GL\glew.h>
 
+#include "Bounds.h"
+
+// Positions alone (xyz, tightly packed) with indices welded on position, so
+// vertices split only by UV or normal seams are shared again
+struct PositionStream
+{
+	std::vector<GLfloat> positions;
+	std::vector<unsigned int> indices;
+};
+
 class Mesh
 {
 public:
 	Mesh();
 
-	void CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices);
+	// keepPositions holds on to a CPU copy of the welded positions and indices (e.g. for occluders).
+	// positionStream can be built ahead of time with BuildPositionStream, otherwise it is built here.
+	// lightmapUVs, two per vertex, become attribute 3 (see Lightmapper::Unwrap).
+	void CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices,
+		bool keepPositions = false, const PositionStream* positionStream = nullptr, const GLfloat* lightmapUVs = nullptr);
 	void RenderMesh();
+	// Position-only draw for depth and shadow passes: 12 bytes a vertex instead of 32
+	void RenderDepth();
 	void ClearMesh();
 
+	// vertices are interleaved position/UV/normal as for CreateMesh; touches no GL state
+	static void BuildPositionStream(const GLfloat* vertices, const unsigned int* indices, unsigned int numOfVertices,
+		unsigned int numOfIndices, PositionStream& stream);
+
+	// Object-space bounds of the vertex positions
+	const AABB& GetBounds() const { return bounds; }
+
+	const std::vector<glm::vec3>& GetPositions() const { return positions; }
+	const std::vector<unsigned int>& GetIndices() const { return cpuIndices; }
+
+	bool HasLightmapUVs() const { return lightmapVBO != 0; }
+
 	~Mesh();
 
 private:
 	GLuint VAO, VBO, IBO;
 	GLsizei indexCount;
+
+	GLuint lightmapVBO;
+
+	GLuint depthVAO, positionVBO, positionIBO;
+	GLsizei positionIndexCount;
+	AABB bounds;
+
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned int> cpuIndices;
 };
 
@@ -19,20 +19,66 @@ void Model::RenderModel()
 	}
 }
 
+void Model::RenderDepth()
+{
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		meshList[i]->RenderDepth();
+	}
+}
+
 void Model::LoadModel(const std::string & fileName)
+{
+	if (ReadModel(fileName))
+	{
+		UploadModel();
+	}
+}
+
+bool Model::ReadModel(const std::string & fileName)
 {
 	Assimp::Importer importer;
 	const aiScene *scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
 
 	if (!scene)
 	{
-		printf("Model (%s) failed to load: %s", fileName, importer.GetErrorString());
-		return;
+		printf("Model (%s) failed to load: %s", fileName.c_str(), importer.GetErrorString());
+		return false;
 	}
 
 	LoadNode(scene->mRootNode, scene);
 
 	LoadMaterials(scene);
+
+	return true;
+}
+
+void Model::UploadModel()
+{
+	for (size_t i = 0; i < pendingMeshes.size(); i++)
+	{
+		MeshData& data = pendingMeshes[i];
+
+		Mesh* newMesh = new Mesh();
+		newMesh->CreateMesh(&data.vertices[0], &data.indices[0], data.vertices.size(), data.indices.size(), false, &data.positionStream);
+		meshList.push_back(newMesh);
+		meshToTex.push_back(data.materialIndex);
+
+		bounds.Grow(newMesh->GetBounds());
+	}
+	pendingMeshes.clear();
+
+	for (size_t i = 0; i < textureList.size(); i++)
+	{
+		if (textureHasAlpha[i])
+		{
+			textureList[i]->UploadTextureA();
+		}
+		else
+		{
+			textureList[i]->UploadTexture();
+		}
+	}
 }
 
 void Model::LoadNode(aiNode * node, const aiScene * scene)
@@ -50,8 +96,10 @@ void Model::LoadNode(aiNode * node, const aiScene * scene)
 
 void Model::LoadMesh(aiMesh * mesh, const aiScene * scene)
 {
-	std::vector<GLfloat> vertices;
-	std::vector<unsigned int> indices;
+	pendingMeshes.push_back(MeshData());
+	std::vector<GLfloat>& vertices = pendingMeshes.back().vertices;
+	std::vector<unsigned int>& indices = pendingMeshes.back().indices;
+	pendingMeshes.back().materialIndex = mesh->mMaterialIndex;
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++)
 	{
@@ -75,22 +123,23 @@ void Model::LoadMesh(aiMesh * mesh, const aiScene * scene)
 		}
 	}
 
-	Mesh* newMesh = new Mesh();
-	newMesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
-	meshList.push_back(newMesh);
-	meshToTex.push_back(mesh->mMaterialIndex);
+	// Welded here so it runs on the loading worker, not the GL thread
+	if (!vertices.empty() && !indices.empty())
+	{
+		Mesh::BuildPositionStream(&vertices[0], &indices[0], (unsigned int)vertices.size(), (unsigned int)indices.size(),
+			pendingMeshes.back().positionStream);
+	}
 }
 
 void Model::LoadMaterials(const aiScene * scene)
 {
-	textureList.resize(scene->mNumMaterials);
+	// Textures keep a pointer to their path, so every path is in place before any texture is made
+	texturePaths.resize(scene->mNumMaterials);
 	
 	for (size_t i = 0; i < scene->mNumMaterials; i++)
 	{
 		aiMaterial* material = scene->mMaterials[i];
 
-		textureList[i] = nullptr;
-
 		if (material->GetTextureCount(aiTextureType_DIFFUSE))
 		{
 			aiString path;
@@ -99,23 +148,36 @@ void Model::LoadMaterials(const aiScene * scene)
 				int idx = std::string(path.data).rfind("\\");
 				std::string filename = std::string(path.data).substr(idx + 1);
 
-				std::string texPath = std::string("Textures/") + filename;
+				texturePaths[i] = std::string("Textures/") + filename;
+			}
+		}
+	}
+
+	textureList.resize(scene->mNumMaterials);
+	textureHasAlpha.resize(scene->mNumMaterials);
 
-				textureList[i] = new Texture(texPath.c_str());
+	for (size_t i = 0; i < scene->mNumMaterials; i++)
+	{
+		textureList[i] = nullptr;
+
+		if (!texturePaths[i].empty())
+		{
+			textureList[i] = new Texture(texturePaths[i].c_str());
+			textureHasAlpha[i] = false;
 
-				if (!textureList[i]->LoadTexture())
-				{
-					printf("Failed to load texture at: %s\n", texPath);
-					delete textureList[i];
-					textureList[i] = nullptr;
-				}
+			if (!textureList[i]->DecodeTexture())
+			{
+				printf("Failed to load texture at: %s\n", texturePaths[i].c_str());
+				delete textureList[i];
+				textureList[i] = nullptr;
 			}
 		}
 
 		if (!textureList[i])
 		{
 			textureList[i] = new Texture("Textures/plain.png");
-			textureList[i]->LoadTextureA();
+			textureList[i]->DecodeTexture();
+			textureHasAlpha[i] = true;
 		}
 	}
 }
@@ -139,6 +201,8 @@ void Model::ClearModel()
 			textureList[i] = nullptr;
 		}
 	}
+
+	bounds = AABB();
 }
 
 Model::~Model()
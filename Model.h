@@ -16,12 +16,31 @@ public:
 	Model();
 
 	void LoadModel(const std::string& fileName);
+
+	// LoadModel in two halves: ReadModel imports the file and decodes its textures
+	// without touching GL, so it can run on a worker; UploadModel creates the meshes
+	// and textures on the GL thread
+	bool ReadModel(const std::string& fileName);
+	void UploadModel();
+
 	void RenderModel();
+	// Geometry only, for depth passes: no textures are bound
+	void RenderDepth();
 	void ClearModel();
 
+	// Union of the mesh bounds, valid after UploadModel
+	const AABB& GetBounds() const { return bounds; }
+
 	~Model();
 
 private:
+	struct MeshData
+	{
+		std::vector<GLfloat> vertices;
+		std::vector<unsigned int> indices;
+		PositionStream positionStream;
+		unsigned int materialIndex;
+	};
 
 	void LoadNode(aiNode *node, const aiScene *scene);
 	void LoadMesh(aiMesh *mesh, const aiScene *scene);
@@ -30,5 +49,11 @@ private:
 	std::vector<Mesh*> meshList;
 	std::vector<Texture*> textureList;
 	std::vector<unsigned int> meshToTex;
+
+	std::vector<MeshData> pendingMeshes;
+	std::vector<std::string> texturePaths;
+	std::vector<bool> textureHasAlpha;
+
+	AABB bounds;
 };
 
@@ -0,0 +1,338 @@
+#include "OcclusionCuller.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+// Clip-space w below which a point counts as behind the eye
+static const float NEAR_W = 1e-4f;
+
+OcclusionCuller::OcclusionCuller()
+{
+	depth.assign(BUFFER_WIDTH * BUFFER_HEIGHT, 1.0f);
+	viewProjection = glm::mat4(1.0f);
+	rendered = false;
+	culledCount = 0;
+}
+
+void OcclusionCuller::AddOccluder(const Mesh& mesh, const glm::mat4& transform)
+{
+	const std::vector<glm::vec3>& positions = mesh.GetPositions();
+	const std::vector<unsigned int>& indices = mesh.GetIndices();
+
+	if (indices.empty())
+	{
+		printf("Occluder mesh has no CPU positions, create it with keepPositions.\n");
+		return;
+	}
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		Triangle triangle;
+		for (int v = 0; v < 3; v++)
+		{
+			triangle.vertices[v] = glm::vec3(transform * glm::vec4(positions[indices[i + v]], 1.0f));
+		}
+		occluderTriangles.push_back(triangle);
+	}
+}
+
+void OcclusionCuller::Render(const glm::mat4& viewProjection, JobSystem& jobs)
+{
+	this->viewProjection = viewProjection;
+	rendered = !occluderTriangles.empty();
+	if (!rendered)
+	{
+		return;
+	}
+
+	// Near clipping turns a triangle into at most two
+	screenTriangles.resize(occluderTriangles.size() * 2);
+
+	jobs.ParallelFor((unsigned int)occluderTriangles.size(), 64, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			SetupTriangle(i);
+		}
+	});
+
+	// Tiles own disjoint parts of the buffer, so they rasterize without any locking
+	jobs.ParallelFor(TILES_X * TILES_Y, 1, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int tile = begin; tile < end; tile++)
+		{
+			RasterizeTile(tile);
+		}
+	});
+}
+
+glm::vec3 OcclusionCuller::ToScreen(const glm::vec4& clip) const
+{
+	float inverseW = 1.0f / clip.w;
+	return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * BUFFER_WIDTH,
+		(clip.y * inverseW * 0.5f + 0.5f) * BUFFER_HEIGHT,
+		clip.z * inverseW * 0.5f + 0.5f);
+}
+
+void OcclusionCuller::SetupTriangle(unsigned int triangle)
+{
+	ScreenTriangle* output = &screenTriangles[triangle * 2];
+	output[0].valid = false;
+	output[1].valid = false;
+
+	glm::vec4 clip[3];
+	for (int v = 0; v < 3; v++)
+	{
+		clip[v] = viewProjection * glm::vec4(occluderTriangles[triangle].vertices[v], 1.0f);
+	}
+
+	// Entirely outside one of the side planes
+	if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+		(clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+		(clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+		(clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w))
+	{
+		return;
+	}
+
+	// Clip against the near plane (z = -w), which keeps w positive
+	glm::vec4 polygon[4];
+	int polygonSize = 0;
+	for (int v = 0; v < 3; v++)
+	{
+		const glm::vec4& a = clip[v];
+		const glm::vec4& b = clip[(v + 1) % 3];
+		float distanceA = a.z + a.w;
+		float distanceB = b.z + b.w;
+
+		if (distanceA >= 0.0f)
+		{
+			polygon[polygonSize++] = a;
+		}
+		if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+		{
+			float t = distanceA / (distanceA - distanceB);
+			polygon[polygonSize++] = a + (b - a) * t;
+		}
+	}
+
+	for (int i = 0; i + 2 < polygonSize; i++)
+	{
+		if (polygon[0].w < NEAR_W || polygon[i + 1].w < NEAR_W || polygon[i + 2].w < NEAR_W)
+		{
+			continue;
+		}
+
+		ScreenTriangle& screen = output[i];
+		screen.vertices[0] = ToScreen(polygon[0]);
+		screen.vertices[1] = ToScreen(polygon[i + 1]);
+		screen.vertices[2] = ToScreen(polygon[i + 2]);
+
+		screen.minX = std::min(screen.vertices[0].x, std::min(screen.vertices[1].x, screen.vertices[2].x));
+		screen.minY = std::min(screen.vertices[0].y, std::min(screen.vertices[1].y, screen.vertices[2].y));
+		screen.maxX = std::max(screen.vertices[0].x, std::max(screen.vertices[1].x, screen.vertices[2].x));
+		screen.maxY = std::max(screen.vertices[0].y, std::max(screen.vertices[1].y, screen.vertices[2].y));
+		screen.valid = true;
+	}
+}
+
+void OcclusionCuller::RasterizeTile(unsigned int tile)
+{
+	int tileX0 = (tile % TILES_X) * TILE_WIDTH;
+	int tileY0 = (tile / TILES_X) * TILE_HEIGHT;
+	int tileX1 = tileX0 + TILE_WIDTH;
+	int tileY1 = tileY0 + TILE_HEIGHT;
+
+	for (int y = tileY0; y < tileY1; y++)
+	{
+		std::fill(&depth[y * BUFFER_WIDTH + tileX0], &depth[y * BUFFER_WIDTH + tileX1], 1.0f);
+	}
+
+	for (size_t i = 0; i < screenTriangles.size(); i++)
+	{
+		const ScreenTriangle& triangle = screenTriangles[i];
+		if (!triangle.valid || triangle.maxX < tileX0 || triangle.minX >= tileX1 ||
+			triangle.maxY < tileY0 || triangle.minY >= tileY1)
+		{
+			continue;
+		}
+
+		RasterizeTriangle(triangle, tileX0, tileY0, tileX1, tileY1);
+	}
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1)
+{
+	glm::vec3 v0 = triangle.vertices[0];
+	glm::vec3 v1 = triangle.vertices[1];
+	glm::vec3 v2 = triangle.vertices[2];
+
+	// Occluders are drawn from both sides; wind everything counter-clockwise
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+	if (area < 0.0f)
+	{
+		std::swap(v1, v2);
+		area = -area;
+	}
+	if (area < 1e-6f)
+	{
+		return;
+	}
+
+	// Edge functions E = A * x + B * y + C, positive inside
+	glm::vec3 edgeA(v0.y - v1.y, v1.y - v2.y, v2.y - v0.y);
+	glm::vec3 edgeB(v1.x - v0.x, v2.x - v1.x, v0.x - v2.x);
+	glm::vec3 edgeC(-(edgeA.x * v0.x + edgeB.x * v0.y), -(edgeA.y * v1.x + edgeB.y * v1.y), -(edgeA.z * v2.x + edgeB.z * v2.y));
+
+	// Depth is linear in screen space
+	float depthDX = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+	float depthDY = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+	float depthC = v0.z - depthDX * v0.x - depthDY * v0.y;
+
+	// Clamped as floats first; vertices close to the near plane land far off screen
+	int minX = (int)std::max((float)tileX0, floorf(triangle.minX)) & ~3;
+	int maxX = (int)std::min((float)(tileX1 - 1), ceilf(triangle.maxX));
+	int minY = (int)std::max((float)tileY0, floorf(triangle.minY));
+	int maxY = (int)std::min((float)(tileY1 - 1), ceilf(triangle.maxY));
+
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 a0 = _mm_set1_ps(edgeA.x), a1 = _mm_set1_ps(edgeA.y), a2 = _mm_set1_ps(edgeA.z);
+	const __m128 depthStepX = _mm_set1_ps(depthDX);
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float pixelY = y + 0.5f;
+		__m128 rowE0 = _mm_set1_ps(edgeB.x * pixelY + edgeC.x);
+		__m128 rowE1 = _mm_set1_ps(edgeB.y * pixelY + edgeC.y);
+		__m128 rowE2 = _mm_set1_ps(edgeB.z * pixelY + edgeC.z);
+		__m128 rowDepth = _mm_set1_ps(depthDY * pixelY + depthC);
+
+		float* row = &depth[y * BUFFER_WIDTH];
+
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, pixelX), rowE0);
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, pixelX), rowE1);
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, pixelX), rowE2);
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+
+			if (_mm_movemask_ps(inside) == 0)
+			{
+				continue;
+			}
+
+			__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthStepX, pixelX), rowDepth);
+			__m128 stored = _mm_loadu_ps(row + x);
+			__m128 nearer = _mm_min_ps(stored, pixelDepth);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const AABB& box) const
+{
+	if (!rendered || box.IsEmpty())
+	{
+		return true;
+	}
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearestDepth = FLT_MAX;
+
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+		// Reaches past the near plane: the camera is in or right at the box
+		if (clip.w < NEAR_W || clip.z < -clip.w)
+		{
+			return true;
+		}
+
+		glm::vec3 screen = ToScreen(clip);
+		minX = std::min(minX, screen.x);
+		minY = std::min(minY, screen.y);
+		maxX = std::max(maxX, screen.x);
+		maxY = std::max(maxY, screen.y);
+		nearestDepth = std::min(nearestDepth, screen.z);
+	}
+
+	// Nothing is known about the part of a box off the buffer, so a box that crosses
+	// an edge could be seen there once the late latch turns the view; keep it
+	if (minX < 0.0f || minY < 0.0f || maxX > BUFFER_WIDTH || maxY > BUFFER_HEIGHT)
+	{
+		return true;
+	}
+
+	// One extra pixel around the box makes up for occluders being sampled at pixel centres
+	int x0 = (int)std::max(0.0f, floorf(minX) - 1.0f) & ~3;
+	int x1 = (int)std::min((float)(BUFFER_WIDTH - 1), ceilf(maxX) + 1.0f);
+	int y0 = (int)std::max(0.0f, floorf(minY) - 1.0f);
+	int y1 = (int)std::min((float)(BUFFER_HEIGHT - 1), ceilf(maxY) + 1.0f);
+
+	__m128 boxDepth = _mm_set1_ps(nearestDepth);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		const float* row = &depth[y * BUFFER_WIDTH];
+		for (int x = x0; x <= x1; x += 4)
+		{
+			// Any occluder pixel at or behind the box's nearest point lets it through
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void OcclusionCuller::Cull(const Scene& scene, std::vector<unsigned int>& objects, JobSystem& jobs)
+{
+	culledCount = 0;
+	if (!rendered || objects.empty())
+	{
+		return;
+	}
+
+	objectVisible.resize(objects.size());
+
+	jobs.ParallelFor((unsigned int)objects.size(), 64, [this, &scene, &objects](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			objectVisible[i] = IsVisible(scene.GetObjectBounds(objects[i])) ? 1 : 0;
+		}
+	});
+
+	size_t kept = 0;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (objectVisible[i])
+		{
+			objects[kept++] = objects[i];
+		}
+	}
+
+	culledCount = (unsigned int)(objects.size() - kept);
+	objects.resize(kept);
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	occluderTriangles.clear();
+	screenTriangles.clear();
+	rendered = false;
+	culledCount = 0;
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
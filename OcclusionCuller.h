@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+#include "Bounds.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "JobSystem.h"
+
+// Software occlusion culling. A few large occluders are rasterized into a small
+// depth buffer on the CPU, tile by tile on the job system, and object bounds are
+// tested against it before the draws are recorded. Both steps use SSE, four
+// pixels at a time.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	// Occluders are static: their triangles are taken to world space once here.
+	// The mesh must have been created with keepPositions.
+	void AddOccluder(const Mesh& mesh, const glm::mat4& transform);
+	unsigned int GetOccluderTriangleCount() const { return (unsigned int)occluderTriangles.size(); }
+
+	void Render(const glm::mat4& viewProjection, JobSystem& jobs);
+
+	// Conservative: true unless the whole box is behind the occluders
+	bool IsVisible(const AABB& box) const;
+
+	// Removes the objects hidden behind the occluders from the list, keeping its order
+	void Cull(const Scene& scene, std::vector<unsigned int>& objects, JobSystem& jobs);
+	unsigned int GetCulledCount() const { return culledCount; }
+
+	void ClearOccluders();
+
+	~OcclusionCuller();
+
+private:
+	static const int BUFFER_WIDTH = 320;
+	static const int BUFFER_HEIGHT = 192;
+	static const int TILE_WIDTH = 64;
+	static const int TILE_HEIGHT = 32;
+	static const int TILES_X = BUFFER_WIDTH / TILE_WIDTH;
+	static const int TILES_Y = BUFFER_HEIGHT / TILE_HEIGHT;
+
+	struct Triangle
+	{
+		glm::vec3 vertices[3];
+	};
+
+	// Near-clipped triangle in buffer pixels, depth in [0, 1]
+	struct ScreenTriangle
+	{
+		glm::vec3 vertices[3];
+		float minX, minY, maxX, maxY;
+		bool valid;
+	};
+
+	std::vector<Triangle> occluderTriangles;
+	std::vector<ScreenTriangle> screenTriangles;
+	std::vector<float> depth;
+	std::vector<unsigned char> objectVisible;
+
+	glm::mat4 viewProjection;
+	bool rendered;
+	unsigned int culledCount;
+
+	void SetupTriangle(unsigned int triangle);
+	void RasterizeTile(unsigned int tile);
+	void RasterizeTriangle(const ScreenTriangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1);
+
+	glm::vec3 ToScreen(const glm::vec4& clip) const;
+};
+
@@ -1,5 +1,7 @@
 #include "PointLight.h"
 
+#include <float.h>
+
 
 
 PointLight::PointLight() : Light()
@@ -35,6 +37,45 @@ void PointLight::UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColou
 	glUniform1f(exponentLocation, exponent);
 }
 
+GLfloat PointLight::GetRange()
+{
+	GLfloat brightest = glm::max(colour.r, glm::max(colour.g, colour.b)) * (ambientIntensity + diffuseIntensity);
+	if (brightest <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	// Solve exponent * d^2 + linear * d + constant = brightest * 256
+	GLfloat target = brightest * 256.0f - constant;
+	if (target <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	if (exponent > 0.0f)
+	{
+		return (-linear + sqrtf(linear * linear + 4.0f * exponent * target)) / (2.0f * exponent);
+	}
+
+	if (linear > 0.0f)
+	{
+		return target / linear;
+	}
+
+	return FLT_MAX;
+}
+
+AABB PointLight::GetBounds()
+{
+	GLfloat range = GetRange();
+	if (range == FLT_MAX)
+	{
+		return AABB(glm::vec3(-FLT_MAX), glm::vec3(FLT_MAX));
+	}
+
+	return AABB(position - glm::vec3(range), position + glm::vec3(range));
+}
+
 PointLight::~PointLight()
 {
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Light.h"
+#include "Bounds.h"
 #include "Window.h"
 
 class PointLight :
@@ -20,51 +21,68 @@ public:
 		if (keys[GLFW_KEY_R] && keys[GLFW_KEY_EQUAL]) {
 			if (colour.r <= 1.0f) {
 				colour.r += 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_R] && keys[GLFW_KEY_MINUS]) {
 			if (colour.r >= 0.0f) {
 				colour.r -= 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_G] && keys[GLFW_KEY_EQUAL]) {
 			if (colour.g <= 1.0f) {
 				colour.g += 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_G] && keys[GLFW_KEY_MINUS]) {
 			if (colour.g >= 0.0f) {
 				colour.g -= 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_B] && keys[GLFW_KEY_EQUAL]) {
 			if (colour.b <= 1.0f) {
 				colour.b += 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_B] && keys[GLFW_KEY_MINUS]) {
 			if (colour.b >= 0.0f) {
 				colour.b -= 0.01;
+				MarkChanged();
 			}
 		}
 	};
 
 	void TurnOffPointLight(bool* keys) {
 		static GLfloat bufferPoint = this->ambientIntensity;
-		if (keys[GLFW_KEY_Y]) {
+		if (keys[GLFW_KEY_Y] && this->ambientIntensity != bufferPoint) {
 			this->ambientIntensity = bufferPoint;
+			MarkChanged();
 		}
 
-		if (keys[GLFW_KEY_N]) {
+		if (keys[GLFW_KEY_N] && this->ambientIntensity != 0) {
 			this->ambientIntensity = 0;
+			MarkChanged();
 		}
 	}
 
-	void ControlPointLight(bool* keys, PointLight& pointlight, GLfloat deltaTime, Window& window) {
-		pointlight.TurnOffPointLight(window.getsKeys());
-		pointlight.TurnPointLight(deltaTime, window.getsKeys());
+	void ControlPointLight(bool* keys, PointLight& pointlight, GLfloat deltaTime) {
+		pointlight.TurnOffPointLight(keys);
+		pointlight.TurnPointLight(deltaTime, keys);
 	};
 
+	glm::vec3 GetPosition() { return position; }
+	// constant, linear, exponent
+	glm::vec3 GetAttenuation() { return glm::vec3(constant, linear, exponent); }
+
+	// Distance at which the light's contribution falls below 1/256, FLT_MAX if it never does
+	GLfloat GetRange();
+	// World box the light can reach; unbounded when the range is FLT_MAX
+	AABB GetBounds();
+
 	~PointLight();
 
 protected:
@@ -0,0 +1,367 @@
+#include "PointShadowMaps.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\type_ptr.hpp>
+
+// Far plane of a point light's map, for lights whose range never ends
+static const float MAX_SHADOW_RANGE = 30.0f;
+static const float SHADOW_NEAR_PLANE = 0.05f;
+
+static constexpr unsigned int MODEL = UniformHash("model");
+static constexpr unsigned int FACE_TRANSFORMS = UniformHash("faceTransforms[]");
+static constexpr unsigned int FACE_MASK = UniformHash("faceMask");
+static constexpr unsigned int LIGHT_POSITION = UniformHash("lightPosition");
+static constexpr unsigned int FAR_PLANE = UniformHash("farPlane");
+static constexpr unsigned int POINT_SHADOW_MAPS = UniformHash("pointShadowMaps[]");
+static constexpr unsigned int POINT_SHADOW_FAR_PLANES = UniformHash("pointShadowFarPlanes[]");
+
+PointShadowMaps::PointShadowMaps()
+{
+	FBO = 0;
+	size = 0;
+	enabled = false;
+
+	staleMaps = 0;
+	mapsRendered = 0;
+	casterCount = 0;
+	frameLightCount = 0;
+
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		maps[m].lightId = 0;
+		maps[m].frameIndex = -1;
+		maps[m].texture = 0;
+		maps[m].drawn = false;
+		maps[m].stale = false;
+		maps[m].farPlane = 0.0f;
+	}
+}
+
+void PointShadowMaps::CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation, GLsizei size)
+{
+	this->size = size;
+	enabled = true;
+
+	shader.CreateFromFiles(vertexLocation, geometryLocation, fragmentLocation, "");
+}
+
+bool PointShadowMaps::CreateTargets()
+{
+	if (FBO != 0)
+	{
+		return true;
+	}
+
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		glGenTextures(1, &maps[m].texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, maps[m].texture);
+		for (unsigned int face = 0; face < FACE_COUNT; face++)
+		{
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+		}
+		// Read through a comparison sampler: each lookup is a filtered 2x2 PCF
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	// Filters across face edges instead of clamping at them; these are the only cube maps
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	// Layered attachment: gl_Layer in pointshadow.geom picks the face. Each map is
+	// attached in turn when it is drawn.
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps[0].texture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Point shadow map framebuffer error: 0x%x\n", status);
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+		for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+		{
+			glDeleteTextures(1, &maps[m].texture);
+			maps[m].texture = 0;
+		}
+		// No point shadows from now on, rather than retrying every frame
+		enabled = false;
+		return false;
+	}
+
+	return true;
+}
+
+bool PointShadowMaps::Update(FrameState& frame, const std::vector<unsigned int>& movedObjects, const BVH& bvh)
+{
+	frameLightCount = frame.pointLightCount;
+	staleMaps = 0;
+	if (!enabled || !CreateTargets())
+	{
+		return false;
+	}
+
+	// Maps of lights that went off are free for others
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		CubeMap& map = maps[m];
+		map.frameIndex = -1;
+
+		bool kept = false;
+		for (unsigned int i = 0; i < frame.pointLightCount && !kept; i++)
+		{
+			kept = frame.pointLights[i].GetId() == map.lightId;
+		}
+
+		if (map.lightId != 0 && !kept)
+		{
+			map.lightId = 0;
+			map.drawn = false;
+			map.casters.clear();
+		}
+	}
+
+	for (unsigned int i = 0; i < frame.pointLightCount; i++)
+	{
+		PointLight& light = frame.pointLights[i];
+		GLfloat range = std::min(light.GetRange(), MAX_SHADOW_RANGE);
+		if (range <= SHADOW_NEAR_PLANE)
+		{
+			continue;
+		}
+
+		CubeMap* map = nullptr;
+		for (unsigned int m = 0; m < MAX_POINT_LIGHTS && !map; m++)
+		{
+			map = maps[m].lightId == light.GetId() ? &maps[m] : nullptr;
+		}
+		for (unsigned int m = 0; m < MAX_POINT_LIGHTS && !map; m++)
+		{
+			map = maps[m].lightId == 0 ? &maps[m] : nullptr;
+		}
+
+		if (map->lightId == 0)
+		{
+			map->lightId = light.GetId();
+			map->placementVersion = light.GetPlacementVersion();
+			map->drawn = false;
+			map->stale = true;
+		}
+
+		// Colour and intensity edits don't change the map, unless they change how far it reaches
+		if (map->placementVersion != light.GetPlacementVersion() || map->farPlane != range)
+		{
+			map->placementVersion = light.GetPlacementVersion();
+			map->stale = true;
+		}
+
+		map->frameIndex = (int)i;
+		map->position = light.GetPosition();
+		map->farPlane = range;
+	}
+
+	// A caster that moved may have left the map as well as entered it
+	bool anyMap = false;
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		CubeMap& map = maps[m];
+		if (map.frameIndex < 0)
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < movedObjects.size() && !map.stale; i++)
+		{
+			map.stale = std::binary_search(map.casters.begin(), map.casters.end(), movedObjects[i]) ||
+				bvh.GetItemBounds(movedObjects[i]).OverlapsSphere(map.position, map.farPlane);
+		}
+
+		anyMap = true;
+		staleMaps += map.stale ? 1 : 0;
+	}
+
+	return anyMap;
+}
+
+void PointShadowMaps::FindCasters(const CubeMap& map, const BVH& bvh, glm::mat4* faceTransforms)
+{
+	// GL's cube face order and orientations: +x, -x, +y, -y, +z, -z
+	static const glm::vec3 FACE_DIRECTIONS[FACE_COUNT] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	static const glm::vec3 FACE_UPS[FACE_COUNT] = {
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE, map.farPlane);
+
+	casters.clear();
+	objectMasks.assign(bvh.GetItemCount(), 0);
+
+	for (unsigned int face = 0; face < FACE_COUNT; face++)
+	{
+		faceTransforms[face] = projection * glm::lookAt(map.position, map.position + FACE_DIRECTIONS[face], FACE_UPS[face]);
+
+		faceObjects.clear();
+		bvh.QueryFrustum(Frustum(faceTransforms[face]), faceObjects);
+		for (size_t i = 0; i < faceObjects.size(); i++)
+		{
+			unsigned int object = faceObjects[i];
+			if (objectMasks[object] == 0)
+			{
+				casters.push_back(object);
+			}
+			objectMasks[object] |= (unsigned char)(1u << face);
+		}
+	}
+
+	casterMasks.resize(casters.size());
+	for (size_t i = 0; i < casters.size(); i++)
+	{
+		casterMasks[i] = objectMasks[casters[i]];
+	}
+}
+
+void PointShadowMaps::Render(const Scene& scene, const BVH& bvh, GLint viewportWidth, GLint viewportHeight)
+{
+	mapsRendered = 0;
+	if (FBO == 0 || staleMaps == 0)
+	{
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glViewport(0, 0, size, size);
+
+	shader.UseShader();
+	GLint uniformModel = shader.GetUniformLocation(MODEL);
+	GLint uniformFaceMask = shader.GetUniformLocation(FACE_MASK);
+
+	casterCount = 0;
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		CubeMap& map = maps[m];
+		if (map.frameIndex < 0 || !map.stale)
+		{
+			continue;
+		}
+
+		glm::mat4 faceTransforms[FACE_COUNT];
+		FindCasters(map, bvh, faceTransforms);
+
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, map.texture, 0);
+		// Clears all six faces
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		glUniformMatrix4fv(shader.GetUniformLocation(FACE_TRANSFORMS, 0), FACE_COUNT, GL_FALSE, glm::value_ptr(faceTransforms[0]));
+		glUniform3f(shader.GetUniformLocation(LIGHT_POSITION), map.position.x, map.position.y, map.position.z);
+		glUniform1f(shader.GetUniformLocation(FAR_PLANE), map.farPlane);
+
+		for (size_t i = 0; i < casters.size(); i++)
+		{
+			const SceneObject& object = scene.GetObject(casters[i]);
+
+			glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(object.transform));
+			glUniform1i(uniformFaceMask, casterMasks[i]);
+
+			if (object.type == SCENE_OBJECT_MESH)
+			{
+				scene.GetMesh(object.resource)->RenderDepth();
+			}
+			else
+			{
+				scene.GetModel(object.resource)->RenderDepth();
+			}
+		}
+
+		std::sort(casters.begin(), casters.end());
+		map.casters = casters;
+		map.drawn = true;
+		map.stale = false;
+		mapsRendered++;
+		casterCount += (unsigned int)casters.size();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+
+	staleMaps = 0;
+}
+
+void PointShadowMaps::UseMaps(Shader* shader)
+{
+	// Indexed like the frame's point lights; a far plane of 0 means no map
+	GLint units[MAX_POINT_LIGHTS];
+	GLfloat farPlanes[MAX_POINT_LIGHTS];
+	for (unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+	{
+		units[i] = POINT_SHADOW_TEXTURE_UNIT + i;
+		farPlanes[i] = 0.0f;
+	}
+
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		const CubeMap& map = maps[m];
+		if (map.frameIndex < 0 || map.frameIndex >= (int)frameLightCount || !map.drawn)
+		{
+			continue;
+		}
+
+		glActiveTexture(GL_TEXTURE0 + POINT_SHADOW_TEXTURE_UNIT + map.frameIndex);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, map.texture);
+		farPlanes[map.frameIndex] = map.farPlane;
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	// Every sampler gets its own unit even when unused, as samplers of different types may not share one
+	glUniform1iv(shader->GetUniformLocation(POINT_SHADOW_MAPS, 0), MAX_POINT_LIGHTS, units);
+	glUniform1fv(shader->GetUniformLocation(POINT_SHADOW_FAR_PLANES, 0), MAX_POINT_LIGHTS, farPlanes);
+}
+
+void PointShadowMaps::ClearMaps()
+{
+	if (FBO != 0)
+	{
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+	}
+
+	for (unsigned int m = 0; m < MAX_POINT_LIGHTS; m++)
+	{
+		if (maps[m].texture != 0)
+		{
+			glDeleteTextures(1, &maps[m].texture);
+			maps[m].texture = 0;
+		}
+		maps[m].lightId = 0;
+		maps[m].frameIndex = -1;
+		maps[m].drawn = false;
+		maps[m].casters.clear();
+	}
+
+	shader.ClearShader();
+	casters.clear();
+	casterMasks.clear();
+	staleMaps = 0;
+}
+
+PointShadowMaps::~PointShadowMaps()
+{
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+#include "Scene.h"
+#include "BVH.h"
+#include "Shader.h"
+#include "FrameState.h"
+
+// Cube shadow maps of the point lights. Each texel holds its distance from the
+// light, so shading compares against one lookup along the light-to-fragment
+// direction. A single pass draws all six faces: pointshadow.geom copies every
+// caster's triangles into the faces it was found in. Nothing in a map changes
+// until its light moves or a caster within its range does, so a map is drawn
+// once and kept until then.
+class PointShadowMaps
+{
+public:
+	PointShadowMaps();
+
+	// Every face is size x size texels
+	void CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation, GLsizei size);
+
+	// Gives the frame's point lights their maps and works out which need drawing.
+	// movedObjects - objects moved since the last call. False if no point light has a map.
+	bool Update(FrameState& frame, const std::vector<unsigned int>& movedObjects, const BVH& bvh);
+	// Draws the maps Update found stale, then rebinds the default framebuffer at the given viewport size
+	void Render(const Scene& scene, const BVH& bvh, GLint viewportWidth, GLint viewportHeight);
+
+	bool HasStaleMaps() { return staleMaps > 0; }
+	unsigned int GetMapsRendered() { return mapsRendered; }
+	unsigned int GetCasterCount() { return casterCount; }
+
+	// For a POINT_SHADOWS_ENABLED shader, which must be in use
+	void UseMaps(Shader* shader);
+
+	void ClearMaps();
+
+	~PointShadowMaps();
+
+private:
+	static const unsigned int FACE_COUNT = 6;
+
+	struct CubeMap
+	{
+		unsigned int lightId;		// 0 - unused
+		unsigned int placementVersion;
+		int frameIndex;				// into the frame's point lights, -1 while the light is off
+		GLuint texture;
+		bool drawn;
+		bool stale;
+		glm::vec3 position;
+		GLfloat farPlane;
+		std::vector<unsigned int> casters;	// sorted, as last drawn
+	};
+
+	Shader shader;
+	GLuint FBO;
+	GLsizei size;
+	bool enabled;
+
+	CubeMap maps[MAX_POINT_LIGHTS];
+	unsigned int staleMaps;
+	unsigned int mapsRendered;
+	unsigned int casterCount;
+	unsigned int frameLightCount;
+
+	// Objects drawn into at least one face, with a bit per face they reach
+	std::vector<unsigned int> casters;
+	std::vector<unsigned char> casterMasks;
+	std::vector<unsigned char> objectMasks;
+	std::vector<unsigned int> faceObjects;
+
+	bool CreateTargets();
+	void FindCasters(const CubeMap& map, const BVH& bvh, glm::mat4* faceTransforms);
+};
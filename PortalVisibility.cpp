@@ -0,0 +1,329 @@
+#include "PortalVisibility.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+// Closer than this to a portal's plane, the portal is treated as filling the view;
+// a bit over the camera's near plane so a doorway never clips away while walking through
+static const float PORTAL_NEAR_DISTANCE = 0.15f;
+
+PortalVisibility::PortalVisibility()
+{
+	frameStamp = 0;
+	visibleCellCount = 0;
+}
+
+int PortalVisibility::AddCell(const AABB& bounds)
+{
+	Cell cell;
+	cell.bounds = bounds;
+	cell.visitStamp = 0;
+	cell.onPath = false;
+	cells.push_back(cell);
+
+	return (int)cells.size() - 1;
+}
+
+void PortalVisibility::AddPortal(int cellA, int cellB, const glm::vec3* corners, unsigned int cornerCount)
+{
+	if (cornerCount < 3 || cornerCount > MAX_PORTAL_CORNERS)
+	{
+		printf("Portal needs 3 to %u corners, got %u.\n", MAX_PORTAL_CORNERS, cornerCount);
+		return;
+	}
+
+	Portal portal;
+	portal.cornerCount = cornerCount;
+	portal.cells[0] = cellA;
+	portal.cells[1] = cellB;
+
+	// Newell's method, robust for slightly non-planar corners
+	portal.normal = glm::vec3(0.0f);
+	for (unsigned int i = 0; i < cornerCount; i++)
+	{
+		const glm::vec3& a = corners[i];
+		const glm::vec3& b = corners[(i + 1) % cornerCount];
+		portal.corners[i] = a;
+		portal.normal += glm::vec3((a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y));
+	}
+	portal.normal = glm::normalize(portal.normal);
+
+	unsigned int index = (unsigned int)portals.size();
+	portals.push_back(portal);
+
+	if (cellA != NO_CELL)
+	{
+		cells[cellA].portals.push_back(index);
+	}
+	if (cellB != NO_CELL)
+	{
+		cells[cellB].portals.push_back(index);
+	}
+}
+
+void PortalVisibility::AssignObjects(const Scene& scene)
+{
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		cells[i].objects.clear();
+	}
+	outsideObjects.clear();
+
+	unsigned int objectCount = scene.GetObjectCount();
+	objectCells.assign(objectCount, std::vector<int>());
+	objectStamps.assign(objectCount, 0);
+
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		AddObjectToCells(i, scene.GetObjectBounds(i));
+	}
+}
+
+void PortalVisibility::UpdateObject(unsigned int object, const AABB& bounds)
+{
+	if (object >= objectCells.size())
+	{
+		objectCells.resize(object + 1);
+		objectStamps.resize(object + 1, 0);
+	}
+
+	RemoveObjectFromCells(object);
+	AddObjectToCells(object, bounds);
+}
+
+void PortalVisibility::AddObjectToCells(unsigned int object, const AABB& bounds)
+{
+	// Objects sitting in a wall or doorway belong to the cells on both sides
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		if (cells[i].bounds.Overlaps(bounds))
+		{
+			cells[i].objects.push_back(object);
+			objectCells[object].push_back((int)i);
+		}
+	}
+
+	if (objectCells[object].empty())
+	{
+		outsideObjects.push_back(object);
+		objectCells[object].push_back(NO_CELL);
+	}
+}
+
+void PortalVisibility::RemoveObjectFromCells(unsigned int object)
+{
+	std::vector<int>& inCells = objectCells[object];
+	for (size_t i = 0; i < inCells.size(); i++)
+	{
+		std::vector<unsigned int>& list = inCells[i] == NO_CELL ? outsideObjects : cells[inCells[i]].objects;
+		std::vector<unsigned int>::iterator it = std::find(list.begin(), list.end(), object);
+		if (it != list.end())
+		{
+			*it = list.back();
+			list.pop_back();
+		}
+	}
+	inCells.clear();
+}
+
+int PortalVisibility::FindCell(const glm::vec3& point) const
+{
+	int best = NO_CELL;
+	float bestVolume = FLT_MAX;
+
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		const AABB& bounds = cells[i].bounds;
+		if (point.x < bounds.min.x || point.y < bounds.min.y || point.z < bounds.min.z ||
+			point.x > bounds.max.x || point.y > bounds.max.y || point.z > bounds.max.z)
+		{
+			continue;
+		}
+
+		glm::vec3 size = bounds.max - bounds.min;
+		float volume = size.x * size.y * size.z;
+		if (volume < bestVolume)
+		{
+			bestVolume = volume;
+			best = (int)i;
+		}
+	}
+
+	return best;
+}
+
+bool PortalVisibility::FindVisible(const BVH& bvh, const glm::vec3& eye, const glm::mat4& viewProjection, std::vector<unsigned int>& objects)
+{
+	visibleCellCount = 0;
+
+	int eyeCell = FindCell(eye);
+	if (eyeCell == NO_CELL)
+	{
+		return false;
+	}
+
+	if (++frameStamp == 0)
+	{
+		std::fill(objectStamps.begin(), objectStamps.end(), 0);
+		for (size_t i = 0; i < cells.size(); i++)
+		{
+			cells[i].visitStamp = 0;
+		}
+		frameStamp = 1;
+	}
+
+	glm::vec4 fullScreen(-1.0f, -1.0f, 1.0f, 1.0f);
+
+	Frustum frustum(viewProjection, fullScreen);
+	for (size_t i = 0; i < outsideObjects.size(); i++)
+	{
+		EmitObject(outsideObjects[i], frustum, bvh, objects);
+	}
+
+	VisitCell(bvh, eyeCell, fullScreen, 0, eye, viewProjection, objects);
+
+	return true;
+}
+
+void PortalVisibility::VisitCell(const BVH& bvh, int cellIndex, const glm::vec4& rect, unsigned int depth,
+	const glm::vec3& eye, const glm::mat4& viewProjection, std::vector<unsigned int>& objects)
+{
+	Cell& cell = cells[cellIndex];
+	cell.onPath = true;
+
+	if (cell.visitStamp != frameStamp)
+	{
+		cell.visitStamp = frameStamp;
+		visibleCellCount++;
+	}
+
+	Frustum frustum(viewProjection, rect);
+	for (size_t i = 0; i < cell.objects.size(); i++)
+	{
+		EmitObject(cell.objects[i], frustum, bvh, objects);
+	}
+
+	if (depth < MAX_PORTAL_DEPTH)
+	{
+		for (size_t i = 0; i < cell.portals.size(); i++)
+		{
+			const Portal& portal = portals[cell.portals[i]];
+			int next = portal.cells[0] == cellIndex ? portal.cells[1] : portal.cells[0];
+
+			// Cycles through the graph would only ever see a subset of what the first pass saw
+			if (next == NO_CELL || cells[next].onPath)
+			{
+				continue;
+			}
+
+			glm::vec4 portalRect;
+			if (ProjectPortal(portal, eye, viewProjection, rect, portalRect))
+			{
+				VisitCell(bvh, next, portalRect, depth + 1, eye, viewProjection, objects);
+			}
+		}
+	}
+
+	cell.onPath = false;
+}
+
+bool PortalVisibility::ProjectPortal(const Portal& portal, const glm::vec3& eye, const glm::mat4& viewProjection,
+	const glm::vec4& rect, glm::vec4& portalRect) const
+{
+	// Standing in the doorway: the portal can't be projected sensibly, keep the whole rectangle
+	float planeDistance = glm::dot(portal.normal, eye - portal.corners[0]);
+	if (fabsf(planeDistance) < PORTAL_NEAR_DISTANCE)
+	{
+		AABB extent;
+		for (unsigned int i = 0; i < portal.cornerCount; i++)
+		{
+			extent.Grow(portal.corners[i]);
+		}
+		extent.min -= glm::vec3(PORTAL_NEAR_DISTANCE);
+		extent.max += glm::vec3(PORTAL_NEAR_DISTANCE);
+
+		if (eye.x >= extent.min.x && eye.y >= extent.min.y && eye.z >= extent.min.z &&
+			eye.x <= extent.max.x && eye.y <= extent.max.y && eye.z <= extent.max.z)
+		{
+			portalRect = rect;
+			return true;
+		}
+	}
+
+	// Clip the polygon to the near plane (z = -w) in clip space
+	glm::vec4 clip[MAX_PORTAL_CORNERS];
+	for (unsigned int i = 0; i < portal.cornerCount; i++)
+	{
+		clip[i] = viewProjection * glm::vec4(portal.corners[i], 1.0f);
+	}
+
+	glm::vec4 clipped[MAX_PORTAL_CORNERS + 1];
+	unsigned int clippedCount = 0;
+	for (unsigned int i = 0; i < portal.cornerCount; i++)
+	{
+		const glm::vec4& a = clip[i];
+		const glm::vec4& b = clip[(i + 1) % portal.cornerCount];
+		float distanceA = a.z + a.w;
+		float distanceB = b.z + b.w;
+
+		if (distanceA >= 0.0f)
+		{
+			clipped[clippedCount++] = a;
+		}
+		if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+		{
+			clipped[clippedCount++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+		}
+	}
+
+	if (clippedCount < 3)
+	{
+		return false;
+	}
+
+	glm::vec4 bounds(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (unsigned int i = 0; i < clippedCount; i++)
+	{
+		// Past the near plane w is positive, so the divide is safe
+		float inverseW = 1.0f / std::max(clipped[i].w, 1e-6f);
+		float x = clipped[i].x * inverseW;
+		float y = clipped[i].y * inverseW;
+		bounds.x = std::min(bounds.x, x);
+		bounds.y = std::min(bounds.y, y);
+		bounds.z = std::max(bounds.z, x);
+		bounds.w = std::max(bounds.w, y);
+	}
+
+	portalRect = glm::vec4(std::max(bounds.x, rect.x), std::max(bounds.y, rect.y),
+		std::min(bounds.z, rect.z), std::min(bounds.w, rect.w));
+
+	return portalRect.x < portalRect.z && portalRect.y < portalRect.w;
+}
+
+void PortalVisibility::EmitObject(unsigned int object, const Frustum& frustum, const BVH& bvh, std::vector<unsigned int>& objects)
+{
+	if (objectStamps[object] == frameStamp || object >= bvh.GetItemCount())
+	{
+		return;
+	}
+
+	if (frustum.Intersects(bvh.GetItemBounds(object)))
+	{
+		objectStamps[object] = frameStamp;
+		objects.push_back(object);
+	}
+}
+
+void PortalVisibility::Clear()
+{
+	cells.clear();
+	portals.clear();
+	outsideObjects.clear();
+	objectCells.clear();
+	objectStamps.clear();
+	visibleCellCount = 0;
+}
+
+PortalVisibility::~PortalVisibility()
+{
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+#include "Bounds.h"
+#include "Scene.h"
+#include "BVH.h"
+
+const int NO_CELL = -1;
+
+// Cell-and-portal visibility. Rooms are cells (boxes), doorways are convex portal
+// polygons joining two cells. From the cell holding the eye, visibility flows only
+// through portals that are on screen, each one shrinking the screen rectangle the
+// next cell is seen through. Only the objects of the cells reached are tested,
+// against that cell's narrowed frustum, so the cost follows what can be seen
+// rather than the size of the building.
+class PortalVisibility
+{
+public:
+	PortalVisibility();
+
+	int AddCell(const AABB& bounds);
+	// corners wind around a convex polygon; up to MAX_PORTAL_CORNERS
+	void AddPortal(int cellA, int cellB, const glm::vec3* corners, unsigned int cornerCount);
+
+	// Objects go to every cell their bounds overlap; objects outside all cells
+	// are always frustum tested
+	void AssignObjects(const Scene& scene);
+	void UpdateObject(unsigned int object, const AABB& bounds);
+
+	// Smallest cell containing the point, or NO_CELL
+	int FindCell(const glm::vec3& point) const;
+
+	// bvh is over the scene's objects and supplies their current bounds. False when
+	// the eye isn't in any cell; the caller should fall back to plain frustum culling
+	bool FindVisible(const BVH& bvh, const glm::vec3& eye, const glm::mat4& viewProjection, std::vector<unsigned int>& objects);
+
+	unsigned int GetCellCount() const { return (unsigned int)cells.size(); }
+	unsigned int GetVisibleCellCount() const { return visibleCellCount; }
+
+	void Clear();
+
+	~PortalVisibility();
+
+private:
+	static const unsigned int MAX_PORTAL_CORNERS = 8;
+	// Bounds the recursion on graphs where many portal chains lead to the same cell
+	static const unsigned int MAX_PORTAL_DEPTH = 16;
+
+	struct Portal
+	{
+		glm::vec3 corners[MAX_PORTAL_CORNERS];
+		unsigned int cornerCount;
+		glm::vec3 normal;
+		int cells[2];
+	};
+
+	struct Cell
+	{
+		AABB bounds;
+		std::vector<unsigned int> portals;
+		std::vector<unsigned int> objects;
+		unsigned int visitStamp;
+		bool onPath;
+	};
+
+	std::vector<Cell> cells;
+	std::vector<Portal> portals;
+	std::vector<unsigned int> outsideObjects;
+	// Cells each object overlaps, just NO_CELL for objects outside them all
+	std::vector<std::vector<int> > objectCells;
+
+	// Frame stamps so objects and cells reached by several portal chains are counted once
+	std::vector<unsigned int> objectStamps;
+	unsigned int frameStamp;
+	unsigned int visibleCellCount;
+
+	void VisitCell(const BVH& bvh, int cell, const glm::vec4& rect, unsigned int depth,
+		const glm::vec3& eye, const glm::mat4& viewProjection, std::vector<unsigned int>& objects);
+	bool ProjectPortal(const Portal& portal, const glm::vec3& eye, const glm::mat4& viewProjection, const glm::vec4& rect, glm::vec4& portalRect) const;
+	void AddObjectToCells(unsigned int object, const AABB& bounds);
+	void RemoveObjectFromCells(unsigned int object);
+	void EmitObject(unsigned int object, const Frustum& frustum, const BVH& bvh, std::vector<unsigned int>& objects);
+};
+
@@ -0,0 +1,248 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+#include <glm\gtc\type_ptr.hpp>
+
+RenderQueue::RenderQueue()
+{
+	usedBuffers = 0;
+	drawOffsetsWritten = false;
+}
+
+void RenderQueue::Record(const Scene& scene, JobSystem& jobs, const std::vector<unsigned int>* visibleObjects,
+	const std::vector<glm::ivec4>* objectLights)
+{
+	unsigned int objectCount = visibleObjects ? (unsigned int)visibleObjects->size() : scene.GetObjectCount();
+
+	usedBuffers = (objectCount + OBJECTS_PER_CHUNK - 1) / OBJECTS_PER_CHUNK;
+	drawOffsetsWritten = false;
+	if (buffers.size() < usedBuffers)
+	{
+		buffers.resize(usedBuffers);
+	}
+
+	jobs.ParallelFor(usedBuffers, 1, [this, &scene, visibleObjects, objectLights](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int chunk = begin; chunk < end; chunk++)
+		{
+			RecordChunk(scene, visibleObjects, objectLights, chunk);
+		}
+	});
+}
+
+void RenderQueue::RecordChunk(const Scene& scene, const std::vector<unsigned int>* visibleObjects, const std::vector<glm::ivec4>* objectLights, unsigned int chunk)
+{
+	CommandBuffer& buffer = buffers[chunk];
+	buffer.Reset();
+
+	unsigned int objectCount = visibleObjects ? (unsigned int)visibleObjects->size() : scene.GetObjectCount();
+	unsigned int first = chunk * OBJECTS_PER_CHUNK;
+	unsigned int last = std::min(first + OBJECTS_PER_CHUNK, objectCount);
+
+	for (unsigned int position = first; position < last; position++)
+	{
+		unsigned int i = visibleObjects ? (*visibleObjects)[position] : position;
+		const SceneObject& object = scene.GetObject(i);
+
+		DrawCommand& command = buffer.Add();
+		command.sortKey = MakeSortKey(object, i);
+		command.transform = object.transform;
+		command.resource = object.resource;
+		command.texture = object.texture;
+		command.material = object.material;
+		command.type = object.type;
+		command.lights = objectLights ? (*objectLights)[position] : glm::ivec4(0);
+		command.lightmapRect = object.lightmapRect;
+	}
+
+	buffer.Sort();
+}
+
+void RenderQueue::Submit(const Scene& scene, GLuint uniformModel, GLuint uniformSpecularIntensity, GLuint uniformShininess,
+	UniformRingBuffer* drawBuffer, GLuint uniformDrawLights, GLuint uniformDrawLightmap)
+{
+	BeginMerge();
+
+	// Program uniforms may be stale from another variant, so nothing is assumed bound
+	unsigned short currentTexture = NO_SCENE_RESOURCE;
+	unsigned short currentMaterial = NO_SCENE_RESOURCE;
+
+	bool reuseDrawBlocks = drawBuffer && drawOffsetsWritten;
+	size_t drawIndex = 0;
+
+	while (!mergeHeads.empty())
+	{
+		std::pop_heap(mergeHeads.begin(), mergeHeads.end(), MergeHeadLater);
+		MergeHead& head = mergeHeads.back();
+		const CommandBuffer& buffer = buffers[head.buffer];
+		const DrawCommand& command = buffer.GetCommand(head.position);
+
+		if (command.type == SCENE_OBJECT_MESH && command.texture != currentTexture)
+		{
+			scene.GetTexture(command.texture)->UseTexture();
+			currentTexture = command.texture;
+		}
+
+		if (drawBuffer)
+		{
+			GLintptr offset = reuseDrawBlocks ? drawOffsets[drawIndex++] : WriteDrawBlock(scene, command, *drawBuffer);
+			if (offset < 0)
+			{
+				// Only if the ring could not grow; the draw is dropped rather than drawn with stale data
+				Advance(head);
+				continue;
+			}
+
+			drawBuffer->BindRange(DRAW_BLOCK_BINDING, offset, sizeof(DrawBlock));
+		}
+		else
+		{
+			if (command.material != currentMaterial)
+			{
+				scene.GetMaterial(command.material)->UseMaterial(uniformSpecularIntensity, uniformShininess);
+				currentMaterial = command.material;
+			}
+
+			glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(command.transform));
+			glUniform4i(uniformDrawLights, command.lights.x, command.lights.y, command.lights.z, command.lights.w);
+			glUniform4fv(uniformDrawLightmap, 1, glm::value_ptr(command.lightmapRect));
+		}
+
+		if (command.type == SCENE_OBJECT_MESH)
+		{
+			scene.GetMesh(command.resource)->RenderMesh();
+		}
+		else
+		{
+			// Models bind a texture per sub-mesh
+			scene.GetModel(command.resource)->RenderModel();
+			currentTexture = NO_SCENE_RESOURCE;
+		}
+
+		Advance(head);
+	}
+
+	drawOffsetsWritten = false;
+}
+
+void RenderQueue::SubmitDepth(const Scene& scene, GLuint uniformModel, UniformRingBuffer* drawBuffer)
+{
+	BeginMerge();
+	drawOffsets.clear();
+
+	while (!mergeHeads.empty())
+	{
+		std::pop_heap(mergeHeads.begin(), mergeHeads.end(), MergeHeadLater);
+		MergeHead& head = mergeHeads.back();
+		const DrawCommand& command = buffers[head.buffer].GetCommand(head.position);
+
+		if (drawBuffer)
+		{
+			GLintptr offset = WriteDrawBlock(scene, command, *drawBuffer);
+			drawOffsets.push_back(offset);
+			if (offset < 0)
+			{
+				Advance(head);
+				continue;
+			}
+
+			drawBuffer->BindRange(DRAW_BLOCK_BINDING, offset, sizeof(DrawBlock));
+		}
+		else
+		{
+			glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(command.transform));
+		}
+
+		if (command.type == SCENE_OBJECT_MESH)
+		{
+			scene.GetMesh(command.resource)->RenderDepth();
+		}
+		else
+		{
+			scene.GetModel(command.resource)->RenderDepth();
+		}
+
+		Advance(head);
+	}
+
+	drawOffsetsWritten = drawBuffer != nullptr;
+}
+
+void RenderQueue::BeginMerge()
+{
+	// Min-heap over the head of every buffer; ties are impossible as the key ends in the object index
+	mergeHeads.clear();
+	for (unsigned int i = 0; i < usedBuffers; i++)
+	{
+		if (buffers[i].GetCount() > 0)
+		{
+			MergeHead head = { buffers[i].GetCommand(0).sortKey, i, 0 };
+			mergeHeads.push_back(head);
+		}
+	}
+	std::make_heap(mergeHeads.begin(), mergeHeads.end(), MergeHeadLater);
+}
+
+GLintptr RenderQueue::WriteDrawBlock(const Scene& scene, const DrawCommand& command, UniformRingBuffer& drawBuffer)
+{
+	Material* material = scene.GetMaterial(command.material);
+
+	DrawBlock block;
+	block.model = command.transform;
+	block.material = glm::vec4(material->GetSpecularIntensity(), material->GetShininess(), 0.0f, 0.0f);
+	block.lights = command.lights;
+	block.lightmap = command.lightmapRect;
+
+	return drawBuffer.Write(&block, sizeof(block));
+}
+
+void RenderQueue::Advance(MergeHead& head)
+{
+	// head is the popped element at the back of the heap
+	const CommandBuffer& buffer = buffers[head.buffer];
+
+	if (++head.position < buffer.GetCount())
+	{
+		head.sortKey = buffer.GetCommand(head.position).sortKey;
+		std::push_heap(mergeHeads.begin(), mergeHeads.end(), MergeHeadLater);
+	}
+	else
+	{
+		mergeHeads.pop_back();
+	}
+}
+
+bool RenderQueue::MergeHeadLater(const MergeHead& a, const MergeHead& b)
+{
+	return a.sortKey > b.sortKey;
+}
+
+unsigned int RenderQueue::GetCommandCount() const
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < usedBuffers; i++)
+	{
+		count += (unsigned int)buffers[i].GetCount();
+	}
+
+	return count;
+}
+
+unsigned long long RenderQueue::MakeSortKey(const SceneObject& object, unsigned int objectIndex)
+{
+	// material:12 | texture:12 | type:1 | mesh or model:12 | object:27, so draws
+	// group by the most expensive state change first
+	unsigned long long key = 0;
+	key |= (unsigned long long)(object.material & 0xFFF) << 52;
+	key |= (unsigned long long)(object.texture & 0xFFF) << 40;
+	key |= (unsigned long long)(object.type & 0x1) << 39;
+	key |= (unsigned long long)(object.resource & 0xFFF) << 27;
+	key |= (unsigned long long)(objectIndex & 0x7FFFFFF);
+
+	return key;
+}
+
+RenderQueue::~RenderQueue()
+{
+}
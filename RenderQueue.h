@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "CommonValues.h"
+
+#include "Scene.h"
+#include "CommandBuffer.h"
+#include "JobSystem.h"
+#include "UniformRingBuffer.h"
+
+// Draw stream for one frame. Record walks the scene on the job system, each
+// chunk of objects writing and sorting its own CommandBuffer; Submit merges
+// the sorted buffers on the GL thread and issues the GL calls.
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	// visibleObjects, when given, lists the object indices to draw (e.g. a BVH
+	// frustum query); otherwise every object in the scene is recorded. With
+	// objectLights, in the same order, every draw also gets the list of lights
+	// reaching its object (see LightCuller::GetLightList).
+	void Record(const Scene& scene, JobSystem& jobs, const std::vector<unsigned int>* visibleObjects = nullptr,
+		const std::vector<glm::ivec4>* objectLights = nullptr);
+	// With a drawBuffer the shader must be a DRAW_BLOCK_ENABLED variant; the model
+	// matrix, material, light list and lightmap rectangle are then written to the
+	// ring instead of set as uniforms
+	void Submit(const Scene& scene, GLuint uniformModel, GLuint uniformSpecularIntensity, GLuint uniformShininess,
+		UniformRingBuffer* drawBuffer = nullptr, GLuint uniformDrawLights = -1, GLuint uniformDrawLightmap = -1);
+
+	// Depth-only replay of the same stream for a pre-pass: no textures or materials.
+	// Draw blocks it writes are reused by the Submit that follows.
+	void SubmitDepth(const Scene& scene, GLuint uniformModel, UniformRingBuffer* drawBuffer = nullptr);
+
+	unsigned int GetCommandCount() const;
+
+	static GLsizeiptr GetDrawBlockSize() { return sizeof(DrawBlock); }
+
+	~RenderQueue();
+
+private:
+	static const unsigned int OBJECTS_PER_CHUNK = 512;
+
+	// std140 layout of DrawBlock in shader.vert / shader.frag
+	struct DrawBlock
+	{
+		glm::mat4 model;
+		glm::vec4 material;		// x - specular intensity, y - shininess
+		glm::ivec4 lights;
+		glm::vec4 lightmap;
+	};
+
+	struct MergeHead
+	{
+		unsigned long long sortKey;
+		unsigned int buffer;
+		size_t position;
+	};
+
+	std::vector<CommandBuffer> buffers;
+	unsigned int usedBuffers;
+
+	std::vector<MergeHead> mergeHeads;
+
+	// Ring offsets of the draw blocks written by SubmitDepth, in submission order
+	std::vector<GLintptr> drawOffsets;
+	bool drawOffsetsWritten;
+
+	void RecordChunk(const Scene& scene, const std::vector<unsigned int>* visibleObjects, const std::vector<glm::ivec4>* objectLights, unsigned int chunk);
+	void BeginMerge();
+	void Advance(MergeHead& head);
+	GLintptr WriteDrawBlock(const Scene& scene, const DrawCommand& command, UniformRingBuffer& drawBuffer);
+
+	static bool MergeHeadLater(const MergeHead& a, const MergeHead& b);
+
+	static unsigned long long MakeSortKey(const SceneObject& object, unsigned int objectIndex);
+};
+
@@ -0,0 +1,122 @@
+#include "Scene.h"
+
+Scene::Scene()
+{
+}
+
+bool Scene::AddObject(const glm::mat4& transform, Mesh* mesh, Texture* texture, Material* material)
+{
+	// All or nothing, so a rejected object doesn't use up slots in the other tables
+	if (!CanRegister(mesh, meshes) || !CanRegister(texture, textures) || !CanRegister(material, materials))
+	{
+		printf("Scene resource limit (%u) reached, object %u not added.\n", MAX_SCENE_RESOURCES, (unsigned int)objects.size());
+		return false;
+	}
+
+	SceneObject object;
+	object.transform = transform;
+	object.resource = Register(mesh, meshes);
+	object.texture = Register(texture, textures);
+	object.material = Register(material, materials);
+	object.type = SCENE_OBJECT_MESH;
+	object.lightmapRect = glm::vec4(0.0f);
+
+	objects.push_back(object);
+	bounds.push_back(CalculateBounds(object));
+
+	return true;
+}
+
+bool Scene::AddModel(const glm::mat4& transform, Model* model, Material* material)
+{
+	if (!CanRegister(model, models) || !CanRegister(material, materials))
+	{
+		printf("Scene resource limit (%u) reached, model %u not added.\n", MAX_SCENE_RESOURCES, (unsigned int)objects.size());
+		return false;
+	}
+
+	SceneObject object;
+	object.transform = transform;
+	object.resource = Register(model, models);
+	object.texture = NO_SCENE_RESOURCE;
+	object.material = Register(material, materials);
+	object.type = SCENE_OBJECT_MODEL;
+	object.lightmapRect = glm::vec4(0.0f);
+
+	objects.push_back(object);
+	bounds.push_back(CalculateBounds(object));
+
+	return true;
+}
+
+void Scene::SetTransform(unsigned int index, const glm::mat4& transform)
+{
+	if (index >= objects.size())
+	{
+		return;
+	}
+
+	objects[index].transform = transform;
+	bounds[index] = CalculateBounds(objects[index]);
+	movedObjects.push_back(index);
+}
+
+void Scene::TakeMovedObjects(std::vector<unsigned int>& moved)
+{
+	moved.swap(movedObjects);
+	movedObjects.clear();
+}
+
+AABB Scene::CalculateBounds(const SceneObject& object) const
+{
+	if (object.type == SCENE_OBJECT_MODEL)
+	{
+		return models[object.resource]->GetBounds().Transformed(object.transform);
+	}
+
+	return meshes[object.resource]->GetBounds().Transformed(object.transform);
+}
+
+template <typename T>
+bool Scene::CanRegister(T* resource, const std::vector<T*>& table) const
+{
+	return table.size() < MAX_SCENE_RESOURCES || resourceIndices.find(resource) != resourceIndices.end();
+}
+
+template <typename T>
+unsigned short Scene::Register(T* resource, std::vector<T*>& table)
+{
+	std::unordered_map<const void*, unsigned short>::iterator it = resourceIndices.find(resource);
+	if (it != resourceIndices.end())
+	{
+		return it->second;
+	}
+
+	if (table.size() >= MAX_SCENE_RESOURCES)
+	{
+		printf("Scene resource limit (%u) reached.\n", MAX_SCENE_RESOURCES);
+		return NO_SCENE_RESOURCE;
+	}
+
+	unsigned short index = (unsigned short)table.size();
+	table.push_back(resource);
+	resourceIndices[resource] = index;
+
+	return index;
+}
+
+void Scene::ClearScene()
+{
+	objects.clear();
+	bounds.clear();
+	movedObjects.clear();
+	meshes.clear();
+	models.clear();
+	textures.clear();
+	materials.clear();
+	resourceIndices.clear();
+}
+
+Scene::~Scene()
+{
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <unordered_map>
+
+#include <glm\glm.hpp>
+
+#include "Mesh.h"
+#include "Model.h"
+#include "Texture.h"
+#include "Material.h"
+#include "Bounds.h"
+
+// Resources are referred to by small indices so draw packets stay compact
+// and never hold API objects. Indices must fit the fields of the sort key.
+const unsigned int MAX_SCENE_RESOURCES = 4096;
+const unsigned short NO_SCENE_RESOURCE = 0xFFFF;
+
+enum SceneObjectType
+{
+	SCENE_OBJECT_MESH,
+	SCENE_OBJECT_MODEL
+};
+
+struct SceneObject
+{
+	glm::mat4 transform;
+	unsigned short resource;	// mesh or model index, depending on type
+	unsigned short texture;		// NO_SCENE_RESOURCE for models, they bind their own
+	unsigned short material;
+	unsigned char type;
+	glm::vec4 lightmapRect;		// xy - scale, zw - offset of the object's lightmap UVs in the atlas; 0 - not lightmapped
+};
+
+class Scene
+{
+public:
+	Scene();
+
+	// False, and nothing added, once a resource table is full
+	bool AddObject(const glm::mat4& transform, Mesh* mesh, Texture* texture, Material* material);
+	bool AddModel(const glm::mat4& transform, Model* model, Material* material);
+
+	unsigned int GetObjectCount() const { return (unsigned int)objects.size(); }
+	const SceneObject& GetObject(unsigned int index) const { return objects[index]; }
+
+	// World-space bounds, kept in step with the transform
+	const AABB& GetObjectBounds(unsigned int index) const { return bounds[index]; }
+	const std::vector<AABB>& GetAllBounds() const { return bounds; }
+
+	// Moves an object after it was added. The index is remembered until
+	// TakeMovedObjects so spatial structures can refit just what changed.
+	void SetTransform(unsigned int index, const glm::mat4& transform);
+	void TakeMovedObjects(std::vector<unsigned int>& moved);
+
+	// Set by Lightmapper when it places the object in its atlas
+	void SetLightmapRect(unsigned int index, const glm::vec4& rect) { objects[index].lightmapRect = rect; }
+
+	Mesh* GetMesh(unsigned short index) const { return meshes[index]; }
+	Model* GetModel(unsigned short index) const { return models[index]; }
+	Texture* GetTexture(unsigned short index) const { return textures[index]; }
+	Material* GetMaterial(unsigned short index) const { return materials[index]; }
+
+	void ClearScene();
+
+	~Scene();
+
+private:
+	std::vector<SceneObject> objects;
+	std::vector<AABB> bounds;
+	std::vector<unsigned int> movedObjects;
+
+	std::vector<Mesh*> meshes;
+	std::vector<Model*> models;
+	std::vector<Texture*> textures;
+	std::vector<Material*> materials;
+
+	std::unordered_map<const void*, unsigned short> resourceIndices;
+
+	AABB CalculateBounds(const SceneObject& object) const;
+
+	// Whether Register would succeed: already registered, or there is room
+	template <typename T>
+	bool CanRegister(T* resource, const std::vector<T*>& table) const;
+	// NO_SCENE_RESOURCE when the table is full
+	template <typename T>
+	unsigned short Register(T* resource, std::vector<T*>& table);
+};
+
@@ -1,28 +1,89 @@
 #include "Shader.h"
 
+// Light array fields, hashed at compile time with the element index left out
+static constexpr unsigned int POINT_COLOUR = UniformHash("pointLights[].base.colour");
+static constexpr unsigned int POINT_AMBIENT_INTENSITY = UniformHash("pointLights[].base.ambientIntensity");
+static constexpr unsigned int POINT_DIFFUSE_INTENSITY = UniformHash("pointLights[].base.diffuseIntensity");
+static constexpr unsigned int POINT_POSITION = UniformHash("pointLights[].position");
+static constexpr unsigned int POINT_CONSTANT = UniformHash("pointLights[].constant");
+static constexpr unsigned int POINT_LINEAR = UniformHash("pointLights[].linear");
+static constexpr unsigned int POINT_EXPONENT = UniformHash("pointLights[].exponent");
+
+static constexpr unsigned int SPOT_COLOUR = UniformHash("spotLights[].base.base.colour");
+static constexpr unsigned int SPOT_AMBIENT_INTENSITY = UniformHash("spotLights[].base.base.ambientIntensity");
+static constexpr unsigned int SPOT_DIFFUSE_INTENSITY = UniformHash("spotLights[].base.base.diffuseIntensity");
+static constexpr unsigned int SPOT_POSITION = UniformHash("spotLights[].base.position");
+static constexpr unsigned int SPOT_CONSTANT = UniformHash("spotLights[].base.constant");
+static constexpr unsigned int SPOT_LINEAR = UniformHash("spotLights[].base.linear");
+static constexpr unsigned int SPOT_EXPONENT = UniformHash("spotLights[].base.exponent");
+static constexpr unsigned int SPOT_DIRECTION = UniformHash("spotLights[].direction");
+static constexpr unsigned int SPOT_EDGE = UniformHash("spotLights[].edge");
+
 Shader::Shader()
 {
 	shaderID = 0;
 	uniformModel = 0;
-	uniformProjection = 0;
+
+	compilePending = false;
+	hasDrawBlock = false;
+	attachedShaders[0] = 0;
+	attachedShaders[1] = 0;
+	attachedShaders[2] = 0;
 
 	pointLightCount = 0;
 	spotLightCount = 0;
+
+	ResetUploadedLights();
 }
 
-void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
+void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode, const std::string& defines)
 {
-	CompileShader(vertexCode, fragmentCode);
+	std::string vertexString = InjectDefines(vertexCode, defines);
+	std::string fragmentString = InjectDefines(fragmentCode, defines);
+
+	CompileShader(vertexString.c_str(), nullptr, fragmentString.c_str(), defines);
 }
 
-void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation)
+void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation, const std::string& defines)
 {
-	std::string vertexString = ReadFile(vertexLocation);
-	std::string fragmentString = ReadFile(fragmentLocation);
+	std::string vertexString = InjectDefines(ReadFile(vertexLocation), defines);
+	std::string fragmentString = InjectDefines(ReadFile(fragmentLocation), defines);
 	const char* vertexCode = vertexString.c_str();
 	const char* fragmentCode = fragmentString.c_str();
 
-	CompileShader(vertexCode, fragmentCode);
+	CompileShader(vertexCode, nullptr, fragmentCode, defines);
+}
+
+void Shader::CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation, const std::string& defines)
+{
+	std::string vertexString = InjectDefines(ReadFile(vertexLocation), defines);
+	std::string geometryString = InjectDefines(ReadFile(geometryLocation), defines);
+	std::string fragmentString = InjectDefines(ReadFile(fragmentLocation), defines);
+
+	CompileShader(vertexString.c_str(), geometryString.c_str(), fragmentString.c_str(), defines);
+}
+
+std::string Shader::InjectDefines(const std::string& code, const std::string& defines)
+{
+	if (defines.empty())
+	{
+		return code;
+	}
+
+	// #version has to stay the first statement, so defines go on the line after it
+	size_t versionPos = code.find("#version");
+	if (versionPos == std::string::npos)
+	{
+		return defines + code;
+	}
+
+	size_t lineEnd = code.find('\n', versionPos);
+	if (lineEnd == std::string::npos)
+	{
+		return code + "\n" + defines;
+	}
+
+	return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
 }
 
 std::string Shader::ReadFile(const char* fileLocation)
@@ -46,7 +107,7 @@ std::string Shader::ReadFile(const char* fileLocation)
 	return content;
 }
 
-void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
+void Shader::CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode, const std::string& defines)
 {
 	shaderID = glCreateProgram();
 
@@ -56,21 +117,68 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 		return;
 	}
 
-	AddShader(shaderID, vertexCode, GL_VERTEX_SHADER);
-	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
+	if (cache.IsSupported())
+	{
+		// The geometry stage is keyed along with the vertex stage
+		cacheKey = cache.BuildKey(geometryCode ? std::string(vertexCode) + geometryCode : std::string(vertexCode), fragmentCode, defines);
+
+		if (cache.LoadProgram(shaderID, cacheKey))
+		{
+			GetUniformLocations();
+			return;
+		}
+
+		// A rejected binary leaves the program unusable, start over from source
+		glDeleteProgram(shaderID);
+		shaderID = glCreateProgram();
+		glProgramParameteri(shaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	else
+	{
+		cacheKey = "";
+	}
+
+	AddShader(shaderID, vertexCode, GL_VERTEX_SHADER, 0);
+	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER, 1);
+	if (geometryCode)
+	{
+		AddShader(shaderID, geometryCode, GL_GEOMETRY_SHADER, 2);
+	}
+
+	// Status is not queried here so the driver can compile and link in the background
+	// while the rest of the scene loads; FinishCompile picks up the result on first use.
+	glLinkProgram(shaderID);
+	compilePending = true;
+}
+
+void Shader::FinishCompile()
+{
+	if (!compilePending)
+	{
+		return;
+	}
+
+	compilePending = false;
 
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
-	glLinkProgram(shaderID);
 	glGetProgramiv(shaderID, GL_LINK_STATUS, &result);
 	if (!result)
 	{
+		PrintShaderLog(attachedShaders[0]);
+		PrintShaderLog(attachedShaders[1]);
+		PrintShaderLog(attachedShaders[2]);
+
 		glGetProgramInfoLog(shaderID, sizeof(eLog), NULL, eLog);
 		printf("Error linking program: '%s'\n", eLog);
+		ReleaseShaders();
 		return;
 	}
 
+	ReleaseShaders();
+
+#ifdef _DEBUG
 	glValidateProgram(shaderID);
 	glGetProgramiv(shaderID, GL_VALIDATE_STATUS, &result);
 	if (!result)
@@ -79,93 +187,78 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 		printf("Error validating program: '%s'\n", eLog);
 		return;
 	}
+#endif
 
-	uniformProjection = glGetUniformLocation(shaderID, "projection");
-	uniformModel = glGetUniformLocation(shaderID, "model");
-	uniformView = glGetUniformLocation(shaderID, "view");
-	uniformDirectionalLight.uniformColour = glGetUniformLocation(shaderID, "directionalLight.base.colour");
-	uniformDirectionalLight.uniformAmbientIntensity = glGetUniformLocation(shaderID, "directionalLight.base.ambientIntensity");
-	uniformDirectionalLight.uniformDirection = glGetUniformLocation(shaderID, "directionalLight.direction");
-	uniformDirectionalLight.uniformDiffuseIntensity = glGetUniformLocation(shaderID, "directionalLight.base.diffuseIntensity");
-	uniformSpecularIntensity = glGetUniformLocation(shaderID, "material.specularIntensity");
-	uniformShininess = glGetUniformLocation(shaderID, "material.shininess");
-	uniformEyePosition = glGetUniformLocation(shaderID, "eyePosition");
-
-	uniformPointLightCount = glGetUniformLocation(shaderID, "pointLightCount");
-
-	for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
+	if (!cacheKey.empty())
 	{
-		char locBuff[100] = { '\0' };
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.colour", i);
-		uniformPointLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.ambientIntensity", i);
-		uniformPointLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.diffuseIntensity", i);
-		uniformPointLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].position", i);
-		uniformPointLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].constant", i);
-		uniformPointLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].linear", i);
-		uniformPointLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].exponent", i);
-		uniformPointLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
+		cache.SaveProgram(shaderID, cacheKey);
 	}
 
-	uniformSpotLightCount = glGetUniformLocation(shaderID, "spotLightCount");
+	GetUniformLocations();
+}
 
-	for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
+void Shader::GetUniformLocations()
+{
+	registry.Reflect(shaderID);
+	ResetUploadedLights();
+
+	uniformModel = registry.Find(UniformHash("model"));
+	uniformDirectionalLight.uniformColour = registry.Find(UniformHash("directionalLight.base.colour"));
+	uniformDirectionalLight.uniformAmbientIntensity = registry.Find(UniformHash("directionalLight.base.ambientIntensity"));
+	uniformDirectionalLight.uniformDirection = registry.Find(UniformHash("directionalLight.direction"));
+	uniformDirectionalLight.uniformDiffuseIntensity = registry.Find(UniformHash("directionalLight.base.diffuseIntensity"));
+	uniformSpecularIntensity = registry.Find(UniformHash("material.specularIntensity"));
+	uniformShininess = registry.Find(UniformHash("material.shininess"));
+	uniformDrawLights = registry.Find(UniformHash("drawLights"));
+	uniformDrawLightmap = registry.Find(UniformHash("drawLightmap"));
+
+	// GLSL 330 has no binding qualifier, so blocks are bound here
+	GLint cameraBlockIndex = registry.FindBlock(UniformHash("CameraBlock"));
+	if (cameraBlockIndex >= 0)
 	{
-		char locBuff[100] = { '\0' };
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.colour", i);
-		uniformSpotLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.ambientIntensity", i);
-		uniformSpotLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.diffuseIntensity", i);
-		uniformSpotLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.position", i);
-		uniformSpotLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
+		glUniformBlockBinding(shaderID, cameraBlockIndex, CAMERA_BLOCK_BINDING);
+	}
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.constant", i);
-		uniformSpotLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
+	GLint drawBlockIndex = registry.FindBlock(UniformHash("DrawBlock"));
+	hasDrawBlock = drawBlockIndex >= 0;
+	if (hasDrawBlock)
+	{
+		glUniformBlockBinding(shaderID, drawBlockIndex, DRAW_BLOCK_BINDING);
+	}
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.linear", i);
-		uniformSpotLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
+	uniformPointLightCount = registry.Find(UniformHash("pointLightCount"));
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.exponent", i);
-		uniformSpotLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
+	for (unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+	{
+		uniformPointLight[i].uniformColour = registry.Find(POINT_COLOUR, i);
+		uniformPointLight[i].uniformAmbientIntensity = registry.Find(POINT_AMBIENT_INTENSITY, i);
+		uniformPointLight[i].uniformDiffuseIntensity = registry.Find(POINT_DIFFUSE_INTENSITY, i);
+		uniformPointLight[i].uniformPosition = registry.Find(POINT_POSITION, i);
+		uniformPointLight[i].uniformConstant = registry.Find(POINT_CONSTANT, i);
+		uniformPointLight[i].uniformLinear = registry.Find(POINT_LINEAR, i);
+		uniformPointLight[i].uniformExponent = registry.Find(POINT_EXPONENT, i);
+	}
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].direction", i);
-		uniformSpotLight[i].uniformDirection = glGetUniformLocation(shaderID, locBuff);
+	uniformSpotLightCount = registry.Find(UniformHash("spotLightCount"));
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].edge", i);
-		uniformSpotLight[i].uniformEdge = glGetUniformLocation(shaderID, locBuff);
+	for (unsigned int i = 0; i < MAX_SPOT_LIGHTS; i++)
+	{
+		uniformSpotLight[i].uniformColour = registry.Find(SPOT_COLOUR, i);
+		uniformSpotLight[i].uniformAmbientIntensity = registry.Find(SPOT_AMBIENT_INTENSITY, i);
+		uniformSpotLight[i].uniformDiffuseIntensity = registry.Find(SPOT_DIFFUSE_INTENSITY, i);
+		uniformSpotLight[i].uniformPosition = registry.Find(SPOT_POSITION, i);
+		uniformSpotLight[i].uniformConstant = registry.Find(SPOT_CONSTANT, i);
+		uniformSpotLight[i].uniformLinear = registry.Find(SPOT_LINEAR, i);
+		uniformSpotLight[i].uniformExponent = registry.Find(SPOT_EXPONENT, i);
+		uniformSpotLight[i].uniformDirection = registry.Find(SPOT_DIRECTION, i);
+		uniformSpotLight[i].uniformEdge = registry.Find(SPOT_EDGE, i);
 	}
 }
 
-GLuint Shader::GetProjectionLocation()
-{
-	return uniformProjection;
-}
 GLuint Shader::GetModelLocation()
 {
 	return uniformModel;
 }
-GLuint Shader::GetViewLocation()
-{
-	return uniformView;
-}
 GLuint Shader::GetAmbientColourLocation()
 {
 	return uniformDirectionalLight.uniformColour;
@@ -190,13 +283,22 @@ GLuint Shader::GetShininessLocation()
 {
 	return uniformShininess;
 }
-GLuint Shader::GetEyePositionLocation()
+GLuint Shader::GetDrawLightsLocation()
 {
-	return uniformEyePosition;
+	return uniformDrawLights;
+}
+GLuint Shader::GetDrawLightmapLocation()
+{
+	return uniformDrawLightmap;
 }
 
 void Shader::SetDirectionalLight(DirectionalLight * dLight)
 {
+	if (!NeedsUpload(uploadedDirectionalLight, *dLight))
+	{
+		return;
+	}
+
 	dLight->UseLight(uniformDirectionalLight.uniformAmbientIntensity, uniformDirectionalLight.uniformColour,
 		uniformDirectionalLight.uniformDiffuseIntensity, uniformDirectionalLight.uniformDirection);
 }
@@ -205,10 +307,19 @@ void Shader::SetPointLights(PointLight * pLight, unsigned int lightCount)
 {
 	if (lightCount > MAX_POINT_LIGHTS) lightCount = MAX_POINT_LIGHTS;
 
-	glUniform1i(uniformPointLightCount, lightCount);
+	if (uploadedPointLightCount != (int)lightCount)
+	{
+		glUniform1i(uniformPointLightCount, lightCount);
+		uploadedPointLightCount = lightCount;
+	}
 
 	for (size_t i = 0; i < lightCount; i++)
 	{
+		if (!NeedsUpload(uploadedPointLight[i], pLight[i]))
+		{
+			continue;
+		}
+
 		pLight[i].UseLight(uniformPointLight[i].uniformAmbientIntensity, uniformPointLight[i].uniformColour,
 			uniformPointLight[i].uniformDiffuseIntensity, uniformPointLight[i].uniformPosition,
 			uniformPointLight[i].uniformConstant, uniformPointLight[i].uniformLinear, uniformPointLight[i].uniformExponent);
@@ -219,10 +330,19 @@ void Shader::SetSpotLights(SpotLight * sLight, unsigned int lightCount)
 {
 	if (lightCount > MAX_SPOT_LIGHTS) lightCount = MAX_SPOT_LIGHTS;
 
-	glUniform1i(uniformSpotLightCount, lightCount);
+	if (uploadedSpotLightCount != (int)lightCount)
+	{
+		glUniform1i(uniformSpotLightCount, lightCount);
+		uploadedSpotLightCount = lightCount;
+	}
 
 	for (size_t i = 0; i < lightCount; i++)
 	{
+		if (!NeedsUpload(uploadedSpotLight[i], sLight[i]))
+		{
+			continue;
+		}
+
 		sLight[i].UseLight(uniformSpotLight[i].uniformAmbientIntensity, uniformSpotLight[i].uniformColour,
 			uniformSpotLight[i].uniformDiffuseIntensity, uniformSpotLight[i].uniformPosition, uniformSpotLight[i].uniformDirection,
 			uniformSpotLight[i].uniformConstant, uniformSpotLight[i].uniformLinear, uniformSpotLight[i].uniformExponent,
@@ -230,13 +350,52 @@ void Shader::SetSpotLights(SpotLight * sLight, unsigned int lightCount)
 	}
 }
 
+bool Shader::NeedsUpload(UploadedLight& uploaded, Light& light)
+{
+	if (uploaded.id == light.GetId() && uploaded.version == light.GetVersion())
+	{
+		return false;
+	}
+
+	uploaded.id = light.GetId();
+	uploaded.version = light.GetVersion();
+	return true;
+}
+
+void Shader::ResetUploadedLights()
+{
+	// Light ids start at 1, so 0 never matches and forces the first upload
+	uploadedDirectionalLight.id = 0;
+	uploadedDirectionalLight.version = 0;
+
+	for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
+	{
+		uploadedPointLight[i].id = 0;
+		uploadedPointLight[i].version = 0;
+	}
+
+	for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
+	{
+		uploadedSpotLight[i].id = 0;
+		uploadedSpotLight[i].version = 0;
+	}
+
+	uploadedPointLightCount = -1;
+	uploadedSpotLightCount = -1;
+}
+
 void Shader::UseShader()
 {
+	FinishCompile();
 	glUseProgram(shaderID);
 }
 
 void Shader::ClearShader()
 {
+	ReleaseShaders();
+	compilePending = false;
+	hasDrawBlock = false;
+
 	if (shaderID != 0)
 	{
 		glDeleteProgram(shaderID);
@@ -244,11 +403,13 @@ void Shader::ClearShader()
 	}
 
 	uniformModel = 0;
-	uniformProjection = 0;
+
+	registry.Clear();
+	ResetUploadedLights();
 }
 
 
-void Shader::AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType)
+void Shader::AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType, int slot)
 {
 	GLuint theShader = glCreateShader(shaderType);
 
@@ -261,18 +422,45 @@ void Shader::AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderT
 	glShaderSource(theShader, 1, theCode, codeLength);
 	glCompileShader(theShader);
 
+	glAttachShader(theProgram, theShader);
+	attachedShaders[slot] = theShader;
+}
+
+void Shader::PrintShaderLog(GLuint theShader)
+{
+	if (theShader == 0)
+	{
+		return;
+	}
+
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
 	glGetShaderiv(theShader, GL_COMPILE_STATUS, &result);
 	if (!result)
 	{
+		GLint shaderType = 0;
+		glGetShaderiv(theShader, GL_SHADER_TYPE, &shaderType);
+
 		glGetShaderInfoLog(theShader, sizeof(eLog), NULL, eLog);
 		printf("Error compiling the %d shader: '%s'\n", shaderType, eLog);
-		return;
 	}
+}
 
-	glAttachShader(theProgram, theShader);
+void Shader::ReleaseShaders()
+{
+	for (size_t i = 0; i < 3; i++)
+	{
+		if (attachedShaders[i] != 0)
+		{
+			if (shaderID != 0)
+			{
+				glDetachShader(shaderID, attachedShaders[i]);
+			}
+			glDeleteShader(attachedShaders[i]);
+			attachedShaders[i] = 0;
+		}
+	}
 }
 
 Shader::~Shader()
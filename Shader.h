@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -8,6 +9,8 @@
 #include <GL\glew.h>
 
 #include "CommonValues.h"
+#include "ShaderCache.h"
+#include "UniformRegistry.h"
 
 #include "DirectionalLight.h"
 #include "PointLight.h"
@@ -18,21 +21,28 @@ class Shader
 public:
 	Shader();
 
-	void CreateFromString(const char* vertexCode, const char* fragmentCode);
-	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation);
+	void CreateFromString(const char* vertexCode, const char* fragmentCode, const std::string& defines = "");
+	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation, const std::string& defines = "");
+	// With a geometry stage between the two, e.g. to fan triangles out to several layers
+	void CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation, const std::string& defines);
 
 	std::string ReadFile(const char* fileLocation);
+	std::string InjectDefines(const std::string& code, const std::string& defines);
+
+	void FinishCompile();
 
-	GLuint GetProjectionLocation();
 	GLuint GetModelLocation();
-	GLuint GetViewLocation();
 	GLuint GetAmbientIntensityLocation();
 	GLuint GetAmbientColourLocation();
 	GLuint GetDiffuseIntensityLocation();
 	GLuint GetDirectionLocation();
 	GLuint GetSpecularIntensityLocation();
 	GLuint GetShininessLocation();
-	GLuint GetEyePositionLocation();
+	GLuint GetDrawLightsLocation();
+	GLuint GetDrawLightmapLocation();
+	bool HasDrawBlock() { return hasDrawBlock; }
+	// Uniforms the fixed getters don't cover; valid once the shader has been used
+	GLint GetUniformLocation(unsigned int nameHash, unsigned int index = 0) { return registry.Find(nameHash, index); }
 
 	void SetDirectionalLight(DirectionalLight * dLight);
 	void SetPointLights(PointLight * pLight, unsigned int lightCount);
@@ -44,11 +54,18 @@ public:
 	~Shader();
 
 private:
+	ShaderCache cache;
+	UniformRegistry registry;
+	std::string cacheKey;
+	bool compilePending;
+	bool hasDrawBlock;
+	GLuint attachedShaders[3];
+
 	int pointLightCount;
 	int spotLightCount;
 
-	GLuint shaderID, uniformProjection, uniformModel, uniformView, uniformEyePosition,
-		uniformSpecularIntensity, uniformShininess;
+	GLuint shaderID, uniformModel,
+		uniformSpecularIntensity, uniformShininess, uniformDrawLights, uniformDrawLightmap;
 
 	struct {
 		GLuint uniformColour;
@@ -87,7 +104,26 @@ private:
 		GLuint uniformEdge;
 	} uniformSpotLight[MAX_SPOT_LIGHTS];
 
-	void CompileShader(const char* vertexCode, const char* fragmentCode);
-	void AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType);
+	// Uniform values live in the program object, so what was last written
+	// to it is remembered here and unchanged lights are not sent again
+	struct UploadedLight {
+		unsigned int id;
+		unsigned int version;
+	};
+
+	UploadedLight uploadedDirectionalLight;
+	UploadedLight uploadedPointLight[MAX_POINT_LIGHTS];
+	UploadedLight uploadedSpotLight[MAX_SPOT_LIGHTS];
+	int uploadedPointLightCount;
+	int uploadedSpotLightCount;
+
+	void ResetUploadedLights();
+	bool NeedsUpload(UploadedLight& uploaded, Light& light);
+
+	void CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode, const std::string& defines);
+	void AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType, int slot);
+	void PrintShaderLog(GLuint theShader);
+	void ReleaseShaders();
+	void GetUniformLocations();
 };
 
@@ -0,0 +1,163 @@
+#include "ShaderCache.h"
+
+static const unsigned int CACHE_MAGIC = 0x43535244; // "RDSC"
+static const unsigned int CACHE_VERSION = 1;
+
+struct CacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	GLenum format;
+	GLint length;
+};
+
+static unsigned long long HashAppend(unsigned long long hash, const char* data, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	// Separator so that ("ab", "c") and ("a", "bc") hash differently
+	hash ^= 0xFF;
+	hash *= 1099511628211ULL;
+
+	return hash;
+}
+
+static unsigned long long HashAppend(unsigned long long hash, const GLubyte* glString)
+{
+	const char* text = glString ? (const char*)glString : "";
+	return HashAppend(hash, text, strlen(text));
+}
+
+ShaderCache::ShaderCache()
+{
+	cacheLocation = "Shaders/";
+}
+
+ShaderCache::ShaderCache(const char* cacheLocation)
+{
+	this->cacheLocation = cacheLocation;
+}
+
+bool ShaderCache::IsSupported()
+{
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+	{
+		return false;
+	}
+
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+
+	return formatCount > 0;
+}
+
+std::string ShaderCache::BuildKey(const std::string& vertexCode, const std::string& fragmentCode, const std::string& defines)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	hash = HashAppend(hash, vertexCode.c_str(), vertexCode.size());
+	hash = HashAppend(hash, fragmentCode.c_str(), fragmentCode.size());
+	hash = HashAppend(hash, defines.c_str(), defines.size());
+
+	// A binary is only valid for the exact driver that produced it
+	hash = HashAppend(hash, glGetString(GL_VENDOR));
+	hash = HashAppend(hash, glGetString(GL_RENDERER));
+	hash = HashAppend(hash, glGetString(GL_VERSION));
+
+	char keyBuff[32] = { '\0' };
+	snprintf(keyBuff, sizeof(keyBuff), "%016llx", hash);
+
+	return std::string(keyBuff);
+}
+
+bool ShaderCache::LoadProgram(GLuint program, const std::string& key)
+{
+	std::string fileLocation = GetFileLocation(key);
+
+	FILE* file = fopen(fileLocation.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	bool headerRead = fread(&header, sizeof(header), 1, file) == 1;
+
+	if (!headerRead || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.length <= 0)
+	{
+		fclose(file);
+		return false;
+	}
+
+	std::vector<char> binary(header.length);
+	bool binaryRead = fread(&binary[0], 1, header.length, file) == (size_t)header.length;
+	fclose(file);
+
+	if (!binaryRead)
+	{
+		return false;
+	}
+
+	glProgramBinary(program, header.format, &binary[0], header.length);
+
+	GLint result = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (!result)
+	{
+		printf("Cached shader binary %s rejected by driver, recompiling.\n", fileLocation.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void ShaderCache::SaveProgram(GLuint program, const std::string& key)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &written, &format, &binary[0]);
+	if (written <= 0)
+	{
+		return;
+	}
+
+	std::string fileLocation = GetFileLocation(key);
+
+	FILE* file = fopen(fileLocation.c_str(), "wb");
+	if (!file)
+	{
+		printf("Failed to write shader cache %s\n", fileLocation.c_str());
+		return;
+	}
+
+	CacheHeader header;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.format = format;
+	header.length = written;
+
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&binary[0], 1, written, file);
+	fclose(file);
+}
+
+std::string ShaderCache::GetFileLocation(const std::string& key)
+{
+	return cacheLocation + "cache_" + key + ".bin";
+}
+
+ShaderCache::~ShaderCache()
+{
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <GL\glew.h>
+
+class ShaderCache
+{
+public:
+	ShaderCache();
+	ShaderCache(const char* cacheLocation);
+
+	bool IsSupported();
+
+	std::string BuildKey(const std::string& vertexCode, const std::string& fragmentCode, const std::string& defines);
+
+	bool LoadProgram(GLuint program, const std::string& key);
+	void SaveProgram(GLuint program, const std::string& key);
+
+	~ShaderCache();
+
+private:
+	std::string cacheLocation;
+
+	std::string GetFileLocation(const std::string& key);
+};
+
@@ -0,0 +1,100 @@
+#include "ShaderLibrary.h"
+
+ShaderLibrary::ShaderLibrary()
+{
+}
+
+void ShaderLibrary::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation)
+{
+	Shader reader;
+	vertexCode = reader.ReadFile(vertexLocation);
+	fragmentCode = reader.ReadFile(fragmentLocation);
+}
+
+Shader* ShaderLibrary::GetVariant(const ShaderFeatures& features)
+{
+	unsigned int key = MakeKey(features);
+
+	std::map<unsigned int, Shader*>::iterator it = variants.find(key);
+	if (it != variants.end())
+	{
+		return it->second;
+	}
+
+	std::string defines = MakeDefines(features);
+
+	Shader* variant = new Shader();
+	variant->CreateFromString(vertexCode.c_str(), fragmentCode.c_str(), defines);
+	variants[key] = variant;
+
+	return variant;
+}
+
+void ShaderLibrary::ClearLibrary()
+{
+	for (std::map<unsigned int, Shader*>::iterator it = variants.begin(); it != variants.end(); ++it)
+	{
+		delete it->second;
+	}
+
+	variants.clear();
+}
+
+unsigned int ShaderLibrary::MakeKey(const ShaderFeatures& features)
+{
+	unsigned int pointLights = features.pointLightCount > MAX_POINT_LIGHTS ? MAX_POINT_LIGHTS : features.pointLightCount;
+	unsigned int spotLights = features.spotLightCount > MAX_SPOT_LIGHTS ? MAX_SPOT_LIGHTS : features.spotLightCount;
+
+	return pointLights | (spotLights << 8) |
+		(features.directionalLight ? 1u << 16 : 0) |
+		(features.shadows ? 1u << 17 : 0) |
+		(features.specular ? 1u << 18 : 0) |
+		(features.drawBlock ? 1u << 19 : 0) |
+		(features.lightLists ? 1u << 20 : 0) |
+		(features.lightmap ? 1u << 21 : 0) |
+		(features.spotShadows ? 1u << 22 : 0) |
+		(features.pointShadows ? 1u << 23 : 0) |
+		((features.shadowFilter & 3u) << 24) |
+		((features.shadowTaps & 31u) << 26) |
+		(features.ambientOcclusion ? 1u << 31 : 0);
+}
+
+std::string ShaderLibrary::MakeDefines(const ShaderFeatures& features)
+{
+	unsigned int pointLights = features.pointLightCount > MAX_POINT_LIGHTS ? MAX_POINT_LIGHTS : features.pointLightCount;
+	unsigned int spotLights = features.spotLightCount > MAX_SPOT_LIGHTS ? MAX_SPOT_LIGHTS : features.spotLightCount;
+
+	char defineBuff[512] = { '\0' };
+	snprintf(defineBuff, sizeof(defineBuff),
+		"#define POINT_LIGHT_COUNT %u\n"
+		"#define SPOT_LIGHT_COUNT %u\n"
+		"#define DIRECTIONAL_LIGHT_ENABLED %d\n"
+		"#define SHADOWS_ENABLED %d\n"
+		"#define SPECULAR_ENABLED %d\n"
+		"#define DRAW_BLOCK_ENABLED %d\n"
+		"#define LIGHT_LISTS_ENABLED %d\n"
+		"#define LIGHTMAP_ENABLED %d\n"
+		"#define SPOT_SHADOWS_ENABLED %d\n"
+		"#define POINT_SHADOWS_ENABLED %d\n"
+		"#define SHADOW_FILTER %u\n"
+		"#define SHADOW_TAPS %u\n"
+		"#define AMBIENT_OCCLUSION_ENABLED %d\n",
+		pointLights, spotLights,
+		features.directionalLight ? 1 : 0,
+		features.shadows ? 1 : 0,
+		features.specular ? 1 : 0,
+		features.drawBlock ? 1 : 0,
+		features.lightLists ? 1 : 0,
+		features.lightmap ? 1 : 0,
+		features.spotShadows ? 1 : 0,
+		features.pointShadows ? 1 : 0,
+		features.shadowFilter,
+		features.shadowTaps,
+		features.ambientOcclusion ? 1 : 0);
+
+	return std::string(defineBuff);
+}
+
+ShaderLibrary::~ShaderLibrary()
+{
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Shader.h"
+
+// How shadow maps are filtered; matches SHADOW_FILTER in shader.frag
+enum ShadowFilter
+{
+	SHADOW_FILTER_GRID,		// hardware-compared taps on a rotated square grid
+	SHADOW_FILTER_POISSON,	// hardware-compared taps on a Poisson disk, turned per pixel
+	SHADOW_FILTER_EVSM		// prefiltered exponential moments for the cascades; spot lights use the grid
+};
+
+// Most taps either kernel takes
+const unsigned int MAX_SHADOW_TAPS = 16;
+
+struct ShaderFeatures
+{
+	unsigned int pointLightCount;
+	unsigned int spotLightCount;
+	bool directionalLight;
+	bool shadows;
+	bool specular;
+	bool drawBlock;		// per-draw data comes from a uniform buffer instead of plain uniforms
+	bool lightLists;	// loop over each draw's own light list instead of every light
+	bool lightmap;		// lightmapped draws read the baked lighting instead of the light loop
+	bool spotShadows;	// spot lights sample their tiles in the shadow atlas
+	bool pointShadows;	// point lights sample their cube shadow maps
+	unsigned int shadowFilter;	// a ShadowFilter
+	unsigned int shadowTaps;	// 1 - MAX_SHADOW_TAPS, a square for the grid
+	bool ambientOcclusion;	// ambient light is scaled by the screen-space occlusion
+};
+
+class ShaderLibrary
+{
+public:
+	ShaderLibrary();
+
+	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation);
+
+	Shader* GetVariant(const ShaderFeatures& features);
+	size_t GetVariantCount() { return variants.size(); }
+
+	void ClearLibrary();
+
+	~ShaderLibrary();
+
+private:
+	std::string vertexCode;
+	std::string fragmentCode;
+
+	std::map<unsigned int, Shader*> variants;
+
+	static unsigned int MakeKey(const ShaderFeatures& features);
+	static std::string MakeDefines(const ShaderFeatures& features);
+};
+
@@ -0,0 +1,523 @@
+#include "ShadowAtlas.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\type_ptr.hpp>
+
+// One perspective map covers cones up to 80 degrees either side of the axis
+static const float MIN_CONE_COS = 0.17f;
+// Far plane of a spot light's map; the spot lights' ranges reach well past the room
+static const float MAX_SHADOW_RANGE = 30.0f;
+static const float SHADOW_NEAR_PLANE = 0.05f;
+
+static constexpr unsigned int MODEL = UniformHash("model");
+static constexpr unsigned int LIGHT_TRANSFORM = UniformHash("lightTransform");
+static constexpr unsigned int SPOT_SHADOW_ATLAS = UniformHash("spotShadowAtlas");
+static constexpr unsigned int SPOT_SHADOW_TRANSFORMS = UniformHash("spotShadowTransforms[]");
+static constexpr unsigned int SPOT_SHADOW_TILES = UniformHash("spotShadowTiles[]");
+
+ShadowAtlas::ShadowAtlas()
+{
+	FBO = 0;
+	depthTexture = 0;
+	atlasSize = 0;
+	updateBudget = 0;
+
+	pendingUpdates = 0;
+	tilesRendered = 0;
+	frameSpotLightCount = 0;
+
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		tiles[t].lightId = 0;
+		tiles[t].frameIndex = -1;
+		tiles[t].requestedSize = 0;
+		tiles[t].x = 0;
+		tiles[t].y = 0;
+		tiles[t].size = 0;
+		tiles[t].drawn = false;
+		tiles[t].stale = false;
+	}
+}
+
+void ShadowAtlas::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation, GLsizei size, unsigned int updateBudget)
+{
+	atlasSize = size;
+	this->updateBudget = updateBudget;
+
+	shader.CreateFromFiles(vertexLocation, fragmentLocation);
+}
+
+bool ShadowAtlas::CreateTargets()
+{
+	if (FBO != 0)
+	{
+		return true;
+	}
+
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, atlasSize, atlasSize, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	// Read through a comparison sampler: each lookup is a filtered 2x2 PCF
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Shadow atlas framebuffer error: 0x%x\n", status);
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteTextures(1, &depthTexture);
+		FBO = 0;
+		depthTexture = 0;
+		// No spot shadows from now on, rather than retrying every frame
+		updateBudget = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool ShadowAtlas::Update(FrameState& frame, const glm::mat4& viewProjection, GLfloat fov, const std::vector<unsigned int>& movedObjects, const BVH& bvh)
+{
+	frameSpotLightCount = frame.spotLightCount;
+	if (updateBudget == 0 || !CreateTargets())
+	{
+		pendingUpdates = 0;
+		return false;
+	}
+
+	// Which of the frame's spot lights get a tile, and how much of the screen each one covers
+	Frustum view(viewProjection);
+	float tanHalfFov = std::tan(fov * 0.5f);
+	float importance[MAX_SPOT_LIGHTS];
+
+	for (unsigned int i = 0; i < frame.spotLightCount; i++)
+	{
+		SpotLight& light = frame.spotLights[i];
+		importance[i] = -1.0f;
+
+		glm::vec3 axis;
+		GLfloat coneCos;
+		light.GetCone(axis, coneCos);
+		AABB bounds = light.GetBounds();
+		if (coneCos < MIN_CONE_COS || light.GetRange() <= 0.0f || bounds.IsEmpty() || !view.Intersects(bounds))
+		{
+			continue;
+		}
+
+		float radius = 0.5f * glm::length(bounds.GetExtent());
+		float distance = glm::length(bounds.GetCentre() - frame.eyePosition);
+		importance[i] = distance <= radius ? 1.0f : std::min(radius / (distance * tanHalfFov), 1.0f);
+	}
+
+	// Tiles of lights that are off or out of view go back to the atlas
+	bool repack = false;
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		Tile& tile = tiles[t];
+		tile.frameIndex = -1;
+
+		bool kept = false;
+		for (unsigned int i = 0; i < frame.spotLightCount && !kept; i++)
+		{
+			kept = importance[i] >= 0.0f && frame.spotLights[i].GetId() == tile.lightId;
+		}
+
+		if (tile.lightId != 0 && !kept)
+		{
+			tile.lightId = 0;
+			tile.size = 0;
+			tile.drawn = false;
+			tile.casters.clear();
+			repack = true;
+		}
+	}
+
+	for (unsigned int i = 0; i < frame.spotLightCount; i++)
+	{
+		if (importance[i] < 0.0f)
+		{
+			continue;
+		}
+
+		SpotLight& light = frame.spotLights[i];
+
+		Tile* tile = nullptr;
+		for (unsigned int t = 0; t < MAX_SPOT_LIGHTS && !tile; t++)
+		{
+			tile = tiles[t].lightId == light.GetId() ? &tiles[t] : nullptr;
+		}
+		for (unsigned int t = 0; t < MAX_SPOT_LIGHTS && !tile; t++)
+		{
+			tile = tiles[t].lightId == 0 ? &tiles[t] : nullptr;
+		}
+
+		if (tile->lightId == 0)
+		{
+			tile->lightId = light.GetId();
+			tile->placementVersion = light.GetPlacementVersion();
+			tile->requestedSize = 0;
+			tile->size = 0;
+			tile->drawn = false;
+			tile->stale = true;
+		}
+
+		// Colour and intensity edits don't change the map
+		if (tile->placementVersion != light.GetPlacementVersion())
+		{
+			tile->placementVersion = light.GetPlacementVersion();
+			tile->stale = true;
+		}
+
+		tile->frameIndex = (int)i;
+		tile->importance = importance[i];
+
+		// Grows straight away, but only shrinks once it is a quarter of the size it needs to be,
+		// so a light at the edge of a size doesn't keep moving the other tiles around
+		GLsizei wanted = MIN_TILE_SIZE;
+		while (wanted < atlasSize / 2 && wanted < importance[i] * atlasSize)
+		{
+			wanted *= 2;
+		}
+		if (wanted > tile->requestedSize || wanted * 4 <= tile->requestedSize)
+		{
+			tile->requestedSize = wanted;
+		}
+		repack = repack || tile->requestedSize != tile->size;
+
+		glm::vec3 axis;
+		GLfloat coneCos;
+		light.GetCone(axis, coneCos);
+		glm::vec3 position = light.GetPosition();
+		glm::vec3 up = std::fabs(axis.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		GLfloat range = std::min(light.GetRange(), MAX_SHADOW_RANGE);
+
+		// A little wider than the cone, so filtering at its edge stays inside the map
+		glm::mat4 projection = glm::perspective(2.0f * std::acos(coneCos) + glm::radians(2.0f), 1.0f, SHADOW_NEAR_PLANE, range);
+		tile->lightTransform = projection * glm::lookAt(position, position + axis, up);
+	}
+
+	// A caster that moved may have left a tile as well as entered one, so both what was drawn
+	// and what the light sees now are checked
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		Tile& tile = tiles[t];
+		if (tile.frameIndex < 0 || tile.stale || movedObjects.empty())
+		{
+			continue;
+		}
+
+		Frustum lightFrustum(tile.lightTransform);
+		for (size_t m = 0; m < movedObjects.size() && !tile.stale; m++)
+		{
+			tile.stale = std::binary_search(tile.casters.begin(), tile.casters.end(), movedObjects[m]) ||
+				lightFrustum.Intersects(bvh.GetItemBounds(movedObjects[m]));
+		}
+	}
+
+	if (repack)
+	{
+		PackTiles();
+	}
+
+	bool anyTile = false;
+	pendingUpdates = 0;
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		if (tiles[t].frameIndex >= 0 && tiles[t].size > 0)
+		{
+			anyTile = true;
+			pendingUpdates += tiles[t].stale ? 1 : 0;
+		}
+	}
+
+	return anyTile;
+}
+
+void ShadowAtlas::PackTiles()
+{
+	Tile* order[MAX_SPOT_LIGHTS];
+	unsigned int count = 0;
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		if (tiles[t].frameIndex >= 0)
+		{
+			order[count++] = &tiles[t];
+		}
+	}
+	std::sort(order, order + count, TilePacksFirst);
+
+	freeSquares.clear();
+	FreeSquare atlas = { 0, 0, atlasSize };
+	freeSquares.push_back(atlas);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Tile& tile = *order[i];
+
+		// Halved until it fits; only when even the smallest tile doesn't is the light left without a map
+		GLsizei size = tile.requestedSize;
+		GLint x = tile.x, y = tile.y;
+		bool placed = Allocate(size, x, y);
+		while (!placed && size > MIN_TILE_SIZE)
+		{
+			size /= 2;
+			x = tile.x;
+			y = tile.y;
+			placed = Allocate(size, x, y);
+		}
+		if (!placed)
+		{
+			size = 0;
+		}
+
+		// Most tiles land where they were and keep their maps
+		if (size != tile.size || x != tile.x || y != tile.y)
+		{
+			tile.x = x;
+			tile.y = y;
+			tile.size = size;
+			tile.drawn = false;
+			tile.stale = true;
+		}
+	}
+}
+
+bool ShadowAtlas::Allocate(GLsizei size, GLint& x, GLint& y)
+{
+	// The smallest square that fits, unless one still holds the given place
+	int best = -1;
+	bool keepsPlace = false;
+	for (size_t i = 0; i < freeSquares.size(); i++)
+	{
+		const FreeSquare& square = freeSquares[i];
+		if (square.size < size)
+		{
+			continue;
+		}
+
+		bool holdsPlace = x >= square.x && x < square.x + square.size && y >= square.y && y < square.y + square.size;
+		if (best < 0 || (holdsPlace && !keepsPlace) || (holdsPlace == keepsPlace && square.size < freeSquares[best].size))
+		{
+			best = (int)i;
+			keepsPlace = holdsPlace;
+		}
+	}
+
+	if (best < 0)
+	{
+		return false;
+	}
+
+	FreeSquare square = freeSquares[best];
+	freeSquares.erase(freeSquares.begin() + best);
+
+	// Keep the quarter towards the given place until it is the right size, freeing the other three
+	while (square.size > size)
+	{
+		GLsizei half = square.size / 2;
+		GLint keepX = keepsPlace && x >= square.x + half ? square.x + half : square.x;
+		GLint keepY = keepsPlace && y >= square.y + half ? square.y + half : square.y;
+		for (int q = 0; q < 4; q++)
+		{
+			FreeSquare quarter = { square.x + (q & 1) * half, square.y + (q >> 1) * half, half };
+			if (quarter.x != keepX || quarter.y != keepY)
+			{
+				freeSquares.push_back(quarter);
+			}
+		}
+		square.x = keepX;
+		square.y = keepY;
+		square.size = half;
+	}
+
+	x = square.x;
+	y = square.y;
+	return true;
+}
+
+void ShadowAtlas::Render(const Scene& scene, const BVH& bvh, GLint viewportWidth, GLint viewportHeight)
+{
+	tilesRendered = 0;
+
+	Tile* order[MAX_SPOT_LIGHTS];
+	unsigned int count = 0;
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		if (tiles[t].frameIndex >= 0 && tiles[t].size > 0 && tiles[t].stale)
+		{
+			order[count++] = &tiles[t];
+		}
+	}
+
+	if (FBO == 0 || count == 0)
+	{
+		return;
+	}
+
+	std::sort(order, order + count, TileDrawsFirst);
+	count = std::min(count, updateBudget);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glEnable(GL_SCISSOR_TEST);
+	// Slope-scaled offset instead of a shader bias, as perspective depth isn't linear
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	shader.UseShader();
+	GLint uniformModel = shader.GetUniformLocation(MODEL);
+	GLint uniformLightTransform = shader.GetUniformLocation(LIGHT_TRANSFORM);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Tile& tile = *order[i];
+
+		glViewport(tile.x, tile.y, tile.size, tile.size);
+		glScissor(tile.x, tile.y, tile.size, tile.size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		glUniformMatrix4fv(uniformLightTransform, 1, GL_FALSE, glm::value_ptr(tile.lightTransform));
+
+		tileCasters.clear();
+		bvh.QueryFrustum(Frustum(tile.lightTransform), tileCasters);
+		for (size_t c = 0; c < tileCasters.size(); c++)
+		{
+			const SceneObject& object = scene.GetObject(tileCasters[c]);
+			glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(object.transform));
+
+			if (object.type == SCENE_OBJECT_MESH)
+			{
+				scene.GetMesh(object.resource)->RenderDepth();
+			}
+			else
+			{
+				scene.GetModel(object.resource)->RenderDepth();
+			}
+		}
+
+		std::sort(tileCasters.begin(), tileCasters.end());
+		tile.casters = tileCasters;
+		tile.drawnTransform = tile.lightTransform;
+		tile.drawn = true;
+		tile.stale = false;
+		tilesRendered++;
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+
+	pendingUpdates -= tilesRendered;
+}
+
+void ShadowAtlas::UseAtlas(Shader* shader)
+{
+	glActiveTexture(GL_TEXTURE0 + SPOT_SHADOW_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// Indexed like the frame's spot lights; an empty rectangle means no map (yet)
+	glm::mat4 transforms[MAX_SPOT_LIGHTS];
+	glm::vec4 rects[MAX_SPOT_LIGHTS];
+	for (unsigned int i = 0; i < MAX_SPOT_LIGHTS; i++)
+	{
+		transforms[i] = glm::mat4(1.0f);
+		rects[i] = glm::vec4(0.0f);
+	}
+
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		const Tile& tile = tiles[t];
+		if (tile.frameIndex < 0 || tile.frameIndex >= (int)frameSpotLightCount || !tile.drawn)
+		{
+			continue;
+		}
+
+		// Clip space straight to the tile's part of the atlas, depth to 0-1
+		float scale = (float)tile.size / atlasSize;
+		glm::vec2 origin((float)tile.x / atlasSize, (float)tile.y / atlasSize);
+		glm::mat4 toTile(1.0f);
+		toTile[0][0] = 0.5f * scale;
+		toTile[1][1] = 0.5f * scale;
+		toTile[2][2] = 0.5f;
+		toTile[3] = glm::vec4(origin + glm::vec2(0.5f * scale), 0.5f, 1.0f);
+		transforms[tile.frameIndex] = toTile * tile.drawnTransform;
+
+		// Filter taps are clamped half a texel inside, so they never read a neighbouring tile
+		float halfTexel = 0.5f / atlasSize;
+		rects[tile.frameIndex] = glm::vec4(origin + glm::vec2(halfTexel), origin + glm::vec2(scale - halfTexel));
+	}
+
+	glUniform1i(shader->GetUniformLocation(SPOT_SHADOW_ATLAS), SPOT_SHADOW_TEXTURE_UNIT);
+	glUniformMatrix4fv(shader->GetUniformLocation(SPOT_SHADOW_TRANSFORMS, 0), MAX_SPOT_LIGHTS, GL_FALSE, glm::value_ptr(transforms[0]));
+	glUniform4fv(shader->GetUniformLocation(SPOT_SHADOW_TILES, 0), MAX_SPOT_LIGHTS, glm::value_ptr(rects[0]));
+}
+
+void ShadowAtlas::ClearAtlas()
+{
+	if (FBO != 0)
+	{
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+	}
+
+	if (depthTexture != 0)
+	{
+		glDeleteTextures(1, &depthTexture);
+		depthTexture = 0;
+	}
+
+	shader.ClearShader();
+
+	for (unsigned int t = 0; t < MAX_SPOT_LIGHTS; t++)
+	{
+		tiles[t].lightId = 0;
+		tiles[t].frameIndex = -1;
+		tiles[t].size = 0;
+		tiles[t].drawn = false;
+		tiles[t].casters.clear();
+	}
+	pendingUpdates = 0;
+}
+
+bool ShadowAtlas::TilePacksFirst(const Tile* a, const Tile* b)
+{
+	if (a->requestedSize != b->requestedSize)
+	{
+		return a->requestedSize > b->requestedSize;
+	}
+
+	// Light ids break ties so the order, and with it every tile's place, is stable
+	return a->lightId < b->lightId;
+}
+
+bool ShadowAtlas::TileDrawsFirst(const Tile* a, const Tile* b)
+{
+	if (a->drawn != b->drawn)
+	{
+		return !a->drawn;
+	}
+
+	return a->importance > b->importance;
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+}
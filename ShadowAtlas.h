@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include <glm\glm.hpp>
+
+#include "CommonValues.h"
+
+#include "Scene.h"
+#include "BVH.h"
+#include "Shader.h"
+#include "FrameState.h"
+
+// Spot light shadow maps sharing one depth texture. Every spot light in view
+// gets a square tile sized by how much of the screen its cone covers. A tile is
+// only drawn again once its light moves or turns, a caster inside it moves, or
+// it is placed somewhere new in the atlas, and at most updateBudget tiles are
+// drawn per frame; lights waiting for theirs keep the last map they had.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas();
+
+	// size is the atlas' width and height, a power of two
+	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation, GLsizei size, unsigned int updateBudget);
+
+	// Sizes and places the tiles for the frame's spot lights and works out which need drawing.
+	// movedObjects - objects moved since the last call. False if no spot light has a tile.
+	bool Update(FrameState& frame, const glm::mat4& viewProjection, GLfloat fov, const std::vector<unsigned int>& movedObjects, const BVH& bvh);
+	// Draws up to the budget of stale tiles, most important first, then rebinds the default
+	// framebuffer at the given viewport size
+	void Render(const Scene& scene, const BVH& bvh, GLint viewportWidth, GLint viewportHeight);
+
+	// Tiles still to draw; the next frames draw them even if nothing else changes
+	bool HasPendingUpdates() { return pendingUpdates > 0; }
+	unsigned int GetTilesRendered() { return tilesRendered; }
+
+	// For a SPOT_SHADOWS_ENABLED shader, which must be in use
+	void UseAtlas(Shader* shader);
+
+	void ClearAtlas();
+
+	~ShadowAtlas();
+
+private:
+	static const GLsizei MIN_TILE_SIZE = 128;
+
+	struct Tile
+	{
+		unsigned int lightId;		// 0 - unused
+		unsigned int placementVersion;
+		int frameIndex;				// into the frame's spot lights, -1 while not in view
+		float importance;			// share of the screen the cone covers, 0-1
+		GLsizei requestedSize;
+		GLint x, y;
+		GLsizei size;				// 0 - no place in the atlas yet
+		bool drawn;					// the tile holds a map, though maybe an out of date one
+		bool stale;
+		glm::mat4 lightTransform;	// what the light's map should be drawn with now
+		glm::mat4 drawnTransform;	// what the map in the tile was drawn with
+		std::vector<unsigned int> casters;	// sorted, as last drawn
+	};
+
+	// Free square of the atlas, split into quarters as smaller tiles are needed
+	struct FreeSquare
+	{
+		GLint x, y;
+		GLsizei size;
+	};
+
+	Shader shader;
+	GLuint FBO, depthTexture;
+	GLsizei atlasSize;
+	unsigned int updateBudget;
+
+	Tile tiles[MAX_SPOT_LIGHTS];
+	std::vector<FreeSquare> freeSquares;
+	std::vector<unsigned int> tileCasters;
+	unsigned int pendingUpdates;
+	unsigned int tilesRendered;
+	unsigned int frameSpotLightCount;
+
+	bool CreateTargets();
+	void PackTiles();
+	// x, y - where the tile was, kept if still free; set to where it goes
+	bool Allocate(GLsizei size, GLint& x, GLint& y);
+
+	// Larger tiles are placed first so the quarters never fragment; drawing starts with
+	// tiles that hold no map at all
+	static bool TilePacksFirst(const Tile* a, const Tile* b);
+	static bool TileDrawsFirst(const Tile* a, const Tile* b);
+};
@@ -42,8 +42,59 @@ void SpotLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLo
 
 void SpotLight::SetFlash(glm::vec3 pos, glm::vec3 dir)
 {
-	position = pos;
-	direction = dir;
+	if (position != pos || direction != dir)
+	{
+		position = pos;
+		direction = dir;
+		MarkMoved();
+	}
+}
+
+void SpotLight::GetCone(glm::vec3& axis, GLfloat& coneCos)
+{
+	// The keys nudge direction without normalising it, and the shader compares
+	// against the unnormalised dot product, so the cone it lights is this one
+	GLfloat length = glm::length(direction);
+	if (length <= 0.0f)
+	{
+		axis = glm::vec3(0.0f, -1.0f, 0.0f);
+		coneCos = procEdge < 0.0f ? -1.0f : 1.0f;
+		return;
+	}
+
+	axis = direction / length;
+	coneCos = glm::clamp(procEdge / length, -1.0f, 1.0f);
+}
+
+AABB SpotLight::GetBounds()
+{
+	AABB sphereBounds = PointLight::GetBounds();
+	GLfloat range = GetRange();
+
+	glm::vec3 axis;
+	GLfloat edgeCos;
+	GetCone(axis, edgeCos);
+
+	if (edgeCos >= 1.0f)
+	{
+		return AABB();
+	}
+	if (range == FLT_MAX || edgeCos <= 0.0f)
+	{
+		return sphereBounds;
+	}
+
+	// Everything lit is within range of the apex and inside the cone, so inside a cone of that height
+	GLfloat capRadius = range * sqrtf(1.0f - edgeCos * edgeCos) / edgeCos;
+	glm::vec3 capCentre = position + axis * range;
+	glm::vec3 capExtent = capRadius * glm::sqrt(glm::max(glm::vec3(1.0f) - axis * axis, glm::vec3(0.0f)));
+
+	AABB bounds(capCentre - capExtent, capCentre + capExtent);
+	bounds.Grow(position);
+
+	bounds.min = glm::max(bounds.min, sphereBounds.min);
+	bounds.max = glm::min(bounds.max, sphereBounds.max);
+	return bounds;
 }
 
 SpotLight::~SpotLight()
@@ -25,56 +25,70 @@ public:
 	void TurnSpotLight(GLfloat deltaTime, bool* keys) {
 		if (keys[GLFW_KEY_RIGHT]) {
 			position.x += 0.05;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_LEFT]) {
 			position.x -= 0.05;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_UP]) {
 			position.z -= 0.05;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_DOWN]) {
 			position.z += 0.05;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_L]) {
 			direction.x += 0.005;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_J]) {
 			direction.x -= 0.005;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_I]) {
 			direction.z -= 0.005;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_K]) {
 			direction.z += 0.005;
+			MarkMoved();
 		}
 		if (keys[GLFW_KEY_R] && keys[GLFW_KEY_EQUAL]) {
 			if (colour.r <= 1.0f) {
 				colour.r += 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_R] && keys[GLFW_KEY_MINUS]) {
 			if (colour.r >= 0.0f) {
 				colour.r -= 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_G] && keys[GLFW_KEY_EQUAL]) {
 			if (colour.g <= 1.0f) {
 				colour.g += 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_G] && keys[GLFW_KEY_MINUS]) {
 			if (colour.g >= 0.0f) {
 				colour.g -= 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_B] && keys[GLFW_KEY_EQUAL]) {
 			if (colour.b <= 1.0f) {
 				colour.b += 0.01;
+				MarkChanged();
 			}
 		}
 		if (keys[GLFW_KEY_B] && keys[GLFW_KEY_MINUS]) {
 			if (colour.b >= 0.0f) {
 				colour.b -= 0.01;
+				MarkChanged();
 			}
 		}
 	};
@@ -82,22 +96,32 @@ public:
 	void TurnOffSpotLight(bool* keys) {
 		static GLfloat buffer1Spot = this->ambientIntensity;
 		static GLfloat buffer2Spot = this->diffuseIntensity;
-		if(keys[GLFW_KEY_Y]) {
+		if(keys[GLFW_KEY_Y] && (this->ambientIntensity != buffer1Spot || this->diffuseIntensity != buffer2Spot)) {
 			this->ambientIntensity = buffer1Spot;
 			this->diffuseIntensity = buffer2Spot;
+			MarkChanged();
 		}
 
-		if (keys[GLFW_KEY_N]) {
+		if (keys[GLFW_KEY_N] && (this->ambientIntensity != 0 || this->diffuseIntensity != 0)) {
 			this->ambientIntensity = 0;
 			this->diffuseIntensity = 0;
+			MarkChanged();
 		}
 	}
 
-	void ControlSpotLight(bool* keys, SpotLight& spotlight, GLfloat deltaTime, Window& window) {
-		spotlight.TurnSpotLight(deltaTime, window.getsKeys());
-		spotlight.TurnOffSpotLight(window.getsKeys());
+	void ControlSpotLight(bool* keys, SpotLight& spotlight, GLfloat deltaTime) {
+		spotlight.TurnSpotLight(deltaTime, keys);
+		spotlight.TurnOffSpotLight(keys);
 	};
 
+	glm::vec3 GetDirection() { return direction; }
+	// Cosine of the cone's half angle, as the shader compares it
+	GLfloat GetEdgeCos() { return procEdge; }
+	// Unit axis and half-angle cosine of the cone the shader actually lights
+	void GetCone(glm::vec3& axis, GLfloat& coneCos);
+	// Bounds of the lit cone, clipped to the range sphere
+	AABB GetBounds();
+
 	~SpotLight();
 
 private:
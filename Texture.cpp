@@ -8,6 +8,8 @@ Texture::Texture()
 	width = 0;
 	height = 0;
 	bitDepth = 0;
+	texData = nullptr;
+	averageColour = glm::vec3(0.5f, 0.5f, 0.5f);
 	fileLocation = "";
 }
 
@@ -17,61 +19,89 @@ Texture::Texture(const char* fileLoc)
 	width = 0;
 	height = 0;
 	bitDepth = 0;
+	texData = nullptr;
+	averageColour = glm::vec3(0.5f, 0.5f, 0.5f);
 	fileLocation = fileLoc;
 }
 
 bool Texture::LoadTexture()
 {
-	unsigned char *texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
+	return DecodeTexture() && UploadTexture();
+}
+
+bool Texture::LoadTextureA()
+{
+	return DecodeTexture() && UploadTextureA();
+}
+
+bool Texture::DecodeTexture()
+{
+	texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
 	if (!texData)
 	{
 		printf("Failed to find: %s\n", fileLocation);
 		return false;
 	}
 
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// Grey images only have the one channel to average
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	size_t pixelCount = (size_t)width * height;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		const unsigned char* pixel = texData + i * bitDepth;
+		for (int channel = 0; channel < 3; channel++)
+		{
+			sum[channel] += pixel[bitDepth >= 3 ? channel : 0];
+		}
+	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	if (pixelCount > 0)
+	{
+		averageColour = glm::vec3((float)(sum[0] / pixelCount), (float)(sum[1] / pixelCount), (float)(sum[2] / pixelCount)) / 255.0f;
+	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	return true;
+}
 
-	stbi_image_free(texData);
+bool Texture::UploadTexture()
+{
+	if (!texData)
+	{
+		return false;
+	}
 
+	Upload(GL_CLAMP_TO_EDGE, GL_RGB);
 	return true;
 }
 
-bool Texture::LoadTextureA()
+bool Texture::UploadTextureA()
 {
-	unsigned char *texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
 	if (!texData)
 	{
-		printf("Failed to find: %s\n", fileLocation);
 		return false;
 	}
 
+	Upload(GL_REPEAT, GL_RGBA);
+	return true;
+}
+
+void Texture::Upload(GLint wrap, GLenum format)
+{
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, texData);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	stbi_image_free(texData);
-
-	return true;
+	texData = nullptr;
 }
 
 void Texture::UseTexture()
@@ -84,6 +114,11 @@ void Texture::ClearTexture()
 {
 	glDeleteTextures(1, &textureID);
 	textureID = 0;
+	if (texData)
+	{
+		stbi_image_free(texData);
+		texData = nullptr;
+	}
 	width = 0;
 	height = 0;
 	bitDepth = 0;
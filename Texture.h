@@ -1,6 +1,7 @@
 #pragma once
 
 #include <GL\glew.h>
+#include <glm\glm.hpp>
 
 #include "stb_image.h"
 
@@ -13,15 +14,28 @@ public:
 	bool LoadTexture();
 	bool LoadTextureA();
 
+	// Loading split in two so the decode can run on a worker thread;
+	// the upload needs the GL context
+	bool DecodeTexture();
+	bool UploadTexture();
+	bool UploadTextureA();
+
 	void UseTexture();
 	void ClearTexture();
 
+	// Mean colour of the image, taken while decoding; the lightmap baker's bounce albedo
+	glm::vec3 GetAverageColour() { return averageColour; }
+
 	~Texture();
 
 private:
 	GLuint textureID;
 	int width, height, bitDepth;
+	unsigned char* texData;
+	glm::vec3 averageColour;
 
 	const char* fileLocation;
+
+	void Upload(GLint wrap, GLenum format);
 };
 
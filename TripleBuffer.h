@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+
+// Single producer / single consumer hand-off without locks. The producer always
+// has a slot to write into, the consumer always has the latest complete slot to
+// read from, and neither ever waits for the other.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : writeIndex(0), readIndex(1), middle(2) {}
+
+	// Producer side
+	T& GetWriteBuffer() { return buffers[writeIndex]; }
+
+	void Publish()
+	{
+		writeIndex = middle.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Consumer side. Returns true when a newer buffer than the current read buffer was taken.
+	bool Consume()
+	{
+		if (!(middle.load(std::memory_order_acquire) & FRESH_BIT))
+		{
+			return false;
+		}
+
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	// The read slot belongs to the consumer until its next Consume
+	T& GetReadBuffer() { return buffers[readIndex]; }
+
+private:
+	static const int INDEX_MASK = 3;
+	static const int FRESH_BIT = 4;
+
+	T buffers[3];
+	int writeIndex;
+	int readIndex;
+	std::atomic<int> middle;
+};
+
@@ -0,0 +1,172 @@
+#include "UniformRegistry.h"
+
+#include <vector>
+
+UniformRegistry::UniformRegistry()
+{
+}
+
+void UniformRegistry::Reflect(GLuint program)
+{
+	Clear();
+
+	std::vector<GLchar> nameBuff;
+
+	if (GLEW_VERSION_4_3 || GLEW_ARB_program_interface_query)
+	{
+		GLint uniformCount = 0, maxLength = 0;
+		glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+		glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+		nameBuff.resize(maxLength + 1);
+
+		const GLenum props[] = { GL_BLOCK_INDEX, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE };
+
+		for (GLint i = 0; i < uniformCount; i++)
+		{
+			GLint values[4] = { 0 };
+			glGetProgramResourceiv(program, GL_UNIFORM, i, 4, props, 4, NULL, values);
+
+			// Block members are addressed through their buffer, not a location
+			if (values[0] != -1 || values[2] < 0)
+			{
+				continue;
+			}
+
+			glGetProgramResourceName(program, GL_UNIFORM, i, maxLength + 1, NULL, &nameBuff[0]);
+
+			unsigned int index = 0;
+			unsigned int nameHash = HashName(&nameBuff[0], &index);
+
+			for (GLint element = 0; element < values[3]; element++)
+			{
+				UniformInfo info = { values[2] + element, (GLenum)values[1] };
+				uniforms[MakeKey(nameHash, index + element)] = info;
+			}
+		}
+	}
+	else
+	{
+		GLint uniformCount = 0, maxLength = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		nameBuff.resize(maxLength + 1);
+
+		for (GLint i = 0; i < uniformCount; i++)
+		{
+			GLuint uniformIndex = i;
+			GLint blockIndex = -1;
+			glGetActiveUniformsiv(program, 1, &uniformIndex, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+			if (blockIndex != -1)
+			{
+				continue;
+			}
+
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(program, uniformIndex, maxLength + 1, NULL, &size, &type, &nameBuff[0]);
+
+			// Pre-4.3 there is no way to get a location without a name lookup, but the
+			// name comes straight from the driver and each uniform is looked up only once
+			GLint location = glGetUniformLocation(program, &nameBuff[0]);
+			if (location < 0)
+			{
+				continue;
+			}
+
+			unsigned int index = 0;
+			unsigned int nameHash = HashName(&nameBuff[0], &index);
+
+			for (GLint element = 0; element < size; element++)
+			{
+				UniformInfo info = { location + element, type };
+				uniforms[MakeKey(nameHash, index + element)] = info;
+			}
+		}
+	}
+
+	GLint blockCount = 0, maxBlockLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockLength);
+	nameBuff.resize(maxBlockLength + 1);
+
+	for (GLint i = 0; i < blockCount; i++)
+	{
+		glGetActiveUniformBlockName(program, i, maxBlockLength + 1, NULL, &nameBuff[0]);
+		blocks[UniformHash(&nameBuff[0])] = i;
+	}
+}
+
+void UniformRegistry::Clear()
+{
+	uniforms.clear();
+	blocks.clear();
+}
+
+GLint UniformRegistry::Find(unsigned int nameHash, unsigned int index) const
+{
+	std::unordered_map<unsigned long long, UniformInfo>::const_iterator it = uniforms.find(MakeKey(nameHash, index));
+	if (it == uniforms.end())
+	{
+		return -1;
+	}
+
+	return it->second.location;
+}
+
+GLint UniformRegistry::FindBlock(unsigned int nameHash) const
+{
+	std::unordered_map<unsigned int, GLint>::const_iterator it = blocks.find(nameHash);
+	if (it == blocks.end())
+	{
+		return -1;
+	}
+
+	return it->second;
+}
+
+unsigned long long UniformRegistry::MakeKey(unsigned int nameHash, unsigned int index)
+{
+	return ((unsigned long long)nameHash << 32) | index;
+}
+
+unsigned int UniformRegistry::HashName(const char* name, unsigned int* index)
+{
+	// Same hash as UniformHash, but the first array subscript is folded to "[]"
+	// and returned through index so every element shares one key
+	unsigned int hash = 2166136261u;
+	bool indexTaken = false;
+	*index = 0;
+
+	while (*name)
+	{
+		if (*name == '[' && !indexTaken)
+		{
+			unsigned int value = 0;
+			const char* digit = name + 1;
+			while (*digit >= '0' && *digit <= '9')
+			{
+				value = value * 10 + (*digit - '0');
+				digit++;
+			}
+
+			if (*digit == ']')
+			{
+				hash = (hash ^ (unsigned char)'[') * 16777619u;
+				hash = (hash ^ (unsigned char)']') * 16777619u;
+				*index = value;
+				indexTaken = true;
+				name = digit + 1;
+				continue;
+			}
+		}
+
+		hash = (hash ^ (unsigned char)*name) * 16777619u;
+		name++;
+	}
+
+	return hash;
+}
+
+UniformRegistry::~UniformRegistry()
+{
+}
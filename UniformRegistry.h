@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+#include <GL\glew.h>
+
+// FNV-1a over a uniform name, usable at compile time. Array indices are
+// written as "[]" (e.g. "pointLights[].base.colour"); the element index is
+// passed separately to UniformRegistry::Find.
+constexpr unsigned int UniformHash(const char* name, unsigned int hash = 2166136261u)
+{
+	return *name ? UniformHash(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+class UniformRegistry
+{
+public:
+	UniformRegistry();
+
+	void Reflect(GLuint program);
+	void Clear();
+
+	GLint Find(unsigned int nameHash, unsigned int index = 0) const;
+	GLint FindBlock(unsigned int nameHash) const;
+
+	size_t GetUniformCount() const { return uniforms.size(); }
+
+	~UniformRegistry();
+
+private:
+	struct UniformInfo
+	{
+		GLint location;
+		GLenum type;
+	};
+
+	std::unordered_map<unsigned long long, UniformInfo> uniforms;
+	std::unordered_map<unsigned int, GLint> blocks;
+
+	static unsigned long long MakeKey(unsigned int nameHash, unsigned int index);
+	static unsigned int HashName(const char* name, unsigned int* index);
+};
+
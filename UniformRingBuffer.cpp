@@ -0,0 +1,131 @@
+#include "UniformRingBuffer.h"
+
+#include <string.h>
+
+UniformRingBuffer::UniformRingBuffer()
+{
+	bufferID = 0;
+	mappedData = nullptr;
+	alignment = 256;
+	sectionSize = 0;
+	sectionCount = 0;
+	writeOffset = 0;
+	sectionEnd = 0;
+}
+
+bool UniformRingBuffer::IsSupported()
+{
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+bool UniformRingBuffer::Create(GLsizeiptr sectionSize, unsigned int sectionCount)
+{
+	ClearBuffer();
+
+	if (!IsSupported() || sectionCount == 0)
+	{
+		return false;
+	}
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment <= 0)
+	{
+		alignment = 256;
+	}
+
+	this->sectionSize = GetAlignedSize(sectionSize);
+	this->sectionCount = sectionCount;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferStorage(GL_UNIFORM_BUFFER, this->sectionSize * sectionCount, NULL, flags);
+	mappedData = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, this->sectionSize * sectionCount, flags);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (!mappedData)
+	{
+		printf("Failed to map uniform ring buffer (%lld bytes)\n", (long long)(this->sectionSize * sectionCount));
+		ClearBuffer();
+		return false;
+	}
+
+	writeOffset = 0;
+	sectionEnd = 0;
+
+	return true;
+}
+
+GLsizeiptr UniformRingBuffer::GetAlignedSize(GLsizeiptr size)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+void UniformRingBuffer::BeginSection(unsigned int section)
+{
+	if (!mappedData)
+	{
+		return;
+	}
+
+	writeOffset = (section % sectionCount) * sectionSize;
+	sectionEnd = writeOffset + sectionSize;
+}
+
+void UniformRingBuffer::Grow(GLsizeiptr minimumSize)
+{
+	GLsizeiptr newSize = sectionSize > 0 ? sectionSize : minimumSize;
+	while (newSize < minimumSize)
+	{
+		newSize *= 2;
+	}
+
+	Create(newSize, sectionCount);
+}
+
+GLintptr UniformRingBuffer::Write(const void* data, GLsizeiptr size)
+{
+	GLsizeiptr alignedSize = GetAlignedSize(size);
+	if (!mappedData || writeOffset + alignedSize > sectionEnd)
+	{
+		return -1;
+	}
+
+	GLintptr offset = writeOffset;
+	memcpy(mappedData + offset, data, size);
+	writeOffset += alignedSize;
+
+	return offset;
+}
+
+void UniformRingBuffer::BindRange(GLuint bindingPoint, GLintptr offset, GLsizeiptr size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, bufferID, offset, size);
+}
+
+void UniformRingBuffer::ClearBuffer()
+{
+	if (bufferID != 0)
+	{
+		if (mappedData)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+
+	mappedData = nullptr;
+	sectionSize = 0;
+	sectionCount = 0;
+	writeOffset = 0;
+	sectionEnd = 0;
+}
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+	ClearBuffer();
+}
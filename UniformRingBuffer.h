@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <GL\glew.h>
+
+// Uniform buffer that stays mapped for its whole life (glBufferStorage with
+// persistent, coherent mapping). It is split into sections, one per FramePacer
+// slot; the pacer's fences keep the CPU from overwriting data the GPU has not
+// read yet. Blocks are written one after another and bound with
+// glBindBufferRange, so no per-draw upload goes through the driver.
+class UniformRingBuffer
+{
+public:
+	UniformRingBuffer();
+
+	static bool IsSupported();
+
+	bool Create(GLsizeiptr sectionSize, unsigned int sectionCount = 3);
+	bool IsCreated() { return mappedData != nullptr; }
+
+	// Rounds a block size up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	GLsizeiptr GetAlignedSize(GLsizeiptr size);
+
+	GLsizeiptr GetSectionSize() { return sectionSize; }
+
+	// Starts writing at the beginning of a section; the caller has made sure the GPU is done with it
+	void BeginSection(unsigned int section);
+
+	// Reallocates so a section holds at least minimumSize; the GPU must be done with every section
+	void Grow(GLsizeiptr minimumSize);
+
+	// Returns the offset the block was written at, -1 if the section is full
+	GLintptr Write(const void* data, GLsizeiptr size);
+	void BindRange(GLuint bindingPoint, GLintptr offset, GLsizeiptr size);
+
+	void ClearBuffer();
+
+	~UniformRingBuffer();
+
+private:
+	GLuint bufferID;
+	unsigned char* mappedData;
+	GLint alignment;
+
+	GLsizeiptr sectionSize;
+	unsigned int sectionCount;
+	GLintptr writeOffset;
+	GLintptr sectionEnd;
+};
+
@@ -12,6 +12,9 @@ Window::Window()
 	
 	xChange = 0.0f;
 	yChange = 0.0f;
+
+	redrawRequested = true;
+	inputTime = 0.0;
 }
 
 Window::Window(GLint windowWidth, GLint windowHeight)
@@ -26,6 +29,9 @@ Window::Window(GLint windowWidth, GLint windowHeight)
 	
 	xChange = 0.0f;
 	yChange = 0.0f;
+
+	redrawRequested = true;
+	inputTime = 0.0;
 }
 
 int Window::Initialise()
@@ -89,6 +95,22 @@ void Window::createCallbacks()
 {
 	glfwSetKeyCallback(mainWindow, handleKeys);
 	glfwSetCursorPosCallback(mainWindow, handleMouse);
+	glfwSetFramebufferSizeCallback(mainWindow, handleResize);
+	glfwSetWindowRefreshCallback(mainWindow, handleRefresh);
+}
+
+bool Window::consumeRedraw()
+{
+	bool wasRequested = redrawRequested;
+	redrawRequested = false;
+	return wasRequested;
+}
+
+double Window::consumeInputTime()
+{
+	double eventTime = inputTime;
+	inputTime = 0.0;
+	return eventTime;
 }
 
 GLfloat Window::getXChange()
@@ -108,6 +130,7 @@ GLfloat Window::getYChange()
 void Window::handleKeys(GLFWwindow* window, int key, int code, int action, int mode)
 {
 	Window* theWindow = static_cast<Window*>(glfwGetWindowUserPointer(window));
+	theWindow->markInput();
 
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 	{
@@ -130,6 +153,7 @@ void Window::handleKeys(GLFWwindow* window, int key, int code, int action, int m
 void Window::handleMouse(GLFWwindow* window, double xPos, double yPos)
 {
 	Window* theWindow = static_cast<Window*>(glfwGetWindowUserPointer(window));
+	theWindow->markInput();
 
 	if (theWindow->mouseFirstMoved)
 	{
@@ -145,6 +169,23 @@ void Window::handleMouse(GLFWwindow* window, double xPos, double yPos)
 	theWindow->lastY = yPos;
 }
 
+void Window::handleResize(GLFWwindow* window, int width, int height)
+{
+	Window* theWindow = static_cast<Window*>(glfwGetWindowUserPointer(window));
+
+	theWindow->bufferWidth = width;
+	theWindow->bufferHeight = height;
+	glViewport(0, 0, width, height);
+
+	theWindow->redrawRequested = true;
+}
+
+void Window::handleRefresh(GLFWwindow* window)
+{
+	Window* theWindow = static_cast<Window*>(glfwGetWindowUserPointer(window));
+	theWindow->redrawRequested = true;
+}
+
 Window::~Window()
 {
 	glfwDestroyWindow(mainWindow);
@@ -25,6 +25,14 @@ public:
 
 	void swapBuffers() { glfwSwapBuffers(mainWindow); }
 
+	// On-demand rendering: sleep until an event arrives, and report whether
+	// the window itself needs repainting
+	void waitEvents(GLdouble timeout) { glfwWaitEventsTimeout(timeout); }
+	bool consumeRedraw();
+
+	// Time of the oldest key or mouse event since the last call, 0 if none
+	double consumeInputTime();
+
 	~Window();
 
 private:
@@ -35,6 +43,9 @@ private:
 
 	bool keys[1024];
 
+	bool redrawRequested;
+	double inputTime;
+
 	GLfloat lastX;
 	GLfloat lastY;
 	GLfloat xChange;
@@ -42,6 +53,9 @@ private:
 	bool mouseFirstMoved;
 
 	void createCallbacks();
+	void markInput() { if (inputTime == 0.0) { inputTime = glfwGetTime(); } }
 	static void handleKeys(GLFWwindow* window, int key, int code, int action, int mode);
 	static void handleMouse(GLFWwindow* window, double xPos, double yPos);
+	static void handleResize(GLFWwindow* window, int width, int height);
+	static void handleRefresh(GLFWwindow* window);
 };
\ No newline at end of file
@@ -0,0 +1,186 @@
+#version 330
+
+// Light accumulation of the deferred path: one full-screen pass per light,
+// reading the surface back from the G-buffer written by gbuffer.frag.
+// The lighting itself is the same as shader.frag.
+#ifndef DIRECTIONAL_LIGHT_ENABLED
+#define DIRECTIONAL_LIGHT_ENABLED 1
+#endif
+#ifndef SPECULAR_ENABLED
+#define SPECULAR_ENABLED 1
+#endif
+
+// Must match DeferredRenderer::LightType
+#define LIGHT_TYPE_DIRECTIONAL 0
+#define LIGHT_TYPE_POINT 1
+#define LIGHT_TYPE_SPOT 2
+
+out vec4 colour;
+
+const int MAX_POINT_LIGHTS = 3;
+const int MAX_SPOT_LIGHTS = 3;
+
+struct Light
+{
+	vec3 colour;
+	float ambientIntensity;
+	float diffuseIntensity;
+};
+
+struct DirectionalLight 
+{
+	Light base;
+	vec3 direction;
+};
+
+struct PointLight
+{
+	Light base;
+	vec3 position;
+	float constant;
+	float linear;
+	float exponent;
+};
+
+struct SpotLight
+{
+	PointLight base;
+	vec3 direction;
+	float edge;
+};
+
+uniform DirectionalLight directionalLight;
+uniform PointLight pointLights[MAX_POINT_LIGHTS];
+uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
+
+// Which light this pass adds; the directional pass also overwrites whatever the last frame left
+uniform int lightType;
+uniform int lightIndex;
+
+uniform mat4 inverseViewProjection;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormalMaterial;
+uniform sampler2D gDepth;
+
+// Shared with shader.vert; eyePosition.w is unused
+layout(std140) uniform CameraBlock
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePosition;
+};
+
+// Filled from the G-buffer in main, then read by the lighting functions as in shader.frag
+vec3 Normal;
+vec3 FragPos;
+float materialSpecularIntensity;
+float materialShininess;
+#define MATERIAL_SPECULAR_INTENSITY materialSpecularIntensity
+#define MATERIAL_SHININESS materialShininess
+
+vec3 DecodeNormal(vec2 encoded)
+{
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	if(n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor)
+{
+	vec4 ambientColour = vec4(light.colour, 1.0f) * light.ambientIntensity;
+	
+	float diffuseFactor = max(dot(normalize(Normal), normalize(direction)), 0.0f);
+	vec4 diffuseColour = vec4(light.colour * light.diffuseIntensity * diffuseFactor, 1.0f);
+	
+	vec4 specularColour = vec4(0, 0, 0, 0);
+	
+#if SPECULAR_ENABLED
+	if(diffuseFactor > 0.0f)
+	{
+		vec3 fragToEye = normalize(eyePosition.xyz - FragPos);
+		vec3 reflectedVertex = normalize(reflect(direction, normalize(Normal)));
+		
+		float specularFactor = dot(fragToEye, reflectedVertex);
+		if(specularFactor > 0.0f)
+		{
+			specularFactor = pow(specularFactor, MATERIAL_SHININESS);
+			specularColour = vec4(light.colour * MATERIAL_SPECULAR_INTENSITY * specularFactor, 1.0f);
+		}
+	}
+#endif
+
+	return (ambientColour + (1.0 - shadowFactor) * (diffuseColour + specularColour));
+}
+
+vec4 CalcPointLight(PointLight pLight)
+{
+	vec3 direction = FragPos - pLight.position;
+	float distance = length(direction);
+	direction = normalize(direction);
+	
+	vec4 colour = CalcLightByDirection(pLight.base, direction, 0.0f);
+	float attenuation = pLight.exponent * distance * distance +
+						pLight.linear * distance +
+						pLight.constant;
+	
+	return (colour / attenuation);
+}
+
+vec4 CalcSpotLight(SpotLight sLight)
+{
+	vec3 rayDirection = normalize(FragPos - sLight.base.position);
+	float slFactor = dot(rayDirection, sLight.direction);
+	
+	if(slFactor > sLight.edge)
+	{
+		vec4 colour = CalcPointLight(sLight.base);
+		
+		return colour * (1.0f - (1.0f - slFactor)*(1.0f/(1.0f - sLight.edge)));
+		
+	} else {
+		return vec4(0, 0, 0, 0);
+	}
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+
+	// Nothing was drawn here, leave the clear colour
+	float depth = texelFetch(gDepth, texel, 0).r;
+	if(depth == 1.0)
+	{
+		discard;
+	}
+
+	vec4 normalMaterial = texelFetch(gNormalMaterial, texel, 0);
+	Normal = DecodeNormal(normalMaterial.xy);
+	materialSpecularIntensity = normalMaterial.z;
+	materialShininess = normalMaterial.w;
+
+	vec2 ndc = (vec2(texel) + 0.5) / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+	vec4 worldPos = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+	FragPos = worldPos.xyz / worldPos.w;
+
+	vec4 lightColour = vec4(0, 0, 0, 0);
+	if(lightType == LIGHT_TYPE_POINT)
+	{
+		lightColour = CalcPointLight(pointLights[lightIndex]);
+	}
+	else if(lightType == LIGHT_TYPE_SPOT)
+	{
+		lightColour = CalcSpotLight(spotLights[lightIndex]);
+	}
+#if DIRECTIONAL_LIGHT_ENABLED
+	else
+	{
+		lightColour = CalcLightByDirection(directionalLight.base, directionalLight.direction, 0.0f);
+	}
+#endif
+
+	colour = texelFetch(gAlbedo, texel, 0) * lightColour;
+}
@@ -0,0 +1,6 @@
+#version 330
+
+// Depth only; colour writes are masked off while this runs
+void main()
+{
+}
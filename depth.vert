@@ -0,0 +1,35 @@
+#version 330
+
+#ifndef DRAW_BLOCK_ENABLED
+#define DRAW_BLOCK_ENABLED 0
+#endif
+
+// Depth pre-pass: positions only. gl_Position must come out bit-identical to
+// shader.vert for the GL_EQUAL colour pass, hence invariant and the same expression.
+layout (location = 0) in vec3 pos;
+
+invariant gl_Position;
+
+#if DRAW_BLOCK_ENABLED
+// Must match the block in shader.vert
+layout(std140) uniform DrawBlock
+{
+	mat4 model;
+	vec4 drawMaterial;
+	ivec4 drawLights;
+	vec4 drawLightmap;
+};
+#else
+uniform mat4 model;
+#endif
+layout(std140) uniform CameraBlock
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePosition;
+};
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(pos, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 330
+
+// Geometry pass of the deferred path, drawn with shader.vert. Lighting happens
+// later in deferred.frag from what is written here.
+#ifndef DRAW_BLOCK_ENABLED
+#define DRAW_BLOCK_ENABLED 0
+#endif
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+layout(location = 0) out vec4 albedo;
+// .xy - octahedral normal, .z - specular intensity, .w - shininess
+layout(location = 1) out vec4 normalMaterial;
+
+struct Material
+{
+	float specularIntensity;
+	float shininess;
+};
+
+uniform sampler2D theTexture;
+
+#if DRAW_BLOCK_ENABLED
+// Must match the block in shader.vert
+layout(std140) uniform DrawBlock
+{
+	mat4 model;
+	vec4 drawMaterial;
+	ivec4 drawLights;
+	vec4 drawLightmap;
+};
+#define MATERIAL_SPECULAR_INTENSITY drawMaterial.x
+#define MATERIAL_SHININESS drawMaterial.y
+#else
+uniform Material material;
+#define MATERIAL_SPECULAR_INTENSITY material.specularIntensity
+#define MATERIAL_SHININESS material.shininess
+#endif
+
+// Unit vector folded onto the octahedron and flattened to [-1, 1]^2; DecodeNormal in deferred.frag undoes it
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 encoded = n.xy;
+	if(n.z < 0.0)
+	{
+		encoded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return encoded;
+}
+
+void main()
+{
+	albedo = texture(theTexture, TexCoord);
+	normalMaterial = vec4(EncodeNormal(normalize(Normal)), MATERIAL_SPECULAR_INTENSITY, MATERIAL_SHININESS);
+}
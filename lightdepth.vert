@@ -0,0 +1,13 @@
+#version 330
+
+// Depth from a light's point of view, for the spot light shadow atlas;
+// positions only, the fragment stage is depth.frag
+layout (location = 0) in vec3 pos;
+
+uniform mat4 model;
+uniform mat4 lightTransform;
+
+void main()
+{
+	gl_Position = lightTransform * model * vec4(pos, 1.0);
+}
@@ -0,0 +1,39 @@
+#version 330
+
+// Sums the per-light lightmap layers into the atlas shader.frag samples. Each
+// layer was baked for a white light of intensity 1, so scaling it by the
+// light's current colour and intensities gives exactly that light's share.
+
+#ifndef MAX_LAYERS
+#define MAX_LAYERS 7
+#endif
+
+// rgb - diffuse and bounce, a - ambient
+uniform sampler2DArray lightmapLayers;
+uniform int layerCount;
+
+// colour * diffuseIntensity and colour * ambientIntensity of the light behind each layer, 0 while it is off
+uniform vec3 layerDiffuse[MAX_LAYERS];
+uniform vec3 layerAmbient[MAX_LAYERS];
+
+out vec4 colour;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec3 total = vec3(0.0);
+	vec3 ambient = vec3(0.0);
+
+	for(int i = 0; i < layerCount; i++)
+	{
+		vec4 layer = texelFetch(lightmapLayers, ivec3(texel, i), 0);
+		total += layerDiffuse[i] * layer.rgb;
+		ambient += layerAmbient[i] * layer.a;
+	}
+	total += ambient;
+
+	// a - the ambient share of the light, which screen-space occlusion darkens (see shader.frag)
+	const vec3 LUMINANCE = vec3(0.2126, 0.7152, 0.0722);
+	float share = dot(ambient, LUMINANCE) / max(dot(total, LUMINANCE), 0.0001);
+	colour = vec4(total, share);
+}
@@ -1,9 +1,13 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <cmath>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
 
 #include <GL\glew.h>
 #include <GLFW\glfw3.h>
@@ -17,6 +21,7 @@
 #include "Window.h"
 #include "Mesh.h"
 #include "Shader.h"
+#include "ShaderLibrary.h"
 #include "Camera.h"
 #include "Texture.h"
 #include "DirectionalLight.h"
@@ -26,11 +31,34 @@
 
 #include "Model.h"
 
+#include "TripleBuffer.h"
+#include "InputMailbox.h"
+#include "FrameState.h"
+
+#include "JobSystem.h"
+#include "Scene.h"
+#include "RenderQueue.h"
+#include "BVH.h"
+#include "OcclusionCuller.h"
+#include "PortalVisibility.h"
+#include "UniformRingBuffer.h"
+#include "FramePacer.h"
+#include "CameraBuffer.h"
+#include "GpuTimer.h"
+#include "DeferredRenderer.h"
+#include "LightCuller.h"
+#include "Lightmapper.h"
+#include "CascadedShadowMap.h"
+#include "ShadowAtlas.h"
+#include "PointShadowMaps.h"
+#include "AmbientOcclusion.h"
+#include "JobBenchmark.h"
+
 const float toRadians = 3.14159265f / 180.0f;
 
 Window mainWindow;
 std::vector<Mesh*> meshList;
-std::vector<Shader> shaderList;
+ShaderLibrary shaderLibrary;
 Camera camera;
 
 Texture brickTexture;
@@ -54,12 +82,151 @@ Material dullMaterial;
 Model chair;
 Model guitar;
 
+Scene scene;
+RenderQueue renderQueue;
+
+// Culling, picking and light queries over the scene's world bounds. The simulation
+// thread refits it and culls with it before publishing each frame; the render thread
+// only queries it for shadow casters and picking. sceneLock keeps the refit (and the
+// scene transforms it follows) apart from the render thread's reads.
+BVH sceneBVH;
+std::mutex sceneLock;
+// Moved and refitted by the simulation thread, not yet taken by the render thread (sceneLock)
+std::vector<unsigned int> pendingMovedObjects;
+// The render thread's share, for the shadow maps
+std::vector<unsigned int> movedObjects;
+// The late latch can turn the view after culling, so the cull frustum is this much wider
+const float cullFovMargin = 10.0f;
+const float pickDistance = 100.0f;
+bool lastPickKey = false;
+
+// Depth-only pass before shading, so the lighting runs once per visible pixel ('Z' or --depth-prepass)
+ShaderLibrary depthShaderLibrary;
+bool depthPrePass = false;
+bool lastPrePassKey = false;
+
+// GPU time of the passes, printed with --frame-stats
+enum GpuTimerSection
+{
+	GPU_TIMER_DEPTH_PREPASS,
+	GPU_TIMER_SHADING,
+	GPU_TIMER_SHADING_AFTER_PREPASS,
+	GPU_TIMER_GBUFFER,
+	GPU_TIMER_DEFERRED_LIGHTING,
+	GPU_TIMER_SHADOW_CASCADES,
+	GPU_TIMER_SPOT_SHADOWS,
+	GPU_TIMER_POINT_SHADOWS,
+	GPU_TIMER_SSAO_DEPTH,
+	GPU_TIMER_SSAO,
+	GPU_TIMER_SSAO_BLUR
+};
+GpuTimer gpuTimer;
+double lastGpuReportTime = 0.0;
+
+// G-buffer and per-light passes instead of shading every light per fragment ('F' or --deferred)
+DeferredRenderer deferredRenderer;
+bool deferredShading = false;
+bool lastDeferredKey = false;
+
+// Each draw only loops over the lights that reach it; --no-light-lists evaluates every light everywhere
+LightCuller lightCuller;
+bool lightLists = true;
+
+// Static lights baked into an atlas that mesh objects sample while no light has moved since;
+// colour and intensity edits only re-sum the per-light layers. 'M' rebakes for the current
+// lights, --no-lightmap lights everything per pixel
+Lightmapper lightmapper;
+bool lightmapEnabled = true;
+bool lastLightmapKey = false;
+bool lightmapStaleReported = false;
+
+// Directional light shadows in cascades fitted to the view, forward shading only;
+// '--cascades N' picks 2-4 of them, 0 turns the shadows off
+CascadedShadowMap cascadedShadows;
+unsigned int shadowCascades = 3;
+const GLsizei cascadeSize = 2048;
+
+// Spot light shadows in tiles of a shared atlas, forward shading only. Tiles are redrawn
+// when their light or a caster moves, at most spotShadowBudget a frame
+// ('--spot-shadow-budget N', 0 turns spot shadows off)
+ShadowAtlas shadowAtlas;
+unsigned int spotShadowBudget = 1;
+const GLsizei shadowAtlasSize = 2048;
+
+// Point light shadows in cube maps, forward shading only; a map is only redrawn when its
+// light or a caster in its range moves ('--no-point-shadows' turns them off)
+PointShadowMaps pointShadowMaps;
+bool pointShadowsEnabled = true;
+const GLsizei pointShadowSize = 512;
+
+// How every shadow map is filtered: '--shadow-filter grid|poisson|evsm' and '--shadow-taps N'.
+// Taps are hardware-compared 2x2 PCFs; EVSM applies to the cascades only.
+unsigned int shadowFilter = SHADOW_FILTER_GRID;
+unsigned int shadowTaps = 4;
+
+// Screen-space ambient occlusion at half or quarter resolution, forward shading only;
+// '--ssao half|quarter|off', ssaoDivisor is 0 when off
+AmbientOcclusion ambientOcclusion;
+unsigned int ssaoDivisor = 2;
+
+// Walls, closet and door hide whatever is behind them; --no-occlusion turns the test off
+OcclusionCuller occlusionCuller;
+bool occlusionCulling = true;
+
+// Rooms as cells, doorways as portals; --no-portals culls against the whole frustum instead
+PortalVisibility portalVisibility;
+bool portalCulling = true;
+// Per-draw model matrix and material, when the driver has buffer storage
+UniformRingBuffer drawBuffer;
+
+// How many frames the CPU may queue ahead of the GPU (1-3); per-frame resources have one slot each
+FramePacer framePacer;
+unsigned int framesInFlight = 2;
+bool printFrameStats = false;
+const double frameStatsInterval = 2.0;
+
+// View and projection for every program; rewritten after the draw list is recorded
+CameraBuffer cameraBuffer;
+
+// Input posted to the simulation thread that the newest frame may not include yet.
+// Its mouse movement is applied to the view at the last moment before submit.
+struct PostedInput
+{
+	unsigned int sequence;
+	GLfloat xChange;
+	GLfloat yChange;
+	double eventTime;
+	bool reported;
+};
+std::vector<PostedInput> postedInput;
+bool lastPostedKeys[1024] = { false };
+GLfloat lastPostedAspect = 0.0f;
+
 DirectionalLight mainLight;
 PointLight pointLights[MAX_POINT_LIGHTS];
 SpotLight spotLights[MAX_SPOT_LIGHTS];
+unsigned int pointLightCount = 0;
+unsigned int spotLightCount = 0;
+
+// Input flows from the window thread to the simulation thread, finished frame
+// snapshots flow back. Camera and lights above belong to the simulation thread
+// once it has started.
+InputMailbox inputMailbox;
+TripleBuffer<FrameState> frameStates;
 
 GLfloat deltaTime = 0.0f;
-GLfloat lastTime = 0.0f;
+
+// On-demand rendering: only draw when the camera, a light or the window changed.
+// While a key is held, frames are limited to frameCap per second.
+bool onDemandRendering = true;
+double frameCap = 60.0;
+double frameInterval = 1.0 / 60.0;
+const double idleWakeInterval = 0.5;
+const GLfloat maxDeltaTime = 0.1f;
+
+// Job system threads (0 - one per hardware thread); --bench-jobs runs the scaling benchmark instead of the scene
+unsigned int workerCount = 0;
+bool runJobBenchmark = false;
 
 // Vertex Shader
 static const char* vShader = "Shaders/shader.vert";
@@ -67,6 +234,37 @@ static const char* vShader = "Shaders/shader.vert";
 // Fragment Shader
 static const char* fShader = "Shaders/shader.frag";
 
+// Depth pre-pass shaders
+static const char* vDepthShader = "Shaders/depth.vert";
+static const char* fDepthShader = "Shaders/depth.frag";
+
+// Deferred shading: geometry pass into the G-buffer, then one pass per light
+static const char* fGBufferShader = "Shaders/gbuffer.frag";
+static const char* vDeferredShader = "Shaders/deferred.vert";
+static const char* fDeferredShader = "Shaders/deferred.frag";
+
+// Sums the lightmap's per-light layers with the lights' current colours
+static const char* fLightmapShader = "Shaders/lightmap.frag";
+
+// Cascaded shadow pass; the fragment stage is the depth pre-pass one
+static const char* vShadowShader = "Shaders/shadow.vert";
+static const char* gShadowShader = "Shaders/shadow.geom";
+
+// Spot light shadow atlas tiles, with the depth pre-pass fragment stage
+static const char* vLightDepthShader = "Shaders/lightdepth.vert";
+
+// Point light cube maps, drawn with the cascaded shadow pass' vertex stage
+static const char* gPointShadowShader = "Shaders/pointshadow.geom";
+static const char* fPointShadowShader = "Shaders/pointshadow.frag";
+
+// EVSM prefiltering of the cascades, drawn with the deferred full-screen triangle
+static const char* fShadowMomentsShader = "Shaders/shadowmoments.frag";
+static const char* fShadowBlurShader = "Shaders/shadowblur.frag";
+
+// Ambient occlusion and its depth-aware blur, drawn with the deferred full-screen triangle
+static const char* fSsaoShader = "Shaders/ssao.frag";
+static const char* fSsaoBlurShader = "Shaders/ssaoblur.frag";
+
 int curKey(bool* keys) {
 	if (keys[GLFW_KEY_1]) { return 1; }
 	if (keys[GLFW_KEY_2]) { return 2; }
@@ -102,6 +300,27 @@ void calcAverageNormals(unsigned int * indices, unsigned int indiceCount, GLfloa
 	}
 }
 
+// Splits the mesh into lightmap charts before creating it, and hands the charts to the baker
+Mesh* CreateLightmappedMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices,
+	bool keepPositions = false)
+{
+	Mesh* mesh = new Mesh();
+
+	LightmapMesh unwrapped;
+	Lightmapper::Unwrap(vertices, indices, numOfVertices, numOfIndices, unwrapped);
+	if (unwrapped.indices.empty())
+	{
+		mesh->CreateMesh(vertices, indices, numOfVertices, numOfIndices, keepPositions);
+		return mesh;
+	}
+
+	mesh->CreateMesh(&unwrapped.vertices[0], &unwrapped.indices[0], (unsigned int)unwrapped.vertices.size(),
+		(unsigned int)unwrapped.indices.size(), keepPositions, nullptr, &unwrapped.lightmapUVs[0]);
+	lightmapper.AddMesh(mesh, unwrapped);
+
+	return mesh;
+}
+
 void CreateObjects() 
 {
 	unsigned int walls_indices[] = {		
@@ -793,110 +1012,939 @@ void CreateObjects()
 	calcAverageNormals(tableClosetIndices, 36, tableClosetVertices, 64, 8, 5);*/
 	/*calcAverageNormals(computerIndices, 36, computerVertices, 64, 8, 5);
 	calcAverageNormals(computerLegIndices, 36, computerLegVertices, 64, 8, 5);*/
-	calcAverageNormals(monitorBaseIndices, 36, monitorBaseVertices, 64, 8, 5);
-	calcAverageNormals(monitorLegIndices, 36, monitorLegVertices, 64, 8, 5);
-	calcAverageNormals(monitorMainIndices, 6, monitorMainVertices, 32, 8, 5);
-	calcAverageNormals(posterIndices, 6, posterVertices, 32, 8, 5);
-	calcAverageNormals(floorIndices, 6, floorVertices, 32, 8, 5);
-
-	Mesh* walls = new Mesh();
-	walls->CreateMesh(walls_vertices, walls_indices, 64, 24);
+	// Each mesh's normals are independent of the others
+	JobCounter normalsDone;
+	jobSystem.Run([&]() { calcAverageNormals(monitorBaseIndices, 36, monitorBaseVertices, 64, 8, 5); }, &normalsDone);
+	jobSystem.Run([&]() { calcAverageNormals(monitorLegIndices, 36, monitorLegVertices, 64, 8, 5); }, &normalsDone);
+	jobSystem.Run([&]() { calcAverageNormals(monitorMainIndices, 6, monitorMainVertices, 32, 8, 5); }, &normalsDone);
+	jobSystem.Run([&]() { calcAverageNormals(posterIndices, 6, posterVertices, 32, 8, 5); }, &normalsDone);
+	jobSystem.Run([&]() { calcAverageNormals(floorIndices, 6, floorVertices, 32, 8, 5); }, &normalsDone);
+	jobSystem.Wait(&normalsDone);
+
+	Mesh* walls = CreateLightmappedMesh(walls_vertices, walls_indices, 64, 24, true);
 	meshList.push_back(walls);
 
-	Mesh* floor = new Mesh();
-	floor->CreateMesh(floorVertices, floorIndices, 32, 6);
+	Mesh* floor = CreateLightmappedMesh(floorVertices, floorIndices, 32, 6);
 	meshList.push_back(floor);
 
-	Mesh* sofaSide = new Mesh();
-	sofaSide->CreateMesh(sofaSideVertices, sofaSideIndices, 64, 36);
+	Mesh* sofaSide = CreateLightmappedMesh(sofaSideVertices, sofaSideIndices, 64, 36);
 	meshList.push_back(sofaSide);
 
-	Mesh* sofaMain = new Mesh();
-	sofaMain->CreateMesh(sofaMainVertices, sofaMainIndices, 64, 36);
+	Mesh* sofaMain = CreateLightmappedMesh(sofaMainVertices, sofaMainIndices, 64, 36);
 	meshList.push_back(sofaMain);
 
-	Mesh* sofaBack = new Mesh();
-	sofaBack->CreateMesh(sofaBackVertices, sofaBackIndices, 64, 36);
+	Mesh* sofaBack = CreateLightmappedMesh(sofaBackVertices, sofaBackIndices, 64, 36);
 	meshList.push_back(sofaBack);
 
-	Mesh* closet = new Mesh();
-	closet->CreateMesh(closetVertices, closetIndices, 96, 48);
+	Mesh* closet = CreateLightmappedMesh(closetVertices, closetIndices, 96, 48, true);
 	meshList.push_back(closet);
 
-	Mesh* tableMain = new Mesh();
-	tableMain->CreateMesh(tableMainVertices, tableMainIndices, 64, 36);
+	Mesh* tableMain = CreateLightmappedMesh(tableMainVertices, tableMainIndices, 64, 36);
 	meshList.push_back(tableMain);
 
-	Mesh* tableSide = new Mesh();
-	tableSide->CreateMesh(tableSideVertices, tableSideIndices, 64, 36);
+	Mesh* tableSide = CreateLightmappedMesh(tableSideVertices, tableSideIndices, 64, 36);
 	meshList.push_back(tableSide);
 
-	Mesh* tableCloset = new Mesh();
-	tableCloset->CreateMesh(tableClosetVertices, tableClosetIndices, 64, 36);
+	Mesh* tableCloset = CreateLightmappedMesh(tableClosetVertices, tableClosetIndices, 64, 36);
 	meshList.push_back(tableCloset);
 
-	Mesh* computer = new Mesh();
-	computer->CreateMesh(computerVertices, computerIndices, 64, 36);
+	Mesh* computer = CreateLightmappedMesh(computerVertices, computerIndices, 64, 36);
 	meshList.push_back(computer);
 
-	Mesh* computerLeg = new Mesh();
-	computerLeg->CreateMesh(computerLegVertices, computerLegIndices, 64, 36);
+	Mesh* computerLeg = CreateLightmappedMesh(computerLegVertices, computerLegIndices, 64, 36);
 	meshList.push_back(computerLeg);
 
-	Mesh* poster = new Mesh();
-	poster->CreateMesh(posterVertices, posterIndices, 32, 6);
+	Mesh* poster = CreateLightmappedMesh(posterVertices, posterIndices, 32, 6);
 	meshList.push_back(poster);
 
-	Mesh* monitorMain = new Mesh();
-	monitorMain->CreateMesh(monitorMainVertices, monitorMainIndices, 64, 36);
+	Mesh* monitorMain = CreateLightmappedMesh(monitorMainVertices, monitorMainIndices, 64, 36);
 	meshList.push_back(monitorMain);
 
-	Mesh* monitorLeg = new Mesh();
-	monitorLeg->CreateMesh(monitorLegVertices, monitorLegIndices, 64, 36);
+	Mesh* monitorLeg = CreateLightmappedMesh(monitorLegVertices, monitorLegIndices, 64, 36);
 	meshList.push_back(monitorLeg);
 
-	Mesh* monitorBase = new Mesh();
-	monitorBase->CreateMesh(monitorBaseVertices, monitorBaseIndices, 64, 36);
+	Mesh* monitorBase = CreateLightmappedMesh(monitorBaseVertices, monitorBaseIndices, 64, 36);
 	meshList.push_back(monitorBase);
 
-	Mesh* lampBase = new Mesh();
-	lampBase->CreateMesh(lampBaseVertices, lampBaseIndices, 64, 36);
+	Mesh* lampBase = CreateLightmappedMesh(lampBaseVertices, lampBaseIndices, 64, 36);
 	meshList.push_back(lampBase);
 
-	Mesh* lampLeg = new Mesh();
-	lampLeg->CreateMesh(lampLegVertices, lampLegIndices, 64, 36);
+	Mesh* lampLeg = CreateLightmappedMesh(lampLegVertices, lampLegIndices, 64, 36);
 	meshList.push_back(lampLeg);
 
-	Mesh* lampMain = new Mesh();
-	lampMain->CreateMesh(lampMainVertices, lampMainIndices, 64, 36);
+	Mesh* lampMain = CreateLightmappedMesh(lampMainVertices, lampMainIndices, 64, 36);
 	meshList.push_back(lampMain);
 
-	Mesh* monitorScreen = new Mesh();
-	monitorScreen->CreateMesh(monitorScreenVertices, monitorScreenIndices, 32, 6);
+	Mesh* monitorScreen = CreateLightmappedMesh(monitorScreenVertices, monitorScreenIndices, 32, 6);
 	meshList.push_back(monitorScreen);
 
-	Mesh* door = new Mesh();
-	door->CreateMesh(doorVertices, doorIndices, 64, 36);
+	Mesh* door = CreateLightmappedMesh(doorVertices, doorIndices, 64, 36, true);
 	meshList.push_back(door);
 
-	Mesh* plinth = new Mesh();
-	plinth->CreateMesh(plinthVertices, plinthIndices, 128, 24);
+	Mesh* plinth = CreateLightmappedMesh(plinthVertices, plinthIndices, 128, 24);
 	meshList.push_back(plinth);
 
-	Mesh* pillow = new Mesh();
-	pillow->CreateMesh(pillowVertices, pillowIndices, 64, 36);
+	Mesh* pillow = CreateLightmappedMesh(pillowVertices, pillowIndices, 64, 36);
 	meshList.push_back(pillow);
 }
 
+void CreateLights()
+{
+	mainLight = DirectionalLight(0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f);
+
+	pointLightCount = 0;
+	pointLights[0] = PointLight(0.8f, 0.8f, 0.7f,
+						0.5f, 1.0f,
+						2.5f, 2.9f, 1.8f,
+						0.5f, 0.2f, 0.1f);
+	pointLightCount++;
+
+	/*pointLights[1] = PointLight(1.0f, 1.0f, 0.7f,
+		0.3f, 1.0f,
+		4.5f, 1.8f, 0.6f,
+		0.5f, 0.2f, 0.1f);
+	pointLightCount++;*/
+
+	spotLightCount = 0;
+	spotLights[0] = SpotLight(1.0f, 1.0f, 0.5f,
+						0.5f, 1.0f,
+						4.528f, 1.87f, 0.55f,
+						-0.05f, -1.0f, 0.0f,
+						0.3f, 0.2f, 0.1f,
+						45.0f);
+	spotLightCount++;
+
+	spotLights[1] = SpotLight(1.0f, 0.3f, 0.0f,
+						1.5f, 1.0f,
+						0.0f, 3.0f, 4.5f,
+						0.5f, -0.75f, -0.5f,
+						0.3f, 0.2f, 0.1f,
+						50.0f);
+	spotLightCount++;
+
+	spotLights[2] = SpotLight(0.3f, 0.0f, 1.0f,
+						1.5f, 1.0f,
+						0.0f, 3.0f, 0.0f,
+						0.5f, -0.75f, 0.5f,
+						0.3f, 0.2f, 0.1f,
+						50.0f);
+	spotLightCount++;
+}
+
+void CreateScene()
+{
+	glm::mat4 model(1.0f);	
+	
+	//walls
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[0], &wallsTexture, &dullMaterial);
+	occlusionCuller.AddOccluder(*meshList[0], model);
+	//walls
+
+	//floor
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[1], &floorTexture, &dullMaterial);
+	//floor
+
+	//sofa
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.03f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[2], &sofaSideTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(2.5f, 0.0f, 0.03f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[2], &sofaSideTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.03f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[3], &tableTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.03f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[4], &tableTexture, &dullMaterial);
+	//sofa
+
+	//closet
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(2.2f, 0.0f, 3.5f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[5], &closet_frontTexture, &dullMaterial);
+	occlusionCuller.AddOccluder(*meshList[5], model);
+	//closet
+
+	//table
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(2.75f, 0.75f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[6], &woodTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(2.77f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[7], &woodTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.9f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[8], &woodTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.901f, 0.55f, 0.02f));
+	model = glm::scale(model, glm::vec3(0.99f, 0.25f, 1.0f));
+	scene.AddObject(model, meshList[8], &woodTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.901f, 0.08f, 0.02f));
+	model = glm::scale(model, glm::vec3(0.99f, 0.6f, 1.0f));
+	scene.AddObject(model, meshList[8], &woodTexture, &dullMaterial);
+	//table
+
+	//computer
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.2f, 0.88f, 0.15f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[9], &plainTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.2f, 0.85f, 0.15f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[10], &plainTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.62f, 0.85f, 0.67f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[10], &plainTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.62f, 0.85f, 0.15f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[10], &plainTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.2f, 0.85f, 0.67f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[10], &plainTexture, &dullMaterial);
+	//computer
+
+	//poster DOOM
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(1.6f, 1.5f, 0.02f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[11], &poster1Texture, &dullMaterial);
+	//poster DOOM
+
+	//poster Pulp Fiction
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.5f, 1.48f, 0.02f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[11], &poster2Texture, &dullMaterial);
+	//poster Pulp Fiction
+
+
+	//monitor
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.4f, 1.0f, 0.15f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.02f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[12], &monitorTexture, &shinyMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.65f, 0.85f, 0.05f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[13], &monitorTexture, &shinyMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.57f, 0.85f, 0.02f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[14], &monitorTexture, &shinyMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.41f, 1.03f, 0.231f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.02f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[18], &monitorScreenTexture, &shinyMaterial);
+	//monitor
+
+	//lamp
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.48f, 1.41f, 0.22f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0f, -0.1f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[15], &dirtTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.52f, 1.41f, 0.26f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0f, -0.1f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[16], &dirtTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.51f, 1.81f, 0.25f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.1f, -0.1f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[17], &dirtTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(4.515f, 1.81f, 0.315f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.1f, -0.1f, 0.0f));
+	model = glm::scale(model, glm::vec3(0.75f, 0.3f, 0.8f));
+	scene.AddObject(model, meshList[17], &plainTexture, &shinyMaterial);
+	//lamp
+
+	//door
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.8f, 0.0f, 4.45f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[19], &tableTexture, &dullMaterial);
+	occlusionCuller.AddOccluder(*meshList[19], model);
+	//door
+
+	//chair
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(3.4f, 0.0f, 1.2f));
+	model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 0.1f, 0.0f));
+	scene.AddModel(model, &chair, &dullMaterial);
+	//chair
+
+	//plinth
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[20], &closetTexture, &dullMaterial);
+	//plinth
+
+	//pillows
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.8f, 0.78f, 0.07f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[21], &closetTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(1.67f, 0.78f, 0.07f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[21], &closetTexture, &dullMaterial);
+
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.15f, 0.0f, 1.3f));
+	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	model = glm::rotate(model, glm::radians(82.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
+	scene.AddObject(model, meshList[21], &closetTexture, &dullMaterial);
+	//pillows
+
+	//guitar
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.48f, 0.0f, 1.5f));
+	model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
+	model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	model = glm::rotate(model, glm::radians(15.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+	scene.AddModel(model, &guitar, &dullMaterial);
+	//guitar
+}
+
+void CreateCells()
+{
+	// The room, and the hallway its door leads to (nothing is placed there yet)
+	int room = portalVisibility.AddCell(AABB(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(6.0f, 3.0f, 4.5f)));
+	int hallway = portalVisibility.AddCell(AABB(glm::vec3(0.0f, 0.0f, 4.5f), glm::vec3(6.0f, 3.0f, 8.0f)));
+
+	// Doorway in the z = 4.5 wall, where the door (meshList[19]) sits
+	glm::vec3 doorway[] = {
+		glm::vec3(0.8f, 0.0f, 4.5f), glm::vec3(2.0f, 0.0f, 4.5f),
+		glm::vec3(2.0f, 2.15f, 4.5f), glm::vec3(0.8f, 2.15f, 4.5f)
+	};
+	portalVisibility.AddPortal(room, hallway, doorway, 4);
+
+	portalVisibility.AssignObjects(scene);
+}
+
+void GatherActiveLights(FrameState& frame)
+{
+	// Only lights that currently contribute anything, packed for the shader variant
+	frame.pointLightCount = 0;
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		if (pointLights[i].IsActive())
+		{
+			frame.pointLights[frame.pointLightCount++] = pointLights[i];
+		}
+	}
+
+	frame.spotLightCount = 0;
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		if (spotLights[i].IsActive())
+		{
+			frame.spotLights[frame.spotLightCount++] = spotLights[i];
+		}
+	}
+
+	frame.mainLight = mainLight;
+
+	frame.features.pointLightCount = frame.pointLightCount;
+	frame.features.spotLightCount = frame.spotLightCount;
+	frame.features.directionalLight = mainLight.IsActive();
+	// The render thread turns shadows on once it has fitted the cascades and drawn the maps
+	frame.features.shadows = false;
+	frame.features.spotShadows = false;
+	frame.features.pointShadows = false;
+	frame.features.ambientOcclusion = false;
+	frame.features.specular = shinyMaterial.HasSpecular() || dullMaterial.HasSpecular();
+	// The render thread owns the ring buffer and decides this per frame
+	frame.features.drawBlock = false;
+}
+
+ShaderFeatures GetDepthFeatures()
+{
+	// The depth shader only cares whether per-draw data comes from the ring
+	ShaderFeatures features = {};
+	features.drawBlock = drawBuffer.IsCreated();
+	return features;
+}
+
 void CreateShaders()
 {
-	Shader *shader1 = new Shader();
-	shader1->CreateFromFiles(vShader, fShader);
-	shaderList.push_back(*shader1);	
+	shaderLibrary.CreateFromFiles(vShader, fShader);
+
+	// Start compiling the variant the scene opens with
+	FrameState initialFrame;
+	GatherActiveLights(initialFrame);
+	initialFrame.features.drawBlock = drawBuffer.IsCreated();
+	initialFrame.features.lightLists = lightLists;
+	initialFrame.features.shadowFilter = shadowFilter;
+	initialFrame.features.shadowTaps = shadowTaps;
+	shaderLibrary.GetVariant(initialFrame.features);
+
+	depthShaderLibrary.CreateFromFiles(vDepthShader, fDepthShader);
+	if (depthPrePass)
+	{
+		depthShaderLibrary.GetVariant(GetDepthFeatures());
+	}
+
+	deferredRenderer.CreateFromFiles(vShader, fGBufferShader, vDeferredShader, fDeferredShader);
+	lightmapper.CreateFromFiles(vDeferredShader, fLightmapShader);
+
+	if (shadowCascades > 0)
+	{
+		cascadedShadows.CreateFromFiles(vShadowShader, gShadowShader, fDepthShader, shadowCascades, cascadeSize);
+		if (shadowFilter == SHADOW_FILTER_EVSM)
+		{
+			cascadedShadows.CreateMomentsFromFiles(vDeferredShader, fShadowMomentsShader, fShadowBlurShader);
+		}
+	}
+
+	if (spotShadowBudget > 0)
+	{
+		shadowAtlas.CreateFromFiles(vLightDepthShader, fDepthShader, shadowAtlasSize, spotShadowBudget);
+	}
+
+	if (pointShadowsEnabled)
+	{
+		pointShadowMaps.CreateFromFiles(vShadowShader, gPointShadowShader, fPointShadowShader, pointShadowSize);
+	}
+
+	if (ssaoDivisor > 0)
+	{
+		ambientOcclusion.CreateFromFiles(vDeferredShader, fSsaoShader, fSsaoBlurShader, ssaoDivisor);
+	}
+}
+
+void ReportGpuTimes()
+{
+	double now = glfwGetTime();
+	if (!gpuTimer.IsCreated() || now - lastGpuReportTime < frameStatsInterval)
+	{
+		return;
+	}
+	lastGpuReportTime = now;
+
+	double shading = gpuTimer.TakeAverage(GPU_TIMER_SHADING);
+	double prePass = gpuTimer.TakeAverage(GPU_TIMER_DEPTH_PREPASS);
+	double shadingAfterPrePass = gpuTimer.TakeAverage(GPU_TIMER_SHADING_AFTER_PREPASS);
+
+	double geometry = gpuTimer.TakeAverage(GPU_TIMER_GBUFFER);
+	double lighting = gpuTimer.TakeAverage(GPU_TIMER_DEFERRED_LIGHTING);
+
+	printf("GPU shading: %.3f ms without depth pre-pass, %.3f ms with it (+ %.3f ms pre-pass = %.3f ms); pre-pass %s\n",
+		shading, shadingAfterPrePass, prePass, shadingAfterPrePass + prePass, depthPrePass ? "on" : "off");
+	printf("GPU deferred: %.3f ms G-buffer + %.3f ms lighting (%u light passes) = %.3f ms; %s shading\n",
+		geometry, lighting, deferredRenderer.GetLightPassCount(), geometry + lighting, deferredShading ? "deferred" : "forward");
+
+	double shadows = gpuTimer.TakeAverage(GPU_TIMER_SHADOW_CASCADES);
+	printf("GPU shadows: %.3f ms for %u cascades, %u casters\n", shadows, cascadedShadows.GetCascadeCount(), cascadedShadows.GetCasterCount());
+
+	double spotShadows = gpuTimer.TakeAverage(GPU_TIMER_SPOT_SHADOWS);
+	printf("GPU spot shadows: %.3f ms when tiles are drawn, %u drawn last time (budget %u)\n", spotShadows,
+		shadowAtlas.GetTilesRendered(), spotShadowBudget);
+
+	double pointShadows = gpuTimer.TakeAverage(GPU_TIMER_POINT_SHADOWS);
+	printf("GPU point shadows: %.3f ms when maps are drawn, %u maps with %u casters drawn last time\n", pointShadows,
+		pointShadowMaps.GetMapsRendered(), pointShadowMaps.GetCasterCount());
+
+	double ssaoDepth = gpuTimer.TakeAverage(GPU_TIMER_SSAO_DEPTH);
+	double ssao = gpuTimer.TakeAverage(GPU_TIMER_SSAO);
+	double ssaoBlur = gpuTimer.TakeAverage(GPU_TIMER_SSAO_BLUR);
+	printf("GPU ambient occlusion: %.3f ms depth + %.3f ms occlusion + %.3f ms blur = %.3f ms at 1/%u resolution\n",
+		ssaoDepth, ssao, ssaoBlur, ssaoDepth + ssao + ssaoBlur, ambientOcclusion.GetDivisor());
+}
+
+unsigned int GetLightStateVersion()
+{
+	// Versions only ever grow, so the sum changes whenever any light changes
+	unsigned int version = mainLight.GetVersion();
+
+	for (size_t i = 0; i < pointLightCount; i++)
+	{
+		version += pointLights[i].GetVersion();
+	}
+
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		version += spotLights[i].GetVersion();
+	}
+
+	return version;
+}
+
+// Simulation thread: refits what moved, then finds what the frame draws and the
+// lights reaching each object
+void CullFrame(FrameState& frame, GLfloat aspect)
+{
+	std::vector<unsigned int> moved;
+	scene.TakeMovedObjects(moved);
+	if (!moved.empty())
+	{
+		std::lock_guard<std::mutex> guard(sceneLock);
+		for (size_t i = 0; i < moved.size(); i++)
+		{
+			sceneBVH.UpdateItem(moved[i], scene.GetObjectBounds(moved[i]));
+			portalVisibility.UpdateObject(moved[i], scene.GetObjectBounds(moved[i]));
+		}
+		pendingMovedObjects.insert(pendingMovedObjects.end(), moved.begin(), moved.end());
+	}
+
+	// glm::perspective takes the camera's fov as radians, so widen the angle it actually produces
+	GLfloat viewFov = 2.0f * std::atan(std::abs(std::tan(frame.fov * 0.5f)));
+	frame.cullFov = glm::min(viewFov + glm::radians(cullFovMargin), glm::radians(170.0f));
+	frame.cullViewProjection = glm::perspective(frame.cullFov, aspect, 0.1f, 100.0f) * frame.view;
+
+	frame.visibleObjects.clear();
+	if (!portalCulling || !portalVisibility.FindVisible(sceneBVH, frame.eyePosition, frame.cullViewProjection, frame.visibleObjects))
+	{
+		// Outside every cell (or portals off): everything in the frustum
+		sceneBVH.QueryFrustum(Frustum(frame.cullViewProjection), frame.visibleObjects);
+	}
+
+	// Drawn with the widened cull frustum; boxes crossing the buffer's edges are kept visible
+	if (occlusionCulling)
+	{
+		occlusionCuller.Render(frame.cullViewProjection, jobSystem);
+		occlusionCuller.Cull(scene, frame.visibleObjects, jobSystem);
+	}
+
+	frame.objectLights.clear();
+	if (lightLists)
+	{
+		lightCuller.Update(frame, sceneBVH);
+		for (size_t i = 0; i < frame.visibleObjects.size(); i++)
+		{
+			frame.objectLights.push_back(lightCuller.GetLightList(frame.visibleObjects[i]));
+		}
+	}
+}
+
+void PublishFrame(unsigned int frameNumber, unsigned int inputSequence, GLfloat aspect)
+{
+	FrameState& frame = frameStates.GetWriteBuffer();
+
+	frame.frameNumber = frameNumber;
+	frame.camera = camera;
+	frame.inputSequence = inputSequence;
+	frame.view = camera.calculateViewMatrix();
+	frame.eyePosition = camera.getCameraPosition();
+	frame.fov = camera.GetFOV();
+	GatherActiveLights(frame);
+	CullFrame(frame, aspect);
+
+	frameStates.Publish();
+
+	// Wake the render thread if it is sleeping in waitEvents
+	glfwPostEmptyEvent();
 }
 
-int main() 
+// aspect - of the window's framebuffer until the render thread posts another
+void RunSimulation(GLfloat aspect)
 {
+	InputState input;
+	memset(input.keys, 0, sizeof(input.keys));
+	input.xChange = 0.0f;
+	input.yChange = 0.0f;
+	input.aspect = aspect;
+	input.sequence = 0;
+
+	unsigned int frameNumber = 0;
+	unsigned int lastLightVersion = GetLightStateVersion();
+	GLfloat simLastTime = glfwGetTime();
+
+	PublishFrame(frameNumber++, input.sequence, input.aspect);
+	GLfloat lastAspect = input.aspect;
+
+	// Whether the last step moved the camera or a light
+	bool animating = false;
+
+	while (true)
+	{
+		bool keyHeld = false;
+		for (size_t i = 0; i < 1024 && !keyHeld; i++)
+		{
+			keyHeld = input.keys[i];
+		}
+
+		// Held keys move things without producing new events, so keep ticking at the
+		// frame cap while they still change something; a held key that moves nothing
+		// sleeps until new input is posted like no key at all
+		double timeout = keyHeld && animating ? (frameInterval > 0.001 ? frameInterval : 0.001) : -1.0;
+		if (!inputMailbox.Wait(input, timeout))
+		{
+			break;
+		}
+
+		GLfloat now = glfwGetTime();
+		deltaTime = now - simLastTime;
+		simLastTime = now;
+
+		// After sleeping through an idle stretch the first step must not teleport the camera
+		if (deltaTime > maxDeltaTime)
+		{
+			deltaTime = maxDeltaTime;
+		}
+
+		camera.keyControl(input.keys, deltaTime);
+		camera.mouseControl(input.xChange, input.yChange);
+
+		if (curKey(input.keys) == 1) {
+			spotLights[1].ControlSpotLight(input.keys, spotLights[1], deltaTime);
+		};
+
+		if (curKey(input.keys) == 2) {
+			spotLights[2].ControlSpotLight(input.keys, spotLights[2], deltaTime);
+		};
+
+		if (curKey(input.keys) == 4) {
+			spotLights[0].ControlSpotLight(input.keys, spotLights[0], deltaTime);
+		};
+
+		if (curKey(input.keys) == 3) {
+			pointLights[0].ControlPointLight(input.keys, pointLights[0], deltaTime);
+		};
+
+		glm::vec3 lowerLight = camera.getCameraPosition();
+		lowerLight.y -= 0.3f;
+		//spotLights[0].SetFlash(lowerLight, camera.getCameraDirection());
+
+		unsigned int lightVersion = GetLightStateVersion();
+		bool lightsChanged = lightVersion != lastLightVersion;
+		lastLightVersion = lightVersion;
+
+		bool cameraChanged = camera.consumeChanged();
+		animating = cameraChanged || lightsChanged;
+
+		// A resized window needs culling for its new frustum
+		bool aspectChanged = input.aspect != lastAspect;
+		lastAspect = input.aspect;
+
+		if (cameraChanged || lightsChanged || aspectChanged || !onDemandRendering)
+		{
+			PublishFrame(frameNumber++, input.sequence, input.aspect);
+		}
+	}
+}
+
+void PostWindowInput()
+{
+	bool* keys = mainWindow.getsKeys();
+	GLfloat xChange = mainWindow.getXChange();
+	GLfloat yChange = mainWindow.getYChange();
+	double eventTime = mainWindow.consumeInputTime();
+
+	// Minimised windows keep the last aspect
+	GLfloat aspect = lastPostedAspect;
+	if (mainWindow.getBufferWidth() > 0 && mainWindow.getBufferHeight() > 0)
+	{
+		aspect = (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight();
+	}
+
+	if (xChange != 0.0f || yChange != 0.0f || aspect != lastPostedAspect || memcmp(keys, lastPostedKeys, sizeof(lastPostedKeys)) != 0)
+	{
+		PostedInput input;
+		input.sequence = inputMailbox.Post(keys, xChange, yChange, aspect);
+		input.xChange = xChange;
+		input.yChange = yChange;
+		input.eventTime = eventTime;
+		input.reported = false;
+		postedInput.push_back(input);
+
+		memcpy(lastPostedKeys, keys, sizeof(lastPostedKeys));
+		lastPostedAspect = aspect;
+	}
+}
+
+glm::mat4 LatchView(const FrameState& frame)
+{
+	// Replays mouse movement the simulation hasn't integrated yet, in posting order,
+	// exactly as Camera::mouseControl will once it does
+	Camera lateCamera = frame.camera;
+	for (size_t i = 0; i < postedInput.size(); i++)
+	{
+		if (postedInput[i].sequence > frame.inputSequence)
+		{
+			lateCamera.mouseControl(postedInput[i].xChange, postedInput[i].yChange);
+		}
+	}
+
+	return lateCamera.calculateViewMatrix();
+}
+
+// Refines a BVH hit on a scene object: meshes with CPU positions are tested triangle by
+// triangle, anything else by its bounds, seen from their far side when the ray starts inside
+bool IntersectPickedObject(const Ray& ray, unsigned int item, float& distance)
+{
+	const SceneObject& object = scene.GetObject(item);
+	if (object.type == SCENE_OBJECT_MESH && !scene.GetMesh(object.resource)->GetPositions().empty())
+	{
+		const Mesh* mesh = scene.GetMesh(object.resource);
+		const std::vector<glm::vec3>& positions = mesh->GetPositions();
+		const std::vector<unsigned int>& indices = mesh->GetIndices();
+
+		// Object space, with the direction left unnormalised so distances stay in world units
+		glm::mat4 inverse = glm::inverse(object.transform);
+		Ray objectRay(glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.0f)));
+
+		bool hit = false;
+		float closest = pickDistance;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			float triangleDistance;
+			if (objectRay.IntersectsTriangle(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]], closest, triangleDistance))
+			{
+				closest = triangleDistance;
+				hit = true;
+			}
+		}
+
+		distance = closest;
+		return hit;
+	}
+
+	const AABB& bounds = scene.GetObjectBounds(item);
+	if (bounds.Contains(ray.origin))
+	{
+		float enter;
+		ray.Intersects(bounds, pickDistance, enter, distance);
+	}
+
+	return true;
+}
+
+void PickObject(FrameState& frame)
+{
+	Ray ray(frame.eyePosition, glm::normalize(frame.camera.getCameraDirection()));
+
+	unsigned int object = 0;
+	float distance = 0.0f;
+	std::lock_guard<std::mutex> guard(sceneLock);
+	if (sceneBVH.Raycast(ray, pickDistance, object, distance, [&ray](unsigned int item, float& itemDistance)
+		{
+			return IntersectPickedObject(ray, item, itemDistance);
+		}))
+	{
+		AABB bounds = scene.GetObjectBounds(object);
+		printf("Picked object %u at %.2f (bounds %.2f %.2f %.2f - %.2f %.2f %.2f)\n", object, distance,
+			bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z);
+	}
+	else
+	{
+		printf("Nothing picked\n");
+	}
+}
+
+void ReportInputLatency(const FrameState& frame, double presentTime)
+{
+	// Mouse movement is always in the frame just presented (latched); anything else
+	// only once the simulation has consumed it
+	for (size_t i = 0; i < postedInput.size(); i++)
+	{
+		PostedInput& input = postedInput[i];
+		bool latched = input.xChange != 0.0f || input.yChange != 0.0f;
+
+		if (!input.reported && input.eventTime > 0.0 && (latched || input.sequence <= frame.inputSequence))
+		{
+			framePacer.AddInputLatency(presentTime - input.eventTime);
+			input.reported = true;
+		}
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < postedInput.size(); i++)
+	{
+		if (postedInput[i].sequence > frame.inputSequence)
+		{
+			postedInput[kept++] = postedInput[i];
+		}
+	}
+	postedInput.resize(kept);
+}
+
+void ParseArguments(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--continuous") == 0)
+		{
+			onDemandRendering = false;
+		}
+		else if (strcmp(argv[i], "--frame-cap") == 0 && i + 1 < argc)
+		{
+			frameCap = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+		{
+			workerCount = (unsigned int)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+		{
+			framesInFlight = (unsigned int)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--frame-stats") == 0)
+		{
+			printFrameStats = true;
+		}
+		else if (strcmp(argv[i], "--bench-jobs") == 0)
+		{
+			runJobBenchmark = true;
+		}
+		else if (strcmp(argv[i], "--no-occlusion") == 0)
+		{
+			occlusionCulling = false;
+		}
+		else if (strcmp(argv[i], "--no-portals") == 0)
+		{
+			portalCulling = false;
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			depthPrePass = true;
+		}
+		else if (strcmp(argv[i], "--deferred") == 0)
+		{
+			deferredShading = true;
+		}
+		else if (strcmp(argv[i], "--no-light-lists") == 0)
+		{
+			lightLists = false;
+		}
+		else if (strcmp(argv[i], "--no-lightmap") == 0)
+		{
+			lightmapEnabled = false;
+		}
+		else if (strcmp(argv[i], "--cascades") == 0 && i + 1 < argc)
+		{
+			shadowCascades = (unsigned int)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--spot-shadow-budget") == 0 && i + 1 < argc)
+		{
+			spotShadowBudget = (unsigned int)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--no-point-shadows") == 0)
+		{
+			pointShadowsEnabled = false;
+		}
+		else if (strcmp(argv[i], "--shadow-filter") == 0 && i + 1 < argc)
+		{
+			const char* filter = argv[++i];
+			if (strcmp(filter, "grid") == 0)
+			{
+				shadowFilter = SHADOW_FILTER_GRID;
+			}
+			else if (strcmp(filter, "poisson") == 0)
+			{
+				shadowFilter = SHADOW_FILTER_POISSON;
+			}
+			else if (strcmp(filter, "evsm") == 0)
+			{
+				shadowFilter = SHADOW_FILTER_EVSM;
+			}
+			else
+			{
+				printf("Unknown shadow filter '%s', using the grid\n", filter);
+			}
+		}
+		else if (strcmp(argv[i], "--shadow-taps") == 0 && i + 1 < argc)
+		{
+			shadowTaps = (unsigned int)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--ssao") == 0 && i + 1 < argc)
+		{
+			const char* resolution = argv[++i];
+			if (strcmp(resolution, "half") == 0)
+			{
+				ssaoDivisor = 2;
+			}
+			else if (strcmp(resolution, "quarter") == 0)
+			{
+				ssaoDivisor = 4;
+			}
+			else if (strcmp(resolution, "off") == 0)
+			{
+				ssaoDivisor = 0;
+			}
+			else
+			{
+				printf("Unknown ambient occlusion resolution '%s', using half\n", resolution);
+			}
+		}
+	}
+
+	// The grid is square, so its taps round down to 1, 4, 9 or 16
+	shadowTaps = std::min(std::max(shadowTaps, 1u), MAX_SHADOW_TAPS);
+	if (shadowFilter != SHADOW_FILTER_POISSON)
+	{
+		unsigned int side = 1;
+		while ((side + 1) * (side + 1) <= shadowTaps)
+		{
+			side++;
+		}
+		shadowTaps = side * side;
+	}
+
+	// A cap of 0 means uncapped
+	frameInterval = frameCap > 0.0 ? 1.0 / frameCap : 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+	ParseArguments(argc, argv);
+
+	if (runJobBenchmark)
+	{
+		RunJobBenchmark(workerCount);
+		return 0;
+	}
+
+	jobSystem.Initialise(workerCount);
+
 	printf("'WASD' - move;\n");
 	printf("'PageUp/PageDown' - Zoom IN/Zoom OUT;\n\n");
 	printf("'1' - handling light source 1;\n");
@@ -913,474 +1961,459 @@ int main()
 	printf("'B' + 'handled light source' + '-' - decrease handled light source's BLUE color intensity;\n\n");
 	printf("'N' + 'handled light source' - turn OFF handled light source;\n");
 	printf("'Y' + 'handled light source' - turn ON handled light source;\n\n");
+	printf("'P' - print the object under the screen centre;\n");
+	printf("'Z' - toggle the depth pre-pass (forward shading only);\n");
+	printf("'F' - switch between forward and deferred shading;\n");
+	printf("'M' - bake the lightmap for the current lights (used until a light moves, forward shading only);\n\n");
+	printf("Launch options: '--continuous' - redraw every frame; '--frame-cap N' - frame limit while moving (0 - no limit);\n");
+	printf("                '--workers N' - job system threads (0 - all cores); '--bench-jobs' - run the job system benchmark and exit;\n");
+	printf("                '--frames-in-flight N' - frames the CPU may run ahead of the GPU (1-3); '--frame-stats' - print frame pacing and input latency timings;\n");
+	printf("                '--no-occlusion' - draw objects hidden behind the walls, closet and door; '--no-portals' - ignore room and doorway visibility;\n");
+	printf("                '--depth-prepass' - start with the depth pre-pass on; '--deferred' - start with deferred shading;\n");
+	printf("                '--no-light-lists' - light every object with every light instead of only the lights that reach it;\n");
+	printf("                '--no-lightmap' - skip the lightmap bake and light every object per pixel;\n");
+	printf("                '--cascades N' - directional light shadow cascades (2-4, 0 - no shadows);\n");
+	printf("                '--spot-shadow-budget N' - spot light shadow maps redrawn per frame (0 - no spot light shadows);\n");
+	printf("                '--no-point-shadows' - point lights cast no shadows;\n");
+	printf("                '--shadow-filter grid|poisson|evsm' - shadow map filtering (EVSM for the directional light only); '--shadow-taps N' - taps per lookup (1-16);\n");
+	printf("                '--ssao half|quarter|off' - screen-space ambient occlusion resolution;\n\n");
 
 	mainWindow = Window(1280, 720);
 	mainWindow.Initialise();
 
-	CreateObjects();
+	shinyMaterial = Material(32.0f, 64);
+	dullMaterial = Material(0.05f, 2);
+
+	CreateLights();
+
+	framePacer.Initialise(framesInFlight);
+	cameraBuffer.Create();
+	gpuTimer.Create(framePacer.GetFramesInFlight());
+
+	if (UniformRingBuffer::IsSupported())
+	{
+		// Room for 1024 draws per frame to start with; it grows if the scene needs more
+		drawBuffer.Create(1024 * drawBuffer.GetAlignedSize(RenderQueue::GetDrawBlockSize()), framePacer.GetFramesInFlight());
+	}
+
+	// Shaders first so the driver can compile them while meshes, textures and models load
 	CreateShaders();
+	CreateObjects();
 
 	camera = Camera(glm::vec3(6.0f, 1.5f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f), -60.0f, 0.0f, 2.5f, 0.35f);
 
 	brickTexture = Texture("Textures/brick.png");
-	brickTexture.LoadTextureA();
 	dirtTexture = Texture("Textures/dirt.png");
-	dirtTexture.LoadTextureA();
 	plainTexture = Texture("Textures/plain.png");
-	plainTexture.LoadTextureA();
 	tableTexture = Texture("Textures/table.png");
-	tableTexture.LoadTextureA();
 	closetTexture = Texture("Textures/closet.png");
-	closetTexture.LoadTextureA();
 	sofaSideTexture = Texture("Textures/sofaSide.png");
-	sofaSideTexture.LoadTextureA();
 	floorTexture = Texture("Textures/floor.png");
-	floorTexture.LoadTextureA();
 	poster1Texture = Texture("Textures/poster1.png");
-	poster1Texture.LoadTextureA();
 	poster2Texture = Texture("Textures/poster2.png");
-	poster2Texture.LoadTextureA();
 	woodTexture = Texture("Textures/wood.png");
-	woodTexture.LoadTextureA();
 	monitorTexture = Texture("Textures/monitor.png");
-	monitorTexture.LoadTextureA();
 	monitorScreenTexture = Texture("Textures/monitorScreen.png");
-	monitorScreenTexture.LoadTextureA();
 	wallsTexture = Texture("Textures/walls.png");
-	wallsTexture.LoadTextureA();
 	closet_frontTexture = Texture("Textures/closet_front.png");
-	closet_frontTexture.LoadTextureA();
 
-	shinyMaterial = Material(32.0f, 64);
-	dullMaterial = Material(0.05f, 2);
+	Texture* sceneTextures[] = {
+		&brickTexture, &dirtTexture, &plainTexture, &tableTexture,
+		&closetTexture, &sofaSideTexture, &floorTexture, &poster1Texture,
+		&poster2Texture, &woodTexture, &monitorTexture, &monitorScreenTexture,
+		&wallsTexture, &closet_frontTexture
+	};
+	const unsigned int sceneTextureCount = sizeof(sceneTextures) / sizeof(sceneTextures[0]);
 
 	chair = Model();
-	chair.LoadModel("Models/chair.obj");
-
 	guitar = Model();
-	guitar.LoadModel("Models/guitar.obj");
 
-	mainLight = DirectionalLight(0.0f, 0.0f, 0.0f,
-		0.0f, 0.0f,
-		0.0f, 0.0f, 0.0f);
+	// Decode images and import models on the workers, then upload on this thread which owns the context
+	JobCounter assetsDecoded;
+	bool chairRead = false, guitarRead = false;
+	for (unsigned int i = 0; i < sceneTextureCount; i++)
+	{
+		Texture* texture = sceneTextures[i];
+		jobSystem.Run([texture]() { texture->DecodeTexture(); }, &assetsDecoded);
+	}
+	jobSystem.Run([&chairRead]() { chairRead = chair.ReadModel("Models/chair.obj"); }, &assetsDecoded);
+	jobSystem.Run([&guitarRead]() { guitarRead = guitar.ReadModel("Models/guitar.obj"); }, &assetsDecoded);
+	jobSystem.Wait(&assetsDecoded);
 
-	unsigned int pointLightCount = 0;
-	pointLights[0] = PointLight(0.8f, 0.8f, 0.7f,
-						0.5f, 1.0f,
-						2.5f, 2.9f, 1.8f,
-						0.5f, 0.2f, 0.1f);
-	pointLightCount++;
+	for (unsigned int i = 0; i < sceneTextureCount; i++)
+	{
+		sceneTextures[i]->UploadTextureA();
+	}
+	if (chairRead)
+	{
+		chair.UploadModel();
+	}
+	if (guitarRead)
+	{
+		guitar.UploadModel();
+	}
 
-	/*pointLights[1] = PointLight(1.0f, 1.0f, 0.7f,
-		0.3f, 1.0f,
-		4.5f, 1.8f, 0.6f,
-		0.5f, 0.2f, 0.1f);
-	pointLightCount++;*/
+	CreateScene();
+	CreateCells();
+	sceneBVH.Build(scene.GetAllBounds(), jobSystem);
 
-	unsigned int spotLightCount = 0;
-	spotLights[0] = SpotLight(1.0f, 1.0f, 0.5f,
-						0.5f, 1.0f,
-						4.528f, 1.87f, 0.55f,
-						-0.05f, -1.0f, 0.0f,
-						0.3f, 0.2f, 0.1f,
-						45.0f);
-	spotLightCount++;
+	if (lightmapEnabled)
+	{
+		// The same light set the first frame is published with
+		FrameState bakeFrame;
+		GatherActiveLights(bakeFrame);
+		lightmapper.Bake(scene, bakeFrame, jobSystem);
+	}
 
-	spotLights[1] = SpotLight(1.0f, 0.3f, 0.0f,
-						1.5f, 1.0f,
-						0.0f, 3.0f, 4.5f,
-						0.5f, -0.75f, -0.5f,
-						0.3f, 0.2f, 0.1f,
-						50.0f);
-	spotLightCount++;
+	GLuint uniformModel = 0, uniformSpecularIntensity = 0, uniformShininess = 0, uniformDrawLights = 0, uniformDrawLightmap = 0;
+	glm::mat4 projection = glm::perspective(glm::radians(85.0f), (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), 0.1f, 100.0f);
 
-	spotLights[2] = SpotLight(0.3f, 0.0f, 1.0f,
-						1.5f, 1.0f,
-						0.0f, 3.0f, 0.0f,
-						0.5f, -0.75f, 0.5f,
-						0.3f, 0.2f, 0.1f,
-						50.0f);
-	spotLightCount++;
+	Shader* currentShader = nullptr;
 
-	GLuint uniformProjection = 0, uniformModel = 0, uniformView = 0, uniformEyePosition = 0,
-		uniformSpecularIntensity = 0, uniformShininess = 0;
-	glm::mat4 projection = glm::perspective(glm::radians(85.0f), (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), 0.1f, 100.0f);
+	double nextFrameTime = 0.0;
+	bool hasFrame = false;
+
+	lastPostedAspect = (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight();
+	std::thread simulationThread(RunSimulation, lastPostedAspect);
 
 	// Loop until window closed
 	while (!mainWindow.getShouldClose())
 	{
-		GLfloat now = glfwGetTime(); // SDL_GetPerformanceCounter();
-		deltaTime = now - lastTime; // (now - lastTime)*1000/SDL_GetPerformanceFrequency();
-		lastTime = now;
-
-		curKey(mainWindow.getsKeys());
-
-		// Get + Handle User Input
-		glfwPollEvents();
-
-		projection = glm::perspective(camera.GetFOV(), (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), 0.1f, 100.0f);
-
-		camera.keyControl(mainWindow.getsKeys(), deltaTime);
-		camera.mouseControl(mainWindow.getXChange(), mainWindow.getYChange());
+		// Spot shadow tiles left over by the update budget are drawn in the next frames
+		bool shadowTilesPending = !deferredShading && shadowAtlas.HasPendingUpdates();
+
+		if (onDemandRendering)
+		{
+			// Sleep until input, a resize, a repaint request or a new frame from the simulation
+			if (shadowTilesPending)
+			{
+				glfwPollEvents();
+			}
+			else
+			{
+				mainWindow.waitEvents(idleWakeInterval);
+			}
+
+			// Keep to the frame cap; events keep being handled meanwhile
+			double untilNextFrame;
+			while ((untilNextFrame = nextFrameTime - glfwGetTime()) > 0.0)
+			{
+				mainWindow.waitEvents(untilNextFrame);
+			}
+		}
+		else
+		{
+			// Get + Handle User Input
+			glfwPollEvents();
+		}
+
+		// Hand new input to the simulation thread
+		PostWindowInput();
+
+		bool newFrame = frameStates.Consume();
+		bool windowChanged = mainWindow.consumeRedraw();
+		hasFrame = hasFrame || newFrame;
+
+		// Picking doesn't change the picture, so it is handled before the redraw check
+		bool pickKey = mainWindow.getsKeys()[GLFW_KEY_P];
+		if (pickKey && !lastPickKey && hasFrame)
+		{
+			PickObject(frameStates.GetReadBuffer());
+		}
+		lastPickKey = pickKey;
+
+		bool prePassKey = mainWindow.getsKeys()[GLFW_KEY_Z];
+		bool prePassToggled = prePassKey && !lastPrePassKey;
+		if (prePassToggled)
+		{
+			depthPrePass = !depthPrePass;
+			printf("Depth pre-pass %s\n", depthPrePass ? "on" : "off");
+		}
+		lastPrePassKey = prePassKey;
+
+		bool deferredKey = mainWindow.getsKeys()[GLFW_KEY_F];
+		bool deferredToggled = deferredKey && !lastDeferredKey;
+		if (deferredToggled)
+		{
+			deferredShading = !deferredShading;
+			printf("%s shading\n", deferredShading ? "Deferred" : "Forward");
+		}
+		lastDeferredKey = deferredKey;
+
+		bool lightmapKey = mainWindow.getsKeys()[GLFW_KEY_M];
+		bool lightmapRebake = lightmapKey && !lastLightmapKey && hasFrame;
+		lastLightmapKey = lightmapKey;
+
+		if (!hasFrame || (onDemandRendering && !newFrame && !windowChanged && !prePassToggled && !deferredToggled && !lightmapRebake &&
+			!shadowTilesPending))
+		{
+			continue;
+		}
+
+		if (mainWindow.getBufferWidth() == 0 || mainWindow.getBufferHeight() == 0)
+		{
+			// Minimised: nothing to draw into
+			continue;
+		}
+
+		FrameState& frame = frameStates.GetReadBuffer();
+
+		// Held until recording is done, so the simulation thread can't refit the BVH
+		// or move objects under the shadow passes and the draw stream
+		std::unique_lock<std::mutex> sceneGuard(sceneLock);
+		movedObjects.clear();
+		movedObjects.swap(pendingMovedObjects);
+
+		if (lightmapRebake)
+		{
+			// Stalls this thread for the bake; the simulation carries on meanwhile
+			printf("Baking lightmap...\n");
+			lightmapEnabled = lightmapper.Bake(scene, frame, jobSystem);
+			lightmapStaleReported = false;
+		}
+
+		nextFrameTime = glfwGetTime() + frameInterval;
+
+		projection = glm::perspective(frame.fov, (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), 0.1f, 100.0f);
+
+		// Blocks until the GPU has finished the frame that last used this slot
+		unsigned int frameSlot = framePacer.BeginFrame();
+		gpuTimer.BeginFrame(frameSlot);
 
 		// Clear the window
 		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		
-		if (curKey(mainWindow.getsKeys()) == 1) {
-			spotLights[1].ControlSpotLight(mainWindow.getsKeys(), spotLights[1], deltaTime, mainWindow);
-		};
-
-		if (curKey(mainWindow.getsKeys()) == 2) {
-			spotLights[2].ControlSpotLight(mainWindow.getsKeys(), spotLights[2], deltaTime, mainWindow);
-		};
-
-		if (curKey(mainWindow.getsKeys()) == 4) {
-			spotLights[0].ControlSpotLight(mainWindow.getsKeys(), spotLights[0], deltaTime, mainWindow);
-		};
-
-		if (curKey(mainWindow.getsKeys()) == 3) {
-			pointLights[0].ControlPointLight(mainWindow.getsKeys(), pointLights[0], deltaTime, mainWindow);
-		};
-
-		shaderList[0].UseShader();
-		uniformModel = shaderList[0].GetModelLocation();
-		uniformProjection = shaderList[0].GetProjectionLocation();
-		uniformView = shaderList[0].GetViewLocation();
-		uniformEyePosition = shaderList[0].GetEyePositionLocation();
-		uniformSpecularIntensity = shaderList[0].GetSpecularIntensityLocation();
-		uniformShininess = shaderList[0].GetShininessLocation();
 
-		glm::vec3 lowerLight = camera.getCameraPosition();
-		lowerLight.y -= 0.3f;
-		//spotLights[0].SetFlash(lowerLight, camera.getCameraDirection());
-
-		shaderList[0].SetPointLights(pointLights, pointLightCount);
-		shaderList[0].SetSpotLights(spotLights, spotLightCount);
-
-		glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projection));
-		glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(camera.calculateViewMatrix()));
-		glUniform3f(uniformEyePosition, camera.getCameraPosition().x, camera.getCameraPosition().y, camera.getCameraPosition().z);
-
-		glm::mat4 model(1.0f);	
-		
-		//walls
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		wallsTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[0]->RenderMesh();
-		//walls
-
-		//floor
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		floorTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[1]->RenderMesh();
-		//floor
-
-		//sofa
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.03f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		sofaSideTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[2]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(2.5f, 0.0f, 0.03f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		sofaSideTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[2]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.03f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		tableTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[3]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.03f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		tableTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[4]->RenderMesh();
-		//sofa
-
-		//closet
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(2.2f, 0.0f, 3.5f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		closet_frontTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[5]->RenderMesh();
-		//closet
-
-		//table
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(2.75f, 0.75f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		woodTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[6]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(2.77f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		woodTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[7]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.9f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		woodTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[8]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.901f, 0.55f, 0.02f));
-		model = glm::scale(model, glm::vec3(0.99f, 0.25f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		woodTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[8]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.901f, 0.08f, 0.02f));
-		model = glm::scale(model, glm::vec3(0.99f, 0.6f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		woodTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[8]->RenderMesh();
-		//table
-
-		//computer
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.2f, 0.88f, 0.15f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		plainTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[9]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.2f, 0.85f, 0.15f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		plainTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[10]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.62f, 0.85f, 0.67f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		plainTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[10]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.62f, 0.85f, 0.15f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		plainTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[10]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.2f, 0.85f, 0.67f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		plainTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[10]->RenderMesh();
-		//computer
-
-		//poster DOOM
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(1.6f, 1.5f, 0.02f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		poster1Texture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[11]->RenderMesh();
-		//poster DOOM
-
-		//poster Pulp Fiction
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.5f, 1.48f, 0.02f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		poster2Texture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[11]->RenderMesh();
-		//poster Pulp Fiction
-
-
-		//monitor
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.4f, 1.0f, 0.15f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.02f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		monitorTexture.UseTexture();
-		shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[12]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.65f, 0.85f, 0.05f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		monitorTexture.UseTexture();
-		shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[13]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.57f, 0.85f, 0.02f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		monitorTexture.UseTexture();
-		shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[14]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.41f, 1.03f, 0.231f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.02f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		monitorScreenTexture.UseTexture();
-		shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[18]->RenderMesh();
-		//monitor
-
-		//lamp
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.48f, 1.41f, 0.22f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0f, -0.1f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		dirtTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[15]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.52f, 1.41f, 0.26f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0f, -0.1f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		dirtTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[16]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.51f, 1.81f, 0.25f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.1f, -0.1f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		dirtTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[17]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(4.515f, 1.81f, 0.315f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-0.1f, -0.1f, 0.0f));
-		model = glm::scale(model, glm::vec3(0.75f, 0.3f, 0.8f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		plainTexture.UseTexture();
-		shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[17]->RenderMesh();
-		//lamp
-
-		//door
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.8f, 0.0f, 4.45f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		tableTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[19]->RenderMesh();
-		//door
-
-		//chair
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(3.4f, 0.0f, 1.2f));
-		model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		chair.RenderModel();
-		//chair
-
-		//plinth
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		closetTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[20]->RenderMesh();
-		//plinth
-
-		//pillows
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.8f, 0.78f, 0.07f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		closetTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[21]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(1.67f, 0.78f, 0.07f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		closetTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[21]->RenderMesh();
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.15f, 0.0f, 1.3f));
-		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		model = glm::rotate(model, glm::radians(82.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		model = glm::rotate(model, glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		closetTexture.UseTexture();
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		meshList[21]->RenderMesh();
-		//pillows
-
-		//guitar
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.48f, 0.0f, 1.5f));
-		model = glm::scale(model, glm::vec3(1.3f, 1.3f, 1.3f));
-		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		model = glm::rotate(model, glm::radians(15.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-		glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		guitar.RenderModel();
-		//guitar
+		GLfloat aspect = (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight();
+
+		// Every frame, even deferred ones, so no moved caster is missed
+		bool spotShadows = spotShadowBudget > 0 &&
+			shadowAtlas.Update(frame, frame.cullViewProjection, frame.cullFov, movedObjects, sceneBVH);
+		bool pointShadows = pointShadowsEnabled && pointShadowMaps.Update(frame, movedObjects, sceneBVH);
+
+		// Pick the smallest variant that covers the lights and features in use this frame;
+		// the deferred path sets its lights up in the light pass instead
+		bool forwardFrame = !deferredShading;
+		Shader* shader = nullptr;
+		bool occlusionPass = false;
+		if (forwardFrame)
+		{
+			ShaderFeatures features = frame.features;
+			features.drawBlock = drawBuffer.IsCreated();
+			features.lightLists = lightLists;
+			features.shadowFilter = shadowFilter;
+			features.shadowTaps = shadowTaps;
+
+			// Cascades cover the widened cull frustum (the rendered fov plus the margin), so the
+			// late latch can't turn past them
+			features.shadows = shadowCascades > 0 && cascadedShadows.Update(frame, frame.cullFov, aspect, 0.1f, sceneBVH);
+			if (features.shadows)
+			{
+				gpuTimer.Begin(GPU_TIMER_SHADOW_CASCADES);
+				cascadedShadows.Render(scene, mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
+				gpuTimer.End();
+			}
+
+			features.spotShadows = spotShadows;
+			if (features.spotShadows && shadowAtlas.HasPendingUpdates())
+			{
+				gpuTimer.Begin(GPU_TIMER_SPOT_SHADOWS);
+				shadowAtlas.Render(scene, sceneBVH, mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
+				gpuTimer.End();
+			}
+
+			features.pointShadows = pointShadows;
+			if (features.pointShadows && pointShadowMaps.HasStaleMaps())
+			{
+				gpuTimer.Begin(GPU_TIMER_POINT_SHADOWS);
+				pointShadowMaps.Render(scene, sceneBVH, mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
+				gpuTimer.End();
+			}
+
+			// New colours and intensities are summed into the atlas here; once a light
+			// moves the layers are wrong, so everything goes back to the light loop
+			features.lightmap = lightmapEnabled && lightmapper.Relight(frame);
+			if (lightmapEnabled && lightmapper.IsBaked() && !features.lightmap && !lightmapStaleReported)
+			{
+				printf("A light moved since the lightmap was baked, press 'M' to rebake\n");
+				lightmapStaleReported = true;
+			}
+			// Drawn after the late latch below, so it matches the camera the colour pass uses
+			features.ambientOcclusion = ssaoDivisor > 0 && ambientOcclusion.Resize(mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
+			occlusionPass = features.ambientOcclusion;
+
+			shader = shaderLibrary.GetVariant(features);
+			shader->UseShader();
+
+			if (shader != currentShader)
+			{
+				// Locations differ per variant but are only fetched when the variant changes
+				uniformModel = shader->GetModelLocation();
+				uniformSpecularIntensity = shader->GetSpecularIntensityLocation();
+				uniformShininess = shader->GetShininessLocation();
+				uniformDrawLights = shader->GetDrawLightsLocation();
+				uniformDrawLightmap = shader->GetDrawLightmapLocation();
+				if (features.lightmap)
+				{
+					glUniform1i(shader->GetUniformLocation(UniformHash("lightmap")), LIGHTMAP_TEXTURE_UNIT);
+				}
+				currentShader = shader;
+			}
+
+			if (features.lightmap)
+			{
+				lightmapper.UseLightmap();
+			}
+
+			if (features.shadows)
+			{
+				cascadedShadows.UseCascades(shader);
+			}
+
+			if (features.spotShadows)
+			{
+				shadowAtlas.UseAtlas(shader);
+			}
+
+			if (features.pointShadows)
+			{
+				pointShadowMaps.UseMaps(shader);
+			}
+
+			shader->SetDirectionalLight(&frame.mainLight);
+			shader->SetPointLights(frame.pointLights, frame.pointLightCount);
+			shader->SetSpotLights(frame.spotLights, frame.spotLightCount);
+		}
+
+		// Workers record and sort what the simulation thread found visible, this thread replays it
+		renderQueue.Record(scene, jobSystem, &frame.visibleObjects, lightLists ? &frame.objectLights : nullptr);
+		sceneGuard.unlock();
+
+		if (drawBuffer.IsCreated())
+		{
+			GLsizeiptr drawBytes = renderQueue.GetCommandCount() * drawBuffer.GetAlignedSize(RenderQueue::GetDrawBlockSize());
+			if (drawBytes > drawBuffer.GetSectionSize())
+			{
+				framePacer.WaitIdle();
+				drawBuffer.Grow(drawBytes);
+			}
+			drawBuffer.BeginSection(frameSlot);
+		}
+
+		// Late latch: everything above is done, so take the newest mouse movement
+		// and only now write the camera the draws will read
+		glfwPollEvents();
+		PostWindowInput();
+		glm::mat4 latchedView = LatchView(frame);
+		cameraBuffer.Update(projection, latchedView, frame.eyePosition);
+
+		if (occlusionPass)
+		{
+			// Depth at the occlusion's own resolution with plain uniforms, so the draw blocks
+			// the pre-pass or the colour pass write are left alone
+			gpuTimer.Begin(GPU_TIMER_SSAO_DEPTH);
+			ambientOcclusion.BeginDepth();
+			Shader* depthShader = depthShaderLibrary.GetVariant({});
+			depthShader->UseShader();
+			renderQueue.SubmitDepth(scene, depthShader->GetModelLocation(), nullptr);
+			gpuTimer.End();
+
+			gpuTimer.Begin(GPU_TIMER_SSAO);
+			ambientOcclusion.RenderOcclusion(projection);
+			gpuTimer.End();
+
+			gpuTimer.Begin(GPU_TIMER_SSAO_BLUR);
+			ambientOcclusion.RenderBlur();
+			gpuTimer.End();
+
+			shader->UseShader();
+			ambientOcclusion.UseOcclusion(shader);
+		}
+
+		if (!forwardFrame)
+		{
+			Shader* geometryShader = deferredRenderer.BeginGeometry(mainWindow.getBufferWidth(), mainWindow.getBufferHeight(), drawBuffer.IsCreated());
+			if (geometryShader)
+			{
+				gpuTimer.Begin(GPU_TIMER_GBUFFER);
+				renderQueue.Submit(scene, geometryShader->GetModelLocation(), geometryShader->GetSpecularIntensityLocation(), geometryShader->GetShininessLocation(),
+					geometryShader->HasDrawBlock() && drawBuffer.IsCreated() ? &drawBuffer : nullptr);
+				gpuTimer.End();
+				deferredRenderer.EndGeometry();
+
+				// Positions are rebuilt from depth with the same late-latched camera the geometry used
+				gpuTimer.Begin(GPU_TIMER_DEFERRED_LIGHTING);
+				deferredRenderer.LightScene(frame, projection * latchedView);
+				gpuTimer.End();
+			}
+			else
+			{
+				// Falls back from the next frame on
+				printf("G-buffer unavailable, switching to forward shading.\n");
+				deferredShading = false;
+			}
+		}
+		else if (depthPrePass)
+		{
+			// Lay down depth with colour writes off; the draw blocks written here are reused below
+			Shader* depthShader = depthShaderLibrary.GetVariant(GetDepthFeatures());
+			depthShader->UseShader();
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+			gpuTimer.Begin(GPU_TIMER_DEPTH_PREPASS);
+			renderQueue.SubmitDepth(scene, depthShader->GetModelLocation(),
+				depthShader->HasDrawBlock() && drawBuffer.IsCreated() ? &drawBuffer : nullptr);
+			gpuTimer.End();
+
+			// Only the nearest surface passes, so every pixel is shaded once
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthMask(GL_FALSE);
+			glDepthFunc(GL_EQUAL);
+			shader->UseShader();
+		}
+
+		if (forwardFrame)
+		{
+			gpuTimer.Begin(depthPrePass ? GPU_TIMER_SHADING_AFTER_PREPASS : GPU_TIMER_SHADING);
+			renderQueue.Submit(scene, uniformModel, uniformSpecularIntensity, uniformShininess,
+				shader->HasDrawBlock() && drawBuffer.IsCreated() ? &drawBuffer : nullptr, uniformDrawLights, uniformDrawLightmap);
+			gpuTimer.End();
+		}
+
+		if (forwardFrame && depthPrePass)
+		{
+			// glClear needs depth writes back on
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+		}
 
 		glUseProgram(0);
 
 		mainWindow.swapBuffers();
+		framePacer.EndFrame();
+		ReportInputLatency(frame, glfwGetTime());
+
+		if (printFrameStats)
+		{
+			framePacer.ReportStats(frameStatsInterval);
+			ReportGpuTimes();
+		}
 	}
 
+	inputMailbox.Shutdown();
+	simulationThread.join();
+	jobSystem.Shutdown();
+	framePacer.WaitIdle();
+	framePacer.ClearPacer();
+	gpuTimer.ClearTimer();
+	deferredRenderer.ClearRenderer();
+	lightmapper.ClearLightmapper();
+	cascadedShadows.ClearShadowMap();
+	shadowAtlas.ClearAtlas();
+	pointShadowMaps.ClearMaps();
+	ambientOcclusion.ClearOcclusion();
+	drawBuffer.ClearBuffer();
+	cameraBuffer.ClearBuffer();
+
 	return 0;
 }
\ No newline at end of file
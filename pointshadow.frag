@@ -0,0 +1,13 @@
+#version 330
+
+in vec3 FragPos;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+// Distance from the light instead of projected depth, so shading can compare
+// against a single lookup along the light-to-fragment direction
+void main()
+{
+	gl_FragDepth = length(FragPos - lightPosition) / farPlane;
+}
@@ -1,10 +1,50 @@
 #version 330
 
+// Feature switches, injected by ShaderLibrary after the #version line.
+// Without them the shader falls back to runtime light counts with every feature on.
+#ifndef DIRECTIONAL_LIGHT_ENABLED
+#define DIRECTIONAL_LIGHT_ENABLED 1
+#endif
+#ifndef SHADOWS_ENABLED
+#define SHADOWS_ENABLED 1
+#endif
+#ifndef SPECULAR_ENABLED
+#define SPECULAR_ENABLED 1
+#endif
+#ifndef DRAW_BLOCK_ENABLED
+#define DRAW_BLOCK_ENABLED 0
+#endif
+#ifndef LIGHT_LISTS_ENABLED
+#define LIGHT_LISTS_ENABLED 0
+#endif
+#ifndef LIGHTMAP_ENABLED
+#define LIGHTMAP_ENABLED 0
+#endif
+#ifndef SPOT_SHADOWS_ENABLED
+#define SPOT_SHADOWS_ENABLED 0
+#endif
+#ifndef POINT_SHADOWS_ENABLED
+#define POINT_SHADOWS_ENABLED 0
+#endif
+// 0 - rotated grid, 1 - Poisson disk, 2 - EVSM cascades (spot lights use the grid)
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER 0
+#endif
+// Hardware-compared taps per shadow lookup, a square for the grid
+#ifndef SHADOW_TAPS
+#define SHADOW_TAPS 4
+#endif
+#ifndef AMBIENT_OCCLUSION_ENABLED
+#define AMBIENT_OCCLUSION_ENABLED 0
+#endif
+
 in vec4 vCol;
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
-in vec4 DirectionalLightSpacePos;
+#if LIGHTMAP_ENABLED
+in vec2 LightmapCoord;
+#endif
 
 out vec4 colour;
 
@@ -54,84 +94,382 @@ uniform PointLight pointLights[MAX_POINT_LIGHTS];
 uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
 
 uniform sampler2D theTexture;
-uniform sampler2D directionalShadowMap;
+#if SHADOWS_ENABLED
+const int MAX_CASCADES = 4;
+
+// Cascades of the directional light's shadow map, layers of one array (see CascadedShadowMap);
+// their exponential moments with EVSM
+#if SHADOW_FILTER == 2
+uniform sampler2DArray directionalShadowMap;
+#else
+uniform sampler2DArrayShadow directionalShadowMap;
+#endif
+uniform mat4 cascadeTransforms[MAX_CASCADES];
+// Distance along the view where each cascade ends
+uniform vec4 cascadeSplits;
+uniform int cascadeCount;
+#endif
+#if SPOT_SHADOWS_ENABLED
+// Spot light shadow maps, tiles of one atlas (see ShadowAtlas), indexed like spotLights.
+// The transforms go straight to atlas UVs; tiles are the rectangles in them, empty while
+// a light has no map.
+uniform sampler2DShadow spotShadowAtlas;
+uniform mat4 spotShadowTransforms[MAX_SPOT_LIGHTS];
+uniform vec4 spotShadowTiles[MAX_SPOT_LIGHTS];
+#endif
+#if POINT_SHADOWS_ENABLED
+// Distance from the light over the far plane, a cube per point light (see PointShadowMaps);
+// a far plane of 0 means the light has no map
+uniform samplerCubeShadow pointShadowMaps[MAX_POINT_LIGHTS];
+uniform float pointShadowFarPlanes[MAX_POINT_LIGHTS];
+#endif
+#if LIGHTMAP_ENABLED
+// Ambient and diffuse of the static lights, direct and one bounce; a - the ambient share
+uniform sampler2D lightmap;
+#endif
+#if AMBIENT_OCCLUSION_ENABLED
+// r - ambient light reaching each texel, g - its view depth, at a fraction of the
+// window's size (see AmbientOcclusion); occlusionScale takes gl_FragCoord there
+uniform sampler2D ambientOcclusion;
+uniform vec2 occlusionScale;
+#endif
 
+#if DRAW_BLOCK_ENABLED
+// Per-draw data from the uniform ring buffer; drawMaterial.x - specular intensity, .y - shininess,
+// drawLights - the lights reaching this draw (see below), drawLightmap - see shader.vert
+layout(std140) uniform DrawBlock
+{
+	mat4 model;
+	vec4 drawMaterial;
+	ivec4 drawLights;
+	vec4 drawLightmap;
+};
+#define MATERIAL_SPECULAR_INTENSITY drawMaterial.x
+#define MATERIAL_SHININESS drawMaterial.y
+#else
 uniform Material material;
+#define MATERIAL_SPECULAR_INTENSITY material.specularIntensity
+#define MATERIAL_SHININESS material.shininess
+#if LIGHT_LISTS_ENABLED
+uniform ivec4 drawLights;
+#endif
+#if LIGHTMAP_ENABLED
+uniform vec4 drawLightmap;
+#endif
+#endif
 
-uniform vec3 eyePosition;
+// drawLights.x - point light count, .y - their indices, .z - spot light count,
+// .w - their indices; 8 bits per index, first light in the low byte
+#define LIGHT_LIST_INDEX(packed, i) (((packed) >> (8 * (i))) & 0xFF)
+
+// Shared with shader.vert; eyePosition.w is unused
+layout(std140) uniform CameraBlock
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePosition;
+};
 
+// How much ambient light reaches the fragment, 1 without occlusion
+float ambientVisibility = 1.0;
+
+// Set for lightmapped draws, whose ambient and diffuse are baked: the light loop then
+// only adds the specular, which depends on the eye
+bool specularOnly = false;
+
+#if AMBIENT_OCCLUSION_ENABLED
+// Bilinear between the four nearest occlusion texels, each weighed down the further
+// its depth is from the fragment's, so occlusion doesn't bleed across edges
+float SampleAmbientOcclusion()
+{
+	float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+	vec2 position = gl_FragCoord.xy * occlusionScale - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = position - vec2(base);
+	ivec2 last = textureSize(ambientOcclusion, 0) - 1;
+
+	float total = 0.0;
+	float weights = 0.0;
+	for(int i = 0; i < 4; i++)
+	{
+		ivec2 corner = ivec2(i & 1, i >> 1);
+		vec2 texel = texelFetch(ambientOcclusion, clamp(base + corner, ivec2(0), last), 0).rg;
+		vec2 bilinear = mix(1.0 - f, f, vec2(corner));
+		float weight = bilinear.x * bilinear.y / (0.001 + abs(texel.g - viewDepth));
+		total += texel.r * weight;
+		weights += weight;
+	}
+
+	return weights > 0.0 ? total / weights : 1.0;
+}
+#endif
+
+#if SHADOWS_ENABLED || SPOT_SHADOWS_ENABLED
+#if SHADOW_FILTER == 1
+const vec2 POISSON_DISK[16] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725), vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464), vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420), vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590), vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
+#elif SHADOW_TAPS >= 16
+#define SHADOW_GRID_SIZE 4
+#elif SHADOW_TAPS >= 9
+#define SHADOW_GRID_SIZE 3
+#elif SHADOW_TAPS >= 4
+#define SHADOW_GRID_SIZE 2
+#else
+#define SHADOW_GRID_SIZE 1
+#endif
+
+// Every tap is already a 2x2 PCF from the comparison sampler, so taps sit two texels apart
+// and cover what four times as many manual compares would
+const float SHADOW_TAP_SPACING = 2.0;
+
+vec2 ShadowKernelRotation()
+{
+#if SHADOW_FILTER == 1
+	// Interleaved gradient noise turns the disk per pixel, trading banding for fine noise
+	float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	float angle = 6.2831853 * noise;
+#else
+	// Turned by atan(1/2) so the grid's rows don't line up with the texels
+	float angle = 0.4636476;
+#endif
+	return vec2(cos(angle), sin(angle));
+}
+
+int ShadowKernelTaps()
+{
+#if SHADOW_FILTER == 1
+	return SHADOW_TAPS;
+#else
+	return SHADOW_GRID_SIZE * SHADOW_GRID_SIZE;
+#endif
+}
+
+// Offset of tap i in texels
+vec2 ShadowKernelOffset(int i, vec2 rotation)
+{
+#if SHADOW_FILTER == 1
+	vec2 offset = POISSON_DISK[i] * SHADOW_TAP_SPACING;
+#else
+	vec2 offset = (vec2(i % SHADOW_GRID_SIZE, i / SHADOW_GRID_SIZE) - 0.5 * float(SHADOW_GRID_SIZE - 1)) * SHADOW_TAP_SPACING;
+#endif
+	return vec2(offset.x * rotation.x - offset.y * rotation.y, offset.x * rotation.y + offset.y * rotation.x);
+}
+#endif
+
+#if SHADOWS_ENABLED && SHADOW_FILTER == 2
+// Must match shadowmoments.frag
+const float POSITIVE_EXPONENT = 40.0;
+const float NEGATIVE_EXPONENT = 5.0;
+
+float ChebyshevUpperBound(vec2 moments, float depth, float minVariance)
+{
+	if(depth <= moments.x)
+	{
+		return 1.0;
+	}
+
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float d = depth - moments.x;
+	return variance / (variance + d * d);
+}
+
+float CalcMomentShadowFactor(vec3 projCoords, int cascade)
+{
+	vec4 moments = texture(directionalShadowMap, vec3(projCoords.xy, cascade));
+
+	float depth = 2.0 * projCoords.z - 1.0;
+	float positive = exp(POSITIVE_EXPONENT * depth);
+	float negative = -exp(-NEGATIVE_EXPONENT * depth);
+
+	// The smallest variance is scaled by each warp's slope so both behave alike
+	const float MIN_VARIANCE = 0.00002;
+	float positiveSlope = POSITIVE_EXPONENT * positive;
+	float negativeSlope = NEGATIVE_EXPONENT * negative;
+	float visibility = min(ChebyshevUpperBound(moments.xy, positive, MIN_VARIANCE * positiveSlope * positiveSlope),
+		ChebyshevUpperBound(moments.zw, negative, MIN_VARIANCE * negativeSlope * negativeSlope));
+
+	// Cuts off the tail that shows as light bleeding where shadows overlap
+	return 1.0 - clamp((visibility - 0.2) / 0.8, 0.0, 1.0);
+}
+#endif
+
+#if SHADOWS_ENABLED
 float CalcDirectionalShadowFactor(DirectionalLight light)
 {
-	vec3 projCoords = DirectionalLightSpacePos.xyz / DirectionalLightSpacePos.w;
+	// The nearest cascade that still covers the fragment; beyond the last one nothing is shadowed
+	float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+	if(viewDepth > cascadeSplits[cascadeCount - 1])
+	{
+		return 0.0;
+	}
+
+	int cascade = 0;
+	while(cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])
+	{
+		cascade++;
+	}
+
+	vec4 lightSpacePos = cascadeTransforms[cascade] * vec4(FragPos, 1.0);
+	vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
 	projCoords = (projCoords * 0.5) + 0.5;
-	
-	float current = projCoords.z;
-	
+
+	if(projCoords.z > 1.0)
+	{
+		return 0.0;
+	}
+
+#if SHADOW_FILTER == 2
+	if(any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThan(projCoords.xy, vec2(1.0))))
+	{
+		return 0.0;
+	}
+
+	return CalcMomentShadowFactor(projCoords, cascade);
+#else
 	vec3 normal = normalize(Normal);
 	vec3 lightDir = normalize(directionalLight.direction);
 	
 	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.0005);
+	float current = projCoords.z - bias;
 
-	
-	float shadow = 0.0;
-	vec2 texelSize = 1.0 / textureSize(directionalShadowMap, 0);
-	for(int x = -1; x <= 1; ++x)
+	// Outside the cascade the border compares as lit
+	float lit = 0.0;
+	vec2 texelSize = 1.0 / textureSize(directionalShadowMap, 0).xy;
+	vec2 rotation = ShadowKernelRotation();
+	int taps = ShadowKernelTaps();
+	for(int i = 0; i < taps; i++)
 	{
-		for(int y = -1; y <= 1; ++y)
-		{
-			float pcfDepth = texture(directionalShadowMap, projCoords.xy + vec2(x,y) * texelSize).r;
-			shadow += current - bias > pcfDepth ? 1.0 : 0.0;
-		}
+		vec2 coord = projCoords.xy + ShadowKernelOffset(i, rotation) * texelSize;
+		lit += texture(directionalShadowMap, vec4(coord, cascade, current));
 	}
 
-	shadow /= 9.0;
-	
+	return 1.0 - lit / float(taps);
+#endif
+}
+#endif
+
+#if SPOT_SHADOWS_ENABLED
+float CalcSpotShadowFactor(int index)
+{
+	vec4 tile = spotShadowTiles[index];
+	vec4 lightSpacePos = spotShadowTransforms[index] * vec4(FragPos, 1.0);
+	if(tile.z <= tile.x || lightSpacePos.w <= 0.0)
+	{
+		return 0.0;
+	}
+
+	vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
 	if(projCoords.z > 1.0)
 	{
-		shadow = 0.0;
-	}									
-	
-	return shadow;
+		return 0.0;
+	}
+
+	// The atlas was drawn with a slope-scaled polygon offset, so only a small bias is left here
+	float current = projCoords.z - 0.0002;
+
+	// Tiles are inset half a texel, so no tap's 2x2 footprint reaches a neighbouring tile
+	float lit = 0.0;
+	vec2 texelSize = 1.0 / textureSize(spotShadowAtlas, 0);
+	vec2 rotation = ShadowKernelRotation();
+	int taps = ShadowKernelTaps();
+	for(int i = 0; i < taps; i++)
+	{
+		vec2 coord = clamp(projCoords.xy + ShadowKernelOffset(i, rotation) * texelSize, tile.xy, tile.zw);
+		lit += texture(spotShadowAtlas, vec3(coord, current));
+	}
+
+	return 1.0 - lit / float(taps);
 }
+#endif
+
+#if POINT_SHADOWS_ENABLED
+float CalcPointShadowFactor(int index)
+{
+	float farPlane = pointShadowFarPlanes[index];
+	vec3 fromLight = FragPos - pointLights[index].position;
+	float current = length(fromLight);
+	if(farPlane <= 0.0 || current >= farPlane)
+	{
+		return 0.0;
+	}
+
+	// Distances are linear, so the bias is in world units. Lit faces have normals along
+	// fromLight here, as in CalcPointLight's diffuse term
+	float bias = max(0.05 * (1.0 - dot(normalize(Normal), fromLight / current)), 0.01);
+	vec4 lookup = vec4(fromLight, (current - bias) / farPlane);
+
+	// One lookup, compared and 2x2 filtered by the sampler. GLSL 3.30 only indexes
+	// sampler arrays with constants.
+	float lit;
+	if(index == 0)
+	{
+		lit = texture(pointShadowMaps[0], lookup);
+	}
+	else if(index == 1)
+	{
+		lit = texture(pointShadowMaps[1], lookup);
+	}
+	else
+	{
+		lit = texture(pointShadowMaps[2], lookup);
+	}
+
+	return 1.0 - lit;
+}
+#endif
 
 vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor)
 {
-	vec4 ambientColour = vec4(light.colour, 1.0f) * light.ambientIntensity;
+	vec4 ambientColour = vec4(light.colour, 1.0f) * light.ambientIntensity * ambientVisibility;
 	
 	float diffuseFactor = max(dot(normalize(Normal), normalize(direction)), 0.0f);
 	vec4 diffuseColour = vec4(light.colour * light.diffuseIntensity * diffuseFactor, 1.0f);
 	
 	vec4 specularColour = vec4(0, 0, 0, 0);
 	
+#if SPECULAR_ENABLED
 	if(diffuseFactor > 0.0f)
 	{
-		vec3 fragToEye = normalize(eyePosition - FragPos);
+		vec3 fragToEye = normalize(eyePosition.xyz - FragPos);
 		vec3 reflectedVertex = normalize(reflect(direction, normalize(Normal)));
 		
 		float specularFactor = dot(fragToEye, reflectedVertex);
 		if(specularFactor > 0.0f)
 		{
-			specularFactor = pow(specularFactor, material.shininess);
-			specularColour = vec4(light.colour * material.specularIntensity * specularFactor, 1.0f);
+			specularFactor = pow(specularFactor, MATERIAL_SHININESS);
+			specularColour = vec4(light.colour * MATERIAL_SPECULAR_INTENSITY * specularFactor, 1.0f);
 		}
 	}
+#endif
+
+	if(specularOnly)
+	{
+		return (1.0 - shadowFactor) * specularColour;
+	}
 
 	return (ambientColour + (1.0 - shadowFactor) * (diffuseColour + specularColour));
 }
 
 vec4 CalcDirectionalLight()
 {
+#if SHADOWS_ENABLED
 	float shadowFactor = CalcDirectionalShadowFactor(directionalLight);
+#else
+	float shadowFactor = 0.0f;
+#endif
 	return CalcLightByDirection(directionalLight.base, directionalLight.direction, shadowFactor);
 }
 
-vec4 CalcPointLight(PointLight pLight)
+vec4 CalcPointLight(PointLight pLight, float shadowFactor)
 {
 	vec3 direction = FragPos - pLight.position;
 	float distance = length(direction);
 	direction = normalize(direction);
 	
-	vec4 colour = CalcLightByDirection(pLight.base, direction, 0.0f);
+	vec4 colour = CalcLightByDirection(pLight.base, direction, shadowFactor);
 	float attenuation = pLight.exponent * distance * distance +
 						pLight.linear * distance +
 						pLight.constant;
@@ -139,14 +477,20 @@ vec4 CalcPointLight(PointLight pLight)
 	return (colour / attenuation);
 }
 
-vec4 CalcSpotLight(SpotLight sLight)
+// index - into spotLights, for the light's shadow tile
+vec4 CalcSpotLight(SpotLight sLight, int index)
 {
 	vec3 rayDirection = normalize(FragPos - sLight.base.position);
 	float slFactor = dot(rayDirection, sLight.direction);
 	
 	if(slFactor > sLight.edge)
 	{
-		vec4 colour = CalcPointLight(sLight.base);
+#if SPOT_SHADOWS_ENABLED
+		float shadowFactor = CalcSpotShadowFactor(index);
+#else
+		float shadowFactor = 0.0f;
+#endif
+		vec4 colour = CalcPointLight(sLight.base, shadowFactor);
 		
 		return colour * (1.0f - (1.0f - slFactor)*(1.0f/(1.0f - sLight.edge)));
 		
@@ -158,9 +502,25 @@ vec4 CalcSpotLight(SpotLight sLight)
 vec4 CalcPointLights()
 {
 	vec4 totalColour = vec4(0, 0, 0, 0);
+#if LIGHT_LISTS_ENABLED
+	for(int i = 0; i < drawLights.x; i++)
+#elif defined(POINT_LIGHT_COUNT)
+	for(int i = 0; i < POINT_LIGHT_COUNT; i++)
+#else
 	for(int i = 0; i < pointLightCount; i++)
-	{		
-		totalColour += CalcPointLight(pointLights[i]);
+#endif
+	{
+#if LIGHT_LISTS_ENABLED
+		int index = LIGHT_LIST_INDEX(drawLights.y, i);
+#else
+		int index = i;
+#endif
+#if POINT_SHADOWS_ENABLED
+		float shadowFactor = CalcPointShadowFactor(index);
+#else
+		float shadowFactor = 0.0f;
+#endif
+		totalColour += CalcPointLight(pointLights[index], shadowFactor);
 	}
 	
 	return totalColour;
@@ -169,9 +529,20 @@ vec4 CalcPointLights()
 vec4 CalcSpotLights()
 {
 	vec4 totalColour = vec4(0, 0, 0, 0);
+#if LIGHT_LISTS_ENABLED
+	for(int i = 0; i < drawLights.z; i++)
+#elif defined(SPOT_LIGHT_COUNT)
+	for(int i = 0; i < SPOT_LIGHT_COUNT; i++)
+#else
 	for(int i = 0; i < spotLightCount; i++)
-	{		
-		totalColour += CalcSpotLight(spotLights[i]);
+#endif
+	{
+#if LIGHT_LISTS_ENABLED
+		int index = LIGHT_LIST_INDEX(drawLights.w, i);
+#else
+		int index = i;
+#endif
+		totalColour += CalcSpotLight(spotLights[index], index);
 	}
 	
 	return totalColour;
@@ -179,7 +550,38 @@ vec4 CalcSpotLights()
 
 void main()
 {
+#if AMBIENT_OCCLUSION_ENABLED
+	ambientVisibility = SampleAmbientOcclusion();
+#endif
+
+#if LIGHTMAP_ENABLED
+	// Baked objects take ambient and diffuse from the atlas and only run the light loop for
+	// the specular; drawLightmap.x is 0 for everything outside the atlas
+	if(drawLightmap.x > 0.0)
+	{
+		vec4 baked = texture(lightmap, LightmapCoord);
+		// Only the ambient share is occluded, direct light already has its baked shadows
+		baked.rgb *= 1.0 - baked.a * (1.0 - ambientVisibility);
+
+		vec4 specular = vec4(0, 0, 0, 0);
+#if SPECULAR_ENABLED
+		specularOnly = true;
+#if DIRECTIONAL_LIGHT_ENABLED
+		specular += CalcDirectionalLight();
+#endif
+		specular += CalcPointLights();
+		specular += CalcSpotLights();
+#endif
+		colour = texture(theTexture, TexCoord) * vec4(baked.rgb + specular.rgb, 1.0);
+		return;
+	}
+#endif
+
+#if DIRECTIONAL_LIGHT_ENABLED
 	vec4 finalColour = CalcDirectionalLight();
+#else
+	vec4 finalColour = vec4(0, 0, 0, 0);
+#endif
 	finalColour += CalcPointLights();
 	finalColour += CalcSpotLights();
 	
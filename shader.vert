@@ -1,24 +1,55 @@
 #version 330
 
+#ifndef DRAW_BLOCK_ENABLED
+#define DRAW_BLOCK_ENABLED 0
+#endif
+#ifndef LIGHTMAP_ENABLED
+#define LIGHTMAP_ENABLED 0
+#endif
+
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec2 tex;
 layout (location = 2) in vec3 norm;
+// Lightmap chart UVs, only on meshes unwrapped by Lightmapper
+layout (location = 3) in vec2 lightmapTex;
+
+// Same transform as depth.vert, so the pre-pass depth matches exactly
+invariant gl_Position;
 
 out vec4 vCol;
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
-out vec4 DirectionalLightSpacePos;
+#if LIGHTMAP_ENABLED
+out vec2 LightmapCoord;
+#endif
 
+#if DRAW_BLOCK_ENABLED
+// Must match the block in shader.frag
+layout(std140) uniform DrawBlock
+{
+	mat4 model;
+	vec4 drawMaterial;
+	ivec4 drawLights;
+	vec4 drawLightmap;
+};
+#else
 uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 directionalLightTransform;
+#if LIGHTMAP_ENABLED
+uniform vec4 drawLightmap;
+#endif
+#endif
+// Written by CameraBuffer just before submit; must match the block in shader.frag
+layout(std140) uniform CameraBlock
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePosition;
+};
 
 void main()
 {
 	gl_Position = projection * view * model * vec4(pos, 1.0);
-	DirectionalLightSpacePos = directionalLightTransform * model * vec4(pos, 1.0);
 	
 	vCol = vec4(clamp(pos, 0.0f, 1.0f), 1.0f);
 	
@@ -27,4 +58,8 @@ void main()
 	Normal = mat3(transpose(inverse(model))) * norm;
 	
 	FragPos = (model * vec4(pos, 1.0)).xyz; 
+#if LIGHTMAP_ENABLED
+	// drawLightmap places this object's charts in the atlas
+	LightmapCoord = lightmapTex * drawLightmap.xy + drawLightmap.zw;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,12 @@
+#version 330
+
+// Cascaded and point light shadow passes: positions only, taken to world space
+// here and into each cascade or cube face by shadow.geom or pointshadow.geom
+layout (location = 0) in vec3 pos;
+
+uniform mat4 model;
+
+void main()
+{
+	gl_Position = model * vec4(pos, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330
+
+// Second half of prefiltering a cascade for EVSM: blurs shadowmoments.frag's
+// output along y, into the cascade's layer of the moments array
+
+uniform sampler2D horizontalMoments;
+
+out vec4 moments;
+
+// Binomial weights, summing to 16
+const float WEIGHTS[5] = float[](1.0, 4.0, 6.0, 4.0, 1.0);
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int last = textureSize(horizontalMoments, 0).y - 1;
+
+	vec4 total = vec4(0.0);
+	for(int i = 0; i < 5; i++)
+	{
+		total += WEIGHTS[i] * texelFetch(horizontalMoments, ivec2(texel.x, clamp(texel.y + i - 2, 0, last)), 0);
+	}
+
+	moments = total / 16.0;
+}
@@ -0,0 +1,47 @@
+#version 330
+
+// First half of prefiltering a cascade for EVSM: warps its depths into
+// exponential moments at half resolution, blurred along x. shadowblur.frag
+// then blurs them along y.
+
+uniform sampler2DArray depthMaps;
+uniform int cascade;
+
+out vec4 moments;
+
+// Must match shader.frag; 40 is as far as 32-bit floats take the positive warp
+const float POSITIVE_EXPONENT = 40.0;
+const float NEGATIVE_EXPONENT = 5.0;
+
+// Binomial weights, summing to 16
+const float WEIGHTS[5] = float[](1.0, 4.0, 6.0, 4.0, 1.0);
+
+vec4 WarpDepth(float depth)
+{
+	depth = 2.0 * depth - 1.0;
+	float positive = exp(POSITIVE_EXPONENT * depth);
+	float negative = -exp(-NEGATIVE_EXPONENT * depth);
+	return vec4(positive, positive * positive, negative, negative * negative);
+}
+
+void main()
+{
+	// Every output texel stands for 2x2 depths, so the taps step two depths at a time
+	ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+	ivec2 last = textureSize(depthMaps, 0).xy - 1;
+
+	vec4 total = vec4(0.0);
+	for(int i = 0; i < 5; i++)
+	{
+		for(int y = 0; y < 2; y++)
+		{
+			for(int x = 0; x < 2; x++)
+			{
+				ivec2 coord = clamp(texel + ivec2(2 * (i - 2) + x, y), ivec2(0), last);
+				total += WEIGHTS[i] * WarpDepth(texelFetch(depthMaps, ivec3(coord, cascade), 0).r);
+			}
+		}
+	}
+
+	moments = total / 64.0;
+}
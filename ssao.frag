@@ -0,0 +1,82 @@
+#version 330
+
+// Ambient occlusion at reduced resolution from the depths alone: positions are
+// rebuilt through the inverse projection, normals from neighbouring positions,
+// and points around each one in its hemisphere are tested against the depths.
+
+uniform sampler2D depthMap;
+uniform mat4 projection;
+uniform mat4 inverseProjection;
+
+// r - ambient light that reaches the point, g - its distance along the view
+out vec2 occlusion;
+
+const int SAMPLE_COUNT = 12;
+// View-space reach of the samples; the room is 6 units across
+const float RADIUS = 0.4;
+const float BIAS = 0.02;
+
+vec3 ViewPosition(ivec2 texel)
+{
+	float depth = texelFetch(depthMap, texel, 0).r;
+	vec2 uv = (vec2(texel) + 0.5) / vec2(textureSize(depthMap, 0));
+	vec4 position = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 last = textureSize(depthMap, 0) - 1;
+
+	// Nothing drawn here: unoccluded, and far enough that the upsample never picks it
+	if(texelFetch(depthMap, texel, 0).r >= 1.0)
+	{
+		occlusion = vec2(1.0, 1000.0);
+		return;
+	}
+
+	vec3 position = ViewPosition(texel);
+
+	// Of the neighbours either side, the one closer in depth is on the same surface,
+	// so normals stay flat up to silhouettes
+	vec3 left = ViewPosition(max(texel - ivec2(1, 0), ivec2(0)));
+	vec3 right = ViewPosition(min(texel + ivec2(1, 0), last));
+	vec3 down = ViewPosition(max(texel - ivec2(0, 1), ivec2(0)));
+	vec3 up = ViewPosition(min(texel + ivec2(0, 1), last));
+	vec3 dx = abs(right.z - position.z) < abs(position.z - left.z) ? right - position : position - left;
+	vec3 dy = abs(up.z - position.z) < abs(position.z - down.z) ? up - position : position - down;
+	vec3 normal = normalize(cross(dx, dy));
+
+	// Interleaved gradient noise turns the kernel per pixel; ssaoblur.frag averages it out
+	float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+
+	vec3 tangent = normalize(cross(abs(normal.x) > 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), normal));
+	vec3 bitangent = cross(normal, tangent);
+
+	float occluded = 0.0;
+	for(int i = 0; i < SAMPLE_COUNT; i++)
+	{
+		// A golden-angle spiral over the hemisphere, closer in for the first samples
+		float height = 1.0 - (float(i) + 0.5) / float(SAMPLE_COUNT);
+		float angle = 2.3999632 * float(i) + 6.2831853 * noise;
+		float ring = sqrt(1.0 - height * height);
+		vec3 direction = tangent * (ring * cos(angle)) + bitangent * (ring * sin(angle)) + normal * height;
+		float scale = (float(i) + noise) / float(SAMPLE_COUNT);
+		vec3 samplePosition = position + direction * RADIUS * mix(0.1, 1.0, scale * scale);
+
+		vec4 projected = projection * vec4(samplePosition, 1.0);
+		vec2 uv = projected.xy / projected.w * 0.5 + 0.5;
+		if(any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+		{
+			continue;
+		}
+
+		// Surfaces well in front of the point don't occlude it
+		float sceneDepth = ViewPosition(ivec2(uv * vec2(last + 1))).z;
+		float inRange = smoothstep(0.0, 1.0, RADIUS / abs(position.z - sceneDepth));
+		occluded += (sceneDepth >= samplePosition.z + BIAS ? 1.0 : 0.0) * inRange;
+	}
+
+	occlusion = vec2(1.0 - occluded / float(SAMPLE_COUNT), -position.z);
+}
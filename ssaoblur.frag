@@ -0,0 +1,31 @@
+#version 330
+
+// Averages ssao.frag's noise over 5x5 texels, leaving out neighbours at another
+// depth so occlusion doesn't bleed across edges
+
+uniform sampler2D occlusionMap;
+
+out vec2 occlusion;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 last = textureSize(occlusionMap, 0) - 1;
+	vec2 centre = texelFetch(occlusionMap, texel, 0).rg;
+
+	float total = 0.0;
+	float weights = 0.0;
+	for(int y = -2; y <= 2; y++)
+	{
+		for(int x = -2; x <= 2; x++)
+		{
+			vec2 neighbour = texelFetch(occlusionMap, clamp(texel + ivec2(x, y), ivec2(0), last), 0).rg;
+			float weight = clamp(1.0 - abs(neighbour.g - centre.g) / (0.05 * centre.g), 0.0, 1.0);
+			total += neighbour.r * weight;
+			weights += weight;
+		}
+	}
+
+	// The centre always counts fully, so weights is never 0
+	occlusion = vec2(total / weights, centre.g);
+}